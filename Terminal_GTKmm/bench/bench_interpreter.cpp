@@ -0,0 +1,334 @@
+/*
+ * References:
+ *    https://www.lua.org/manual/5.4/manual.html#lua_newstate
+ *    https://docs.python.org/3/c-api/init.html
+ *
+ * Micro-benchmarks of the execution engine: first call, per-call overhead
+ * on trivial commands, output throughput and state creation costs, for
+ * every language. Prints a table, and JSON with --json FILE ("-" for
+ * stdout) so that results can be compared between versions.
+ *
+ *    bench_interpreter [--json FILE] [--filter TEXT] [--quick]
+ *
+ * Allocations are the C++ heap allocations (operator new) per call.
+ */
+#include "interpreter.hpp"
+#include "lua_pool.hpp"
+#include "pipeline.hpp"
+#include "python_runtime.hpp"
+#include "python_writer.hpp"
+#include "result_cache.hpp"
+
+#include <Python.h>
+#include <lua.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> s_allocations{0};
+
+} // namespace
+
+// Counting allocator for the whole program
+auto operator new(size_t size) -> void * {
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  std::string name;
+  size_t iterations{0};
+  std::vector<double> samples; // Seconds per call
+  double allocations{0};       // Per call
+  uint64_t bytes{0};           // Output per call
+};
+
+struct Options {
+  std::string json;
+  std::string filter;
+  bool quick{false};
+};
+
+auto percentile(std::vector<double> sorted, double p) -> double {
+  if (sorted.empty()) {
+    return 0;
+  }
+  std::sort(sorted.begin(), sorted.end());
+  auto index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+class Bench {
+public:
+  explicit Bench(const Options &options) : m_options(options) {}
+
+  // Times f iterations times; f returns the output bytes it produced
+  void run(const std::string &name, size_t iterations,
+           const std::function<uint64_t()> &f) {
+    if (!m_options.filter.empty() &&
+        name.find(m_options.filter) == std::string::npos) {
+      return;
+    }
+    if (m_options.quick) {
+      iterations = std::max<size_t>(1, iterations / 10);
+    }
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.samples.reserve(iterations);
+    uint64_t allocations = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+      auto before = s_allocations.load(std::memory_order_relaxed);
+      auto start = Clock::now();
+      result.bytes = f();
+      auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+      allocations += s_allocations.load(std::memory_order_relaxed) - before;
+      result.samples.push_back(elapsed.count());
+    }
+    result.allocations = static_cast<double>(allocations) / iterations;
+
+    print(result);
+    m_results.push_back(std::move(result));
+  }
+
+  void write_json() const {
+    if (m_options.json.empty()) {
+      return;
+    }
+    std::FILE *out = m_options.json == "-"
+                         ? stdout
+                         : std::fopen(m_options.json.c_str(), "w");
+    if (!out) {
+      std::fprintf(stderr, "Failed to open %s\n", m_options.json.c_str());
+      return;
+    }
+    std::fprintf(out, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < m_results.size(); ++i) {
+      const auto &r = m_results[i];
+      std::fprintf(out,
+                   "    {\"name\": \"%s\", \"iterations\": %zu, "
+                   "\"min_s\": %.9g, \"p50_s\": %.9g, \"p90_s\": %.9g, "
+                   "\"p99_s\": %.9g, \"max_s\": %.9g, "
+                   "\"allocations_per_call\": %.2f, \"bytes_per_call\": %llu}%s\n",
+                   r.name.c_str(), r.iterations, percentile(r.samples, 0),
+                   percentile(r.samples, 0.5), percentile(r.samples, 0.9),
+                   percentile(r.samples, 0.99), percentile(r.samples, 1),
+                   r.allocations, static_cast<unsigned long long>(r.bytes),
+                   i + 1 < m_results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout) {
+      std::fclose(out);
+    }
+  }
+
+private:
+  Options m_options;
+  std::vector<Result> m_results;
+
+  static void print(const Result &r) {
+    double p50 = percentile(r.samples, 0.5);
+    std::printf("%-28s %8zu  p50 %10.3f us  p90 %10.3f us  p99 %10.3f us"
+                "  %8.1f allocs",
+                r.name.c_str(), r.iterations, p50 * 1e6,
+                percentile(r.samples, 0.9) * 1e6,
+                percentile(r.samples, 0.99) * 1e6, r.allocations);
+    if (r.bytes > 0 && p50 > 0) {
+      std::printf("  %8.1f MB/s", r.bytes / p50 / 1e6);
+    }
+    std::printf("\n");
+  }
+};
+
+// Runs a command, counting (and discarding) its output
+auto execute(Interpreter &session, const std::string &command, int language)
+    -> uint64_t {
+  uint64_t bytes = 0;
+  session.execute_command(
+      command, language,
+      [&bytes](std::string_view chunk, bool) { bytes += chunk.size(); });
+  return bytes;
+}
+
+// Commands printing `lines` lines of 64 bytes
+auto output_command(int language, size_t lines) -> std::string {
+  auto count = std::to_string(lines);
+  switch (language) {
+  case Interpreter::Languages::BASH:
+    return "yes " + std::string(63, 'x') + " | head -n " + count;
+  case Interpreter::Languages::PYTHON:
+    return "line = '" + std::string(63, 'x') + "'\nfor _ in range(" + count +
+           "):\n    print(line)";
+  default:
+    return "local line = string.rep('x', 63)\nfor _ = 1, " + count +
+           " do print(line) end";
+  }
+}
+
+// Scripts of `lines` statements that print nothing, for compilation cost
+auto script_command(int language, size_t lines) -> std::string {
+  std::string script = "local total = 0\n";
+  if (language == Interpreter::Languages::PYTHON) {
+    script = "total = 0\n";
+  }
+  for (size_t i = 0; i < lines; ++i) {
+    script += "total = total + " + std::to_string(i) + " * 2\n";
+  }
+  return script;
+}
+
+auto parse_options(int argc, char *argv[]) -> Options {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (argument == "--json" && i + 1 < argc) {
+      options.json = argv[++i];
+    } else if (argument == "--filter" && i + 1 < argc) {
+      options.filter = argv[++i];
+    } else if (argument == "--quick") {
+      options.quick = true;
+    } else {
+      std::fprintf(stderr, "Usage: %s [--json FILE] [--filter TEXT] [--quick]\n",
+                   argv[0]);
+      std::exit(2);
+    }
+  }
+  return options;
+}
+
+} // namespace
+
+auto main(int argc, char *argv[]) -> int {
+  Bench bench(parse_options(argc, argv));
+  Interpreter::set_bash_mode(Interpreter::BashMode::FRESH_SHELL);
+  auto session = std::make_unique<Interpreter>();
+
+  const std::vector<std::pair<int, std::string>> trivial{
+      {Interpreter::Languages::BASH, "true"},
+      {Interpreter::Languages::PYTHON, "pass"},
+      {Interpreter::Languages::LUA, "local x = 1"}};
+
+  // First call: includes Python initialization and the first Lua state
+  for (const auto &[language, command] : trivial) {
+    bench.run("first_call/" + Interpreter::name(language), 1,
+              [&]() { return execute(*session, command, language); });
+  }
+
+  // Per-call overhead
+  for (const auto &[language, command] : trivial) {
+    size_t iterations =
+        language == Interpreter::Languages::BASH ? 500 : 20000;
+    bench.run("trivial/" + Interpreter::name(language), iterations,
+              [&]() { return execute(*session, command, language); });
+  }
+
+  // Per-call overhead of the session shell, against a fresh shell above
+  Interpreter::set_bash_mode(Interpreter::BashMode::SHELL_SESSION);
+  bench.run("trivial/Bash_session", 20000,
+            [&]() {
+              return execute(*session, "true", Interpreter::Languages::BASH);
+            });
+
+  // Output throughput: 1 MB and 100 MB
+  for (int language : {Interpreter::Languages::BASH,
+                       Interpreter::Languages::PYTHON,
+                       Interpreter::Languages::LUA}) {
+    auto small = output_command(language, 16 * 1024);
+    auto large = output_command(language, 1600 * 1024);
+    bench.run("output_1mb/" + Interpreter::name(language), 50,
+              [&]() { return execute(*session, small, language); });
+    bench.run("output_100mb/" + Interpreter::name(language), 3,
+              [&]() { return execute(*session, large, language); });
+  }
+
+  // 100 MB streamed from a Bash stage into a stage of each language
+  auto source =
+      "bash: " + output_command(Interpreter::Languages::BASH, 1600 * 1024);
+  const std::vector<std::pair<std::string, std::string>> consumers{
+      {"Bash", "bash: wc -l"}, {"Python", "python: None"}, {"Lua", "lua: nil"}};
+  for (const auto &[name, consumer] : consumers) {
+    auto stages = Pipeline::parse(source + " | " + consumer);
+    bench.run("pipeline_100mb/Bash_" + name, 3, [&]() -> uint64_t {
+      Pipeline::run(*session, stages, [](std::string_view, bool) {});
+      return 1600 * 1024 * 64;
+    });
+  }
+
+  // The same output replayed from the result cache
+  Interpreter::result_cache().set_enabled(true);
+  for (int language : {Interpreter::Languages::BASH,
+                       Interpreter::Languages::PYTHON,
+                       Interpreter::Languages::LUA}) {
+    auto small = output_command(language, 16 * 1024);
+    bench.run("cached_1mb/" + Interpreter::name(language), 50,
+              [&]() { return execute(*session, small, language); });
+  }
+  Interpreter::result_cache().set_enabled(false);
+
+  // A 10000 line script: compiled by the first run, then loaded from the
+  // chunk cache
+  for (int language :
+       {Interpreter::Languages::PYTHON, Interpreter::Languages::LUA}) {
+    auto script = script_command(language, 10000);
+    bench.run("script_10k_lines/" + Interpreter::name(language), 50,
+              [&]() { return execute(*session, script, language); });
+  }
+
+  // State creation
+  bench.run("state/luaL_newstate", 2000, []() -> uint64_t {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    lua_close(L);
+    return 0;
+  });
+
+  LuaStatePool pool([](lua_State *) {});
+  bench.run("state/lua_pool_create", 2000, [&pool]() -> uint64_t {
+    auto state = pool.create();
+    return 0;
+  });
+
+  PythonRuntime::initialize();
+  bench.run("state/python_writers", 2000, []() -> uint64_t {
+    PyGILState_STATE gil = PyGILState_Ensure();
+    auto writers = PythonWriter::create();
+    Py_XDECREF(writers.out);
+    Py_XDECREF(writers.err);
+    PyGILState_Release(gil);
+    return 0;
+  });
+
+  if (PythonRuntime::subinterpreters_supported()) {
+    size_t created = 0;
+    bench.run("state/python_subinterpreter", 8, [&created]() -> uint64_t {
+      PythonRuntime::prefill(++created);
+      return 0;
+    });
+  }
+
+  bench.write_json();
+  session.reset();
+  Interpreter::shutdown();
+  return 0;
+}
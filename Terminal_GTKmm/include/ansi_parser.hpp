@@ -0,0 +1,82 @@
+/*
+ * References:
+ *    https://vt100.net/emu/dec_ansi_parser
+ *    https://en.wikipedia.org/wiki/ANSI_escape_code#SGR
+ *
+ * Streaming ANSI/VT escape sequence parser. Text is split into spans that
+ * carry the SGR attributes (colors, bold, ...) in effect; every other escape
+ * sequence is removed. Sequences cut by a chunk boundary are completed by
+ * the next call to feed().
+ */
+#ifndef ANSI_PARSER_HPP
+#define ANSI_PARSER_HPP
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class AnsiParser {
+
+public:
+    // Colors: DEFAULT_COLOR, PALETTE | index (0-255) or RGB | 0xRRGGBB
+    static constexpr uint32_t DEFAULT_COLOR = 0;
+    static constexpr uint32_t PALETTE = 1u << 24;
+    static constexpr uint32_t RGB = 2u << 24;
+
+    enum Flags : uint8_t {
+        BOLD = 1 << 0,
+        DIM = 1 << 1,
+        ITALIC = 1 << 2,
+        UNDERLINE = 1 << 3,
+        INVERSE = 1 << 4,
+        STRIKETHROUGH = 1 << 5
+    };
+
+    struct Attributes {
+        uint32_t foreground{DEFAULT_COLOR};
+        uint32_t background{DEFAULT_COLOR};
+        uint8_t flags{0};
+
+        auto operator==(const Attributes &) const -> bool = default;
+    };
+
+    // Text without escape sequences; views into the data given to feed()
+    struct Span {
+        std::string_view text;
+        Attributes attributes;
+    };
+
+    // Replaces the contents of spans with the text found in data.
+    void feed(const std::string_view data, std::vector<Span> &spans);
+    void reset();
+
+    // 0xRRGGBB of a PALETTE or RGB color (xterm palette)
+    static auto to_rgb(uint32_t color) -> uint32_t;
+
+    enum State : uint8_t {
+        GROUND,
+        ESCAPE,
+        ESCAPE_INTERMEDIATE,
+        CSI_PARAM,
+        CSI_IGNORE,
+        STRING,         // OSC, DCS, APC, PM, SOS: skipped up to BEL or ST
+        STRING_ESCAPE,  // ESC seen inside a string, expecting '\'
+        STATE_COUNT
+    };
+
+private:
+    State m_state{GROUND};
+    Attributes m_attributes;
+
+    std::array<uint32_t, 32> m_params{};
+    size_t m_param_count{0};
+    bool m_private{false};
+
+    void dispatch_csi(char final);
+    void apply_sgr();
+
+    static constexpr size_t MAX_PARAM = 65535;
+};
+
+#endif // ANSI_PARSER_HPP
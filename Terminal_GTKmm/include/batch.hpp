@@ -0,0 +1,66 @@
+/*
+ * Headless batch mode: runs the scripts listed in a manifest through the
+ * Interpreter backends on a pool of workers, without GTK or a display.
+ *
+ *    TerminalApp --batch jobs.txt [-j N] [-o DIR] [-q] [--timeout SEC]
+ *                [--python-subinterpreters]
+ *
+ * Manifest: one job per line, "<language> <script path>" or just the path
+ * (language by extension). Blank lines and lines starting with # are
+ * skipped; relative paths are relative to the manifest.
+ *
+ * Without -o, output is streamed to stdout/stderr in manifest order while
+ * later jobs already run; with -o, each job writes DIR/<n>_<name>.out and
+ * .err. Bash jobs get a fresh shell and Lua jobs a fresh state each;
+ * Python jobs share the main interpreter (run one at a time) unless
+ * sub-interpreters are requested, which needs Python >= 3.12 and extension
+ * modules that support them.
+ * With --timeout, a job still running after SEC seconds is stopped and
+ * counts as failed.
+ * The exit status is 0 when every job succeeded, 1 otherwise and 2 on
+ * usage or manifest errors.
+ */
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class Batch {
+
+public:
+    struct Job {
+        int language;
+        std::string path;
+    };
+
+    struct Options {
+        std::string manifest;
+        size_t workers{0};       // 0: one per hardware thread
+        std::string output_dir;  // Empty: stream to stdout/stderr
+        bool quiet{false};       // No per-job headers
+        std::chrono::seconds timeout{0}; // 0: no limit
+        bool python_subinterpreters{false};
+    };
+
+    // True when the command line asks for batch mode.
+    static auto requested(int argc, char *argv[]) -> bool;
+    static auto main(int argc, char *argv[]) -> int;
+
+    // Throw std::runtime_error on malformed input.
+    static auto parse_arguments(int argc, char *argv[]) -> Options;
+    static auto parse_manifest(const std::string &path) -> std::vector<Job>;
+
+    // Returns the number of failed jobs.
+    static auto run(const std::vector<Job> &jobs, const Options &options) -> size_t;
+
+    // Bytes a job may queue ahead of the one being printed
+    static constexpr size_t MAX_QUEUED_BYTES = 1024 * 1024;
+
+private:
+    static auto run_streamed(const std::vector<Job> &jobs, const Options &options) -> size_t;
+    static auto run_to_files(const std::vector<Job> &jobs, const Options &options) -> size_t;
+};
+
+#endif // BATCH_HPP
@@ -0,0 +1,87 @@
+/*
+ * References:
+ *    https://www.lua.org/manual/5.4/manual.html#lua_dump
+ *    https://docs.python.org/3/c-api/marshal.html
+ *
+ * Compiled form of large Lua and Python sources, keyed by the SHA-256 of
+ * the runtime, the chunk name and the source text, so running the same
+ * script again skips parsing and compilation. Chunks are Lua bytecode from
+ * lua_dump or marshalled Python code objects; the cache only stores bytes.
+ * Kept in memory, least recently used first out of the byte budget, and
+ * optionally in a directory so that later starts find them too. On disk
+ * every runtime version has a directory of its own, and a file is loaded
+ * only if its header holds the digests of the source it is looked up for
+ * and of its own chunk.
+ */
+#ifndef CHUNK_CACHE_HPP
+#define CHUNK_CACHE_HPP
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class ChunkCache {
+
+public:
+    explicit ChunkCache(size_t max_bytes = DEFAULT_MAX_BYTES);
+
+    ChunkCache(const ChunkCache &) = delete;
+    auto operator=(const ChunkCache &) -> ChunkCache & = delete;
+
+    // Sources shorter than this compile faster than they are looked up
+    static auto worth_caching(const std::string_view source) -> bool {
+        return source.size() >= MIN_SOURCE_BYTES;
+    }
+
+    struct Key {
+        std::string runtime; // Name and version
+        std::string source;  // SHA-256 of the source text, in hex
+        std::string id;      // SHA-256 of runtime, name and source, in hex
+    };
+
+    // Key of a source compiled by runtime (name and version) as name.
+    static auto key(const std::string_view runtime, const std::string_view name,
+                    const std::string_view source) -> Key;
+
+    // Thread safe. Misses in memory are looked up on disk.
+    auto find(const Key &key) -> std::shared_ptr<const std::string>;
+    void store(const Key &key, std::string chunk);
+    void clear();
+
+    // Evicts down to the new budget.
+    void set_max_bytes(size_t max_bytes);
+
+    // Directory of the on-disk store, created when missing; empty keeps
+    // chunks in memory only. Files unused for MAX_DISK_AGE are removed,
+    // then the oldest ones beyond max_disk_bytes, for every runtime.
+    void set_directory(std::string directory, size_t max_disk_bytes = DEFAULT_MAX_DISK_BYTES);
+
+    auto entries() const -> size_t;
+    auto bytes() const -> size_t;
+
+    static constexpr size_t MIN_SOURCE_BYTES = 4 * 1024;
+    static constexpr size_t DEFAULT_MAX_BYTES = 32 * 1024 * 1024;
+    static constexpr size_t DEFAULT_MAX_DISK_BYTES = 256 * 1024 * 1024;
+    static constexpr int MAX_DISK_AGE_DAYS = 30;
+
+private:
+    using Entries = std::list<std::pair<std::string, std::shared_ptr<const std::string>>>;
+
+    mutable std::mutex m_mutex;
+    Entries m_entries; // Most recently used first
+    std::unordered_map<std::string_view, Entries::iterator> m_index;
+    size_t m_bytes{0};
+    size_t m_max_bytes;
+    std::string m_directory;
+
+    void insert(const std::string &key, std::shared_ptr<const std::string> chunk);
+    void evict(size_t max_bytes);
+    auto path(const Key &key) const -> std::string;
+    auto load(const Key &key) const -> std::shared_ptr<const std::string>;
+    void save(const Key &key, const std::string &chunk) const;
+};
+
+#endif // CHUNK_CACHE_HPP
@@ -0,0 +1,41 @@
+/*
+ * Tab completion of the word before the cursor.
+ *
+ *    Bash    first word: executables on $PATH and shell builtins;
+ *            otherwise files, relative to the directory of the session
+ *    Python  session globals and builtins; attributes after a dot
+ *    Lua     globals; fields of a table after a dot or colon
+ *
+ * Executables come from an ExecutableIndex built in the background and
+ * kept current with inotify, so completing never scans $PATH.
+ */
+#ifndef COMPLETION_HPP
+#define COMPLETION_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Interpreter;
+
+class Completion {
+
+public:
+    struct Result {
+        size_t start{0};                // Offset of the completed word in text
+        std::vector<std::string> items; // Replacements for the word, sorted
+    };
+
+    // Starts indexing executables; later calls do nothing.
+    static void prepare();
+
+    // text: the input up to the cursor; names and files are looked up in
+    // the session of interpreter.
+    static auto complete(const std::string_view text, int language, Interpreter &interpreter) -> Result;
+
+    static auto common_prefix(const std::vector<std::string> &items) -> std::string;
+
+    static constexpr size_t MAX_ITEMS = 500;
+};
+
+#endif // COMPLETION_HPP
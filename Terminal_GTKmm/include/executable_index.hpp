@@ -0,0 +1,52 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man7/inotify.7.html
+ *
+ * Sorted names of the executables on $PATH. The directories are scanned
+ * once on a background thread, which then watches them with inotify and
+ * rescans only the ones that changed, so looking up a prefix never touches
+ * the file system.
+ */
+#ifndef EXECUTABLE_INDEX_HPP
+#define EXECUTABLE_INDEX_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class ExecutableIndex {
+
+public:
+    // Starts scanning $PATH.
+    ExecutableIndex();
+    ~ExecutableIndex();
+
+    ExecutableIndex(const ExecutableIndex &) = delete;
+    auto operator=(const ExecutableIndex &) -> ExecutableIndex & = delete;
+
+    // Up to limit names starting with prefix, sorted; none before the
+    // first scan is done. Thread safe.
+    auto complete(const std::string_view prefix, size_t limit) const -> std::vector<std::string>;
+
+    auto ready() const -> bool { return m_names.load() != nullptr; }
+
+    // Changes within this delay are handled by a single rescan
+    static constexpr std::chrono::milliseconds SETTLE_DELAY{100};
+    // How often stop is checked if no eventfd could be made to signal it
+    static constexpr std::chrono::milliseconds STOP_POLL_INTERVAL{200};
+
+private:
+    using Names = std::vector<std::string>;
+
+    std::atomic<std::shared_ptr<const Names>> m_names;
+    std::jthread m_thread;
+
+    void run(std::stop_token stop);
+};
+
+#endif // EXECUTABLE_INDEX_HPP
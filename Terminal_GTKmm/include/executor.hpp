@@ -0,0 +1,48 @@
+/*
+ * References:
+ *    https://en.cppreference.com/w/cpp/thread
+ *
+ * Small pool of worker threads used to run interpreter commands
+ * outside the GTK main loop.
+ */
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+class Executor {
+
+public:
+    using Task = std::function<void()>;
+
+    // 0 selects a size based on the number of hardware threads.
+    explicit Executor(size_t workers = 0);
+    ~Executor();
+
+    Executor(const Executor &) = delete;
+    auto operator=(const Executor &) -> Executor & = delete;
+
+    void submit(Task task);
+
+    [[ nodiscard ]] auto workers() const -> size_t;
+    [[ nodiscard ]] auto pending() const -> size_t;
+
+private:
+    std::vector<std::jthread> m_workers;
+    std::deque<Task> m_tasks;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable_any m_condition;
+
+    void run(std::stop_token stop);
+
+    static constexpr size_t MIN_WORKERS = 2;
+};
+
+#endif // EXECUTOR_HPP
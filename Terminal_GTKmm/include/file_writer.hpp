@@ -0,0 +1,76 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man3/mkstemp.3.html
+ *    https://man7.org/linux/man-pages/man2/fsync.2.html
+ *    https://man7.org/linux/man-pages/man2/rename.2.html
+ *
+ * Writes a file on a background thread. Data goes to a temporary file in
+ * the target directory, which is synced and renamed over the target once
+ * everything is written, so the target is either the old or the complete
+ * new file. The producer never blocks: it checks can_write() and is told
+ * through the notify callback when the writer made progress.
+ */
+#ifndef FILE_WRITER_HPP
+#define FILE_WRITER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+class FileWriter {
+
+public:
+    // Called on the writer thread after each chunk and when finished.
+    using Notify = std::function<void()>;
+
+    // Throws std::runtime_error if the temporary file cannot be created.
+    FileWriter(const std::string &path, const Notify &notify, size_t max_queued_bytes = MAX_QUEUED_BYTES);
+    // Discards the temporary file unless the write finished successfully.
+    ~FileWriter();
+
+    FileWriter(const FileWriter &) = delete;
+    auto operator=(const FileWriter &) -> FileWriter & = delete;
+
+    // False while the queue is full (or after an error).
+    [[ nodiscard ]] auto can_write() const -> bool;
+    void write(std::string chunk);
+
+    // No more data: sync and rename once the queue is written.
+    void close();
+
+    [[ nodiscard ]] auto finished() const -> bool;
+    // Empty on success; valid once finished() is true.
+    [[ nodiscard ]] auto error() const -> std::string;
+
+    static constexpr size_t MAX_QUEUED_BYTES = 4 * 1024 * 1024;
+
+private:
+    std::string m_path;
+    std::string m_temp_path;
+    int m_fd{-1};
+    Notify m_notify;
+    size_t m_max_queued_bytes;
+
+    std::deque<std::string> m_chunks;
+    size_t m_queued_bytes{0};
+    bool m_closed{false};
+    bool m_finished{false};
+    std::string m_error;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable_any m_condition;
+
+    // Declared last: started after, and joined before, the members above
+    std::jthread m_thread;
+
+    void run(std::stop_token stop);
+    auto write_all(const std::string &chunk) -> bool;
+    auto commit() -> bool;
+    void fail(const std::string &what);
+};
+
+#endif // FILE_WRITER_HPP
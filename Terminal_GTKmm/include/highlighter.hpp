@@ -0,0 +1,63 @@
+/*
+ * References:
+ *    https://docs.gtk.org/gtk4/class.TextBuffer.html
+ *
+ * Incremental syntax highlighting of a TextBuffer. The lexer state at the
+ * end of every line is kept, so an edit only re-lexes the lines it touched
+ * and then continues while the carried state changes (an opened string or
+ * comment). A small time budget is spent right after each edit; whatever is
+ * left (a large paste, a language switch) is finished at idle time.
+ */
+#ifndef HIGHLIGHTER_HPP
+#define HIGHLIGHTER_HPP
+
+#include <gtkmm-4.0/gtkmm/textbuffer.h>
+
+#include "tokenizer.hpp"
+
+#include <array>
+#include <chrono>
+#include <vector>
+
+class Highlighter {
+
+public:
+    Highlighter(const Glib::RefPtr<Gtk::TextBuffer> &buffer, int language);
+    ~Highlighter();
+
+    Highlighter(const Highlighter &) = delete;
+    Highlighter &operator=(const Highlighter &) = delete;
+
+    // Re-highlights the whole buffer (in idle slices)
+    void set_language(int language);
+
+private:
+    Glib::RefPtr<Gtk::TextBuffer> m_buffer;
+    Glib::RefPtr<Gtk::TextTag> m_base_tag;
+    std::array<Glib::RefPtr<Gtk::TextTag>, Tokenizer::KIND_COUNT> m_tags;
+
+    std::vector<Tokenizer::State> m_states; // State at the end of each line
+    std::vector<Tokenizer::Token> m_tokens;
+    int m_language;
+
+    // Lines from m_dirty_first up to at least m_dirty_last must be re-lexed
+    int m_dirty_first{-1};
+    int m_dirty_last{-1};
+
+    std::vector<sigc::connection> m_connections;
+    sigc::connection m_idle;
+
+    void on_insert(const Gtk::TextBuffer::iterator &end, const Glib::ustring &text, int bytes);
+    void on_erase(const Gtk::TextBuffer::iterator &start, const Gtk::TextBuffer::iterator &end);
+    void on_changed();
+
+    void mark_dirty(int first, int last);
+    auto relex(std::chrono::microseconds budget) -> bool;
+    auto relex_line(int line) -> bool;
+
+    // Spent right after an edit, then per idle slice
+    static constexpr std::chrono::microseconds EDIT_BUDGET{2000};
+    static constexpr std::chrono::microseconds IDLE_BUDGET{5000};
+};
+
+#endif // HIGHLIGHTER_HPP
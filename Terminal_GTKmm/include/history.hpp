@@ -0,0 +1,68 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man3/memmem.3.html
+ *
+ * Command history of one language, kept across runs in an append-only log
+ * of NUL terminated entries. The log is memory mapped when first searched,
+ * so nothing is read at startup; entries added afterwards stay in memory
+ * next to the mapping as well as being appended to the file.
+ *
+ * Entries are addressed by the offset of their first byte in the log.
+ * Searches scan the log backwards (newest first) in blocks with memmem; a
+ * match never spans two entries because queries cannot contain NUL, so no
+ * index has to be built or kept in sync.
+ */
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include "mapped_file.hpp"
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+
+class History {
+
+public:
+    struct Match {
+        size_t position; // Offset of the entry
+        std::string_view text;
+    };
+
+    explicit History(std::string path);
+    ~History();
+
+    History(const History &) = delete;
+    auto operator=(const History &) -> History & = delete;
+
+    // Appends an entry, unless it repeats the newest one. Failing to write
+    // the log only loses the entry for later runs.
+    void add(const std::string_view command);
+
+    // Position just past the newest entry; the start of a backward search.
+    auto end() -> size_t;
+
+    // Newest entry before the one at position (after it for next) that
+    // contains query, or starts with it when prefix is set. The text stays
+    // valid until the next add.
+    auto previous(size_t position, const std::string_view query, bool prefix) -> std::optional<Match>;
+    auto next(size_t position, const std::string_view query, bool prefix) -> std::optional<Match>;
+
+    // Bytes scanned per step of a backward search
+    static constexpr size_t SEARCH_BLOCK_SIZE = 256 * 1024;
+
+private:
+    std::string m_path;
+    bool m_ready{false};
+    std::optional<MappedFile> m_file; // Entries from earlier runs
+    std::string_view m_loaded;        // Complete entries of m_file
+    std::string m_added;              // Entries of this run
+    int m_fd{-1};                     // Log opened for appending
+
+    void load();
+    auto segments() -> std::array<std::string_view, 2>;
+    auto entry_at(size_t position) -> Match;
+};
+
+#endif // HISTORY_HPP
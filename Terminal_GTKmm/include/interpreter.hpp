@@ -12,16 +12,28 @@
 #ifndef INTERPRETER_HPP
 #define INTERPRETER_HPP
 
+#include <functional>
+#include <memory>
+#include <stop_token>
 #include <string>
 #include <string_view>
 #include <vector>
 
+class ChunkCache;
+class ResultCache;
+
+// One session: its shell, Lua state and Python namespace persist across
+// the commands it runs, apart from those of any other session. Languages,
+// modes and policies are shared by every session.
 class Interpreter {
 
 public:
-    Interpreter() = default;
+    Interpreter();
     ~Interpreter();
 
+    Interpreter(const Interpreter &) = delete;
+    auto operator=(const Interpreter &) -> Interpreter & = delete;
+
     enum Languages {
         DEFAULT,
         BASH,
@@ -29,16 +41,132 @@ public:
         LUA
     };
 
+    // What happens to the session Lua state before each command
+    enum LuaReset {
+        KEEP_STATE,     // Globals persist across commands
+        RESET_GLOBALS,  // Globals restored to their initial values
+        FRESH_STATE     // A new state for every command
+    };
+
+    // How Bash commands run
+    enum BashMode {
+        FRESH_SHELL,  // A new /bin/sh for every command
+        SHELL_SESSION // One long-lived bash; cd, export and functions persist
+    };
+
+    // Where Python commands run
+    enum PythonMode {
+        SHARED_INTERPRETER, // Main interpreter, one GIL for every command
+        SUBINTERPRETERS     // Sub-interpreters with their own GIL (Python >= 3.12)
+    };
+
+    // Receives output as it is produced; is_error marks stderr/diagnostics.
+    using OutputHandler = std::function<void(std::string_view chunk, bool is_error)>;
+
+    // Input of a pipeline stage: fills chunk with the next piece, returns
+    // false at the end of the input or once stop is requested.
+    using InputSource = std::function<bool(std::string &chunk, std::stop_token stop)>;
+
     static auto name(int index) -> std::string;
 
-    [[ nodiscard ]] static auto execute_command(const std::string_view command, size_t number) -> std::string;
+    // Language of a script file by extension (.sh, .py, .lua), else DEFAULT.
+    static auto language_of(const std::string_view path) -> int;
+
+    static void set_bash_mode(BashMode mode);
+    static auto bash_mode() -> BashMode;
+
+    static void set_lua_reset(LuaReset policy);
+    static auto lua_reset() -> LuaReset;
+
+    // Returns false (and keeps the shared interpreter) when the Python
+    // runtime has no per-interpreter GIL.
+    static auto set_python_mode(PythonMode mode) -> bool;
+    static auto python_mode() -> PythonMode;
+
+    // Output of earlier commands, shared by every session; off by default.
+    static auto result_cache() -> ResultCache &;
+
+    // Compiled Lua and Python chunks of large commands and scripts.
+    static auto chunk_cache() -> ChunkCache &;
+
+    // Startup work ahead of the first command (see WarmUp), from any
+    // thread: opens up to count pooled Lua states; initializes Python and
+    // imports modules into the main interpreter, returning how many were
+    // imported.
+    static void prepare_lua(size_t count);
+    static auto prepare_python(const std::vector<std::string> &modules, std::stop_token stop = {}) -> size_t;
+
+    // Finalizes the embedded Python runtime. Call once every Interpreter
+    // is destroyed.
+    static void shutdown();
+
+    // Starts the session shell in Bash session mode, unless a command is
+    // using it. Errors are left for the first command to report. Returns
+    // whether the shell is running: false outside session mode, while a
+    // command holds it or when it failed to start.
+    auto prepare() -> bool;
+
+    // Names defined in the session of a Python or Lua command: globals, or
+    // the attributes (fields) of the object at a dotted path, starting with
+    // prefix and sorted. Empty while a command holds the session.
+    auto session_names(size_t language, const std::string_view path, const std::string_view prefix)
+        -> std::vector<std::string>;
+
+    // Directory Bash commands run in: the session shell's when there is one.
+    auto working_directory() -> std::string;
+
+    // Thread safe: may be called from any worker thread. Commands of one
+    // session may run in parallel; those that find its context busy run
+    // in a fresh shell, an isolated Lua state or a pooled sub-interpreter.
+    [[ nodiscard ]] auto execute_command(const std::string_view command, size_t number) -> std::string;
+    // Return false if the command failed (error, exception, non-zero status)
+    // or was cancelled. A stop request ends the command within milliseconds:
+    // Bash gets its process group signalled, Python a KeyboardInterrupt and
+    // Lua an error from an instruction count hook. Output so far is kept.
+    // While the result cache is on, a cached command replays its output
+    // after a marker line; bypass_cache runs it anyway and caches the new
+    // result.
+    auto execute_command(const std::string_view command, size_t number, const OutputHandler &on_output,
+                         std::stop_token stop = {}, bool bypass_cache = false) -> bool;
+
+    // Runs a script from disk in the session. Lua and Python scripts are
+    // mapped and compiled under the name of the file; those larger than
+    // MAX_CACHED_SCRIPT_BYTES are loaded by the interpreter itself
+    // (dofile, exec(open())) and never cached.
+    auto execute_file(const std::string_view path, size_t number, const OutputHandler &on_output,
+                      std::stop_token stop = {}) -> bool;
+
+    static constexpr size_t MAX_CACHED_SCRIPT_BYTES = 16 * 1024 * 1024;
+
+    // Runs one stage of a pipeline (see Pipeline). Without input it is an
+    // ordinary command, never cached. With input, Bash commands read it on
+    // stdin in a fresh shell; Python and Lua commands run once per input
+    // line with the line in the global `line`: a value other than None/nil
+    // is written as an output line, and a function value is called with
+    // the line instead, then once more with None/nil at the end.
+    auto execute_stage(const std::string_view command, size_t number, const InputSource *input,
+                       const OutputHandler &on_output, std::stop_token stop = {}) -> bool;
 
 private:
     static const std::vector<std::string> s_names;
 
-    [[ nodiscard ]] static auto execute_bash(const std::string_view command) -> std::string;
-    [[ nodiscard ]] static auto execute_python(const std::string_view command) -> std::string;
-    [[ nodiscard ]] static auto execute_lua(const std::string_view command) -> std::string;
+    struct Context;
+    std::unique_ptr<Context> m_context;
+
+    // name is the chunk name of Python and Lua code; empty for commands
+    auto execute_cached(const std::string_view command, const std::string_view name, size_t number,
+                        const OutputHandler &on_output, std::stop_token stop, bool bypass_cache) -> bool;
+    auto run_command(const std::string_view command, const std::string_view name, size_t number,
+                     const OutputHandler &on_output, std::stop_token stop) -> bool;
+    auto execute_bash(const std::string_view command, const OutputHandler &on_output, std::stop_token stop,
+                      const InputSource *input = nullptr) -> bool;
+    auto execute_python(const std::string_view command, const std::string_view name, const OutputHandler &on_output,
+                        std::stop_token stop, const InputSource *input = nullptr) -> bool;
+    auto execute_lua(const std::string_view command, const std::string_view name, const OutputHandler &on_output,
+                     std::stop_token stop, const InputSource *input = nullptr) -> bool;
+
+    // Instructions between two checks of the stop token in Lua code
+    static constexpr int LUA_STOP_CHECK_INTERVAL = 10000;
 };
 
 #endif // INTERPRETER_HPP
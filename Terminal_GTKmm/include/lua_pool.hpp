@@ -0,0 +1,65 @@
+/*
+ * References:
+ *    https://www.lua.org/manual/5.4/manual.html#4
+ *
+ * Pool of pre-opened Lua states, so that running a chunk costs little
+ * more than luaL_loadbuffer + lua_pcall.
+ */
+#ifndef LUA_POOL_HPP
+#define LUA_POOL_HPP
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct lua_State;
+
+class LuaStatePool {
+
+public:
+    // Custom deleter for lua_State*
+    struct StateDeleter {
+        void operator()(lua_State *L) const;
+    };
+
+    // Custom Smart Pointer Type
+    using StatePtr = std::unique_ptr<lua_State, StateDeleter>;
+
+    // Runs on every new state after luaL_openlibs, before the globals
+    // snapshot used by reset_globals is taken.
+    using Setup = std::function<void(lua_State *)>;
+
+    explicit LuaStatePool(Setup setup, size_t capacity = 4);
+
+    LuaStatePool(const LuaStatePool &) = delete;
+    auto operator=(const LuaStatePool &) -> LuaStatePool & = delete;
+
+    // Returns a ready state, creating one if the pool is empty.
+    [[ nodiscard ]] auto acquire() -> StatePtr;
+
+    // Gives a state back. Reused states have their globals reset first;
+    // with reuse == false the state is closed instead.
+    void release(StatePtr state, bool reuse = true);
+
+    // Opens states until the pool holds count of them (up to capacity).
+    void prefill(size_t count);
+
+    [[ nodiscard ]] auto size() const -> size_t;
+
+    // Creates a state with the standard libraries and the setup applied.
+    [[ nodiscard ]] auto create() const -> StatePtr;
+
+    // Restores the global table to the snapshot taken at creation:
+    // new globals are removed, replaced or deleted ones are put back.
+    static void reset_globals(lua_State *L);
+
+private:
+    Setup m_setup;
+    size_t m_capacity;
+
+    mutable std::mutex m_mutex;
+    std::vector<StatePtr> m_states;
+};
+
+#endif // LUA_POOL_HPP
@@ -0,0 +1,37 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man2/mmap.2.html
+ *
+ * Read-only memory mapping of a whole file. Pages are loaded by the kernel
+ * as they are touched, so opening a large file costs nothing up front and
+ * no copy of its content is made.
+ */
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <string_view>
+
+class MappedFile {
+
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped.
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    [[ nodiscard ]] auto data() const -> std::string_view { return {m_data, m_size}; }
+    [[ nodiscard ]] auto size() const -> size_t { return m_size; }
+
+private:
+    const char *m_data{nullptr};
+    size_t m_size{0};
+
+    void unmap();
+};
+
+#endif // MAPPED_FILE_HPP
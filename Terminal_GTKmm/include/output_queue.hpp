@@ -0,0 +1,65 @@
+/*
+ * References:
+ *    https://en.cppreference.com/w/cpp/atomic/atomic/wait
+ *
+ * Lock-free single producer / single consumer queue carrying the output of
+ * one command from its worker to the UI thread. The producer blocks while
+ * the queue holds more than max_bytes, which in turn stalls the pipe or the
+ * interpreter that is writing: output never piles up without bound.
+ */
+#ifndef OUTPUT_QUEUE_HPP
+#define OUTPUT_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class OutputQueue {
+
+public:
+    struct Chunk {
+        std::string text;
+        bool is_error{false};
+        bool finished{false}; // Last chunk of the command
+        std::chrono::steady_clock::time_point time{std::chrono::steady_clock::now()};
+    };
+
+    explicit OutputQueue(size_t max_bytes, size_t capacity = DEFAULT_CAPACITY);
+
+    OutputQueue(const OutputQueue &) = delete;
+    auto operator=(const OutputQueue &) -> OutputQueue & = delete;
+
+    // Producer side. Blocks while full; returns false once closed.
+    auto push(Chunk chunk) -> bool;
+
+    // Consumer side. front() is nullptr when the queue is empty,
+    // wait_front() blocks until a chunk arrives.
+    [[ nodiscard ]] auto front() -> Chunk *;
+    [[ nodiscard ]] auto wait_front() -> Chunk *;
+    void pop();
+
+    // Unblocks the producer for good; later pushes are dropped.
+    void close();
+
+    [[ nodiscard ]] auto queued_bytes() const -> size_t;
+
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+private:
+    std::vector<Chunk> m_slots;
+    size_t m_max_bytes;
+
+    // Monotonic counters; slot index is counter % capacity
+    alignas(64) std::atomic<uint64_t> m_head{0}; // Consumer
+    alignas(64) std::atomic<uint64_t> m_tail{0}; // Producer
+
+    std::atomic<size_t> m_bytes{0};
+    std::atomic<bool> m_closed{false};
+
+    // Bumped on every pop and on close; the producer waits on it
+    std::atomic<uint32_t> m_wakeups{0};
+};
+
+#endif // OUTPUT_QUEUE_HPP
@@ -0,0 +1,120 @@
+/*
+ * References:
+ *    https://docs.gtk.org/glib/struct.Regex.html
+ *    https://man7.org/linux/man-pages/man3/memchr.3.html
+ *
+ * Search over a Scrollback. Plain text is found by jumping with memchr to
+ * the rarest byte of the query and comparing the rest, regular expressions
+ * by GRegex over whole chunks. Scanning starts at the newest output and
+ * goes back in chunks of about a megabyte: a small time budget is spent as
+ * soon as the query changes, so the nearest matches are there for the next
+ * frame, and the rest is scanned at idle time. New output is scanned as it
+ * arrives. Next and previous only look up the sorted match list.
+ */
+#ifndef OUTPUT_SEARCH_HPP
+#define OUTPUT_SEARCH_HPP
+
+#include <glib.h>
+#include <sigc++/connection.h>
+
+#include "scrollback.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+class OutputSearch {
+
+public:
+    struct Match {
+        uint64_t offset; // Global offset in the scrollback
+        uint64_t length;
+    };
+
+    // Called whenever matches were found or dropped
+    using UpdateHandler = std::function<void()>;
+
+    OutputSearch(const Scrollback &scrollback, UpdateHandler on_update);
+    ~OutputSearch();
+
+    OutputSearch(const OutputSearch &) = delete;
+    auto operator=(const OutputSearch &) -> OutputSearch & = delete;
+
+    // Starts over with a new query; an empty one ends the search. Returns
+    // why an invalid regular expression was rejected, else an empty string.
+    auto set_query(const std::string &query, bool regex, bool ignore_case) -> std::string;
+    [[ nodiscard ]] auto active() const -> bool { return m_active; }
+
+    // Call after appending to or clearing the scrollback
+    void update();
+
+    // Matches overlapping [begin, end), oldest first
+    [[ nodiscard ]] auto matches_in(uint64_t begin, uint64_t end) const -> std::vector<Match>;
+
+    // Matches found so far; complete once all retained output was scanned
+    // (or MAX_MATCHES were found)
+    [[ nodiscard ]] auto count() const -> size_t { return m_matches.size(); }
+    [[ nodiscard ]] auto complete() const -> bool;
+
+    // First match starting at or after offset, and last one starting
+    // before it. Output older than what was scanned is scanned first.
+    auto find_next(uint64_t offset) -> std::optional<Match>;
+    auto find_previous(uint64_t offset) -> std::optional<Match>;
+
+    // Among the matches found so far, the last one starting before offset,
+    // else the first one after it; never scans
+    [[ nodiscard ]] auto nearest(uint64_t offset) const -> std::optional<Match>;
+
+    // Match shown as the current one, and its 1-based position
+    void set_current(std::optional<Match> match) { m_current = match; }
+    [[ nodiscard ]] auto current() const -> std::optional<Match> { return m_current; }
+    [[ nodiscard ]] auto current_index() const -> size_t;
+
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+    // Overlap of pieces cut inside a line longer than a chunk, for regular
+    // expressions (literals overlap by the query length)
+    static constexpr size_t REGEX_OVERLAP = 4096;
+    static constexpr size_t MAX_MATCHES = 4'000'000;
+
+private:
+    const Scrollback &m_scrollback;
+    UpdateHandler m_on_update;
+
+    bool m_active{false};
+    std::string m_needle;         // Literal query, lowercase when ignoring case
+    size_t m_rare{0};             // Index of its least common byte
+    bool m_ignore_case{false};
+    GRegex *m_regex{nullptr};
+
+    // Sorted by offset; [m_scanned_begin, m_scanned_end) was searched.
+    // m_scanned_end is a line start, the unfinished last line is searched
+    // again when more output arrives.
+    std::deque<Match> m_matches;
+    uint64_t m_scanned_begin{0};
+    uint64_t m_scanned_end{0};
+    bool m_truncated{false};
+    std::optional<Match> m_current;
+
+    std::string m_chunk;
+    std::vector<Match> m_found;
+    sigc::connection m_idle;
+
+    void reset();
+    void find_all(const std::string_view text, uint64_t base);
+    void find_literal(const std::string_view text, uint64_t base);
+    void find_regex(const std::string_view text, uint64_t base);
+    void scan_new();
+    auto scan_older() -> bool;
+    auto scan(std::chrono::microseconds budget) -> bool;
+    void schedule();
+
+    // Spent right after a query change, then per idle slice
+    static constexpr std::chrono::microseconds QUERY_BUDGET{4000};
+    static constexpr std::chrono::microseconds IDLE_BUDGET{8000};
+};
+
+#endif // OUTPUT_SEARCH_HPP
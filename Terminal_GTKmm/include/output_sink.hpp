@@ -0,0 +1,38 @@
+/*
+ * Chunk buffer shared by the embedded interpreters: writes are appended in
+ * place and handed to the output handler in chunks, by size or by age, so
+ * that long running scripts stream their output while they run.
+ */
+#ifndef OUTPUT_SINK_HPP
+#define OUTPUT_SINK_HPP
+
+#include "interpreter.hpp"
+
+#include <chrono>
+#include <string>
+#include <string_view>
+
+class OutputSink {
+
+public:
+    explicit OutputSink(const Interpreter::OutputHandler &on_output);
+    ~OutputSink();
+
+    OutputSink(const OutputSink &) = delete;
+    auto operator=(const OutputSink &) -> OutputSink & = delete;
+
+    void write(const std::string_view text, bool is_error = false);
+    void flush();
+
+    static constexpr size_t FLUSH_SIZE = 64 * 1024;
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{50};
+
+private:
+    const Interpreter::OutputHandler &m_on_output;
+
+    std::string m_buffer;
+    bool m_is_error{false};
+    std::chrono::steady_clock::time_point m_last_flush;
+};
+
+#endif // OUTPUT_SINK_HPP
@@ -0,0 +1,120 @@
+/*
+ * References:
+ *    https://gnome.pages.gitlab.gnome.org/gtkmm-documentation/sec-drawing-area.html
+ *    https://docs.gtk.org/Pango/
+ *
+ * Virtualized view of a Scrollback: only the lines inside the viewport are
+ * laid out and drawn, so the cost of a frame does not depend on how much
+ * output is retained. Lines are not wrapped: the view scrolls sideways,
+ * and only the bytes of a line that fit in the viewport are read and laid
+ * out, however long the line is. Selection is by whole lines.
+ */
+#ifndef OUTPUT_VIEW_HPP
+#define OUTPUT_VIEW_HPP
+
+#include <gtkmm-4.0/gtkmm/adjustment.h>
+#include <gtkmm-4.0/gtkmm/box.h>
+#include <gtkmm-4.0/gtkmm/drawingarea.h>
+#include <gtkmm-4.0/gtkmm/scrollbar.h>
+#include <gdkmm/rgba.h>
+#include <pangomm/attrlist.h>
+#include <pangomm/layout.h>
+
+#include "ansi_parser.hpp"
+#include "output_search.hpp"
+#include "scrollback.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+class OutputView : public Gtk::Box {
+
+public:
+    struct Style {
+        Gdk::RGBA foreground;
+        std::optional<Gdk::RGBA> background;
+        uint8_t flags{0}; // AnsiParser::Flags
+    };
+
+    explicit OutputView(Scrollback &scrollback);
+    virtual ~OutputView() = default;
+
+    // Palette entry for a Scrollback::Style id
+    void set_style(Scrollback::Style id, const Style &style);
+
+    // Style id for text with the given SGR attributes over a base style
+    // (output or error). Equal attributes always map to the same id.
+    [[ nodiscard ]] auto intern(const AnsiParser::Attributes &attributes, Scrollback::Style base) -> Scrollback::Style;
+
+    // Call after appending to or clearing the scrollback.
+    void refresh();
+
+    // Text of the selected lines, or an empty string.
+    [[ nodiscard ]] auto selected_text() const -> std::string;
+
+    // Matches of search are highlighted, the current one differently
+    void set_search(const OutputSearch *search);
+
+    // Scrolls so that a line is in the middle of the view (stops following)
+    void show_line(uint64_t number);
+
+    // Line at the bottom of the view
+    [[ nodiscard ]] auto last_visible_line() const -> uint64_t;
+
+private:
+    Scrollback &m_scrollback;
+
+    Gtk::Box m_row{Gtk::Orientation::HORIZONTAL};
+    Gtk::DrawingArea m_area;
+    Glib::RefPtr<Gtk::Adjustment> m_adjustment;
+    Gtk::Scrollbar m_scrollbar;
+
+    // Horizontal position in bytes from the start of the lines; one column
+    // per byte, exact for ASCII output
+    Glib::RefPtr<Gtk::Adjustment> m_hadjustment;
+    Gtk::Scrollbar m_hscrollbar;
+
+    Glib::RefPtr<Pango::Layout> m_layout;
+    std::vector<Style> m_styles;
+    std::unordered_map<uint64_t, Scrollback::Style> m_style_ids;
+    const OutputSearch *m_search{nullptr};
+
+    int m_line_height{1};
+    int m_char_width{1};
+    bool m_follow{true};    // Keep the last line visible while appending
+
+    // Selected lines (global numbers), inclusive; none when m_has_selection is false
+    bool m_has_selection{false};
+    uint64_t m_selection_anchor{0};
+    uint64_t m_selection_end{0};
+
+    void on_draw(const Cairo::RefPtr<Cairo::Context> &cr, int width, int height);
+    void on_resize(int width, int height);
+    auto on_scroll(double dx, double dy) -> bool;
+    auto on_key_pressed(guint keyval, guint keycode, Gdk::ModifierType state) -> bool;
+    void on_drag_begin(double x, double y);
+    void on_drag_update(double offset_x, double offset_y);
+
+    void add_attributes(Pango::AttrList &attributes, const Style &style, size_t start, size_t end) const;
+    void add_matches(Pango::AttrList &attributes, uint64_t begin, uint64_t end) const;
+    void update_metrics();
+    void update_adjustment();
+    void update_hadjustment();
+    auto line_at(double y) const -> uint64_t;
+    auto visible_lines() const -> int;
+    auto visible_columns() const -> int;
+
+    double m_drag_start_y{0};
+
+    static constexpr int MARGIN = 15;
+    static constexpr size_t MAX_STYLES = 4096;
+
+    // Longest UTF-8 encoding of a character: bytes read per visible column
+    static constexpr size_t MAX_CHAR_BYTES = 4;
+    // Columns moved by a step of the wheel or an arrow key
+    static constexpr int HORIZONTAL_STEP = 8;
+};
+
+#endif // OUTPUT_VIEW_HPP
@@ -0,0 +1,78 @@
+/*
+ * References:
+ *    https://en.cppreference.com/w/cpp/thread/condition_variable_any/wait
+ *
+ * Cross-language pipelines: the output of one stage is the input of the
+ * next, whatever their languages.
+ *
+ *    bash: cat big.csv | python: process(line) | lua: summarize
+ *
+ * A "|" followed by "bash:", "python:" or "lua:" starts a new stage; other
+ * "|" belong to the stage (a Bash pipe), as do those inside quotes, escaped
+ * with a backslash or inside Lua long strings ([[...]]). Every stage
+ * runs on a thread of its own and streams its output to the next one in
+ * chunks, through a bounded link, so a pipeline runs at the speed of its
+ * slowest stage in constant memory. Errors of every stage reach the final
+ * output. A stage that ends before reading all its input stops the stages
+ * before it, as SIGPIPE would. How a stage uses its input is described at
+ * Interpreter::execute_stage.
+ */
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "interpreter.hpp"
+
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Pipeline {
+
+public:
+    struct Stage {
+        int language;
+        std::string command;
+    };
+
+    // Stages of text, or none when it is not a pipeline of two or more
+    // stages with a language prefix each.
+    [[ nodiscard ]] static auto parse(const std::string_view text) -> std::vector<Stage>;
+
+    // Runs the stages in the sessions of interpreter, the last one on this
+    // thread. The output of the last stage and the errors of all go to
+    // on_output, which is never called from two threads at once.
+    // Returns false if a stage failed or was cancelled.
+    static auto run(Interpreter &interpreter, const std::vector<Stage> &stages,
+                    const Interpreter::OutputHandler &on_output, std::stop_token stop = {}) -> bool;
+
+    // Calls f(std::string_view line) for every line of input (without its
+    // line break; a last unterminated line too) while f returns true.
+    // Returns false if f did.
+    template <typename F>
+    static auto for_each_line(const Interpreter::InputSource &input, std::stop_token stop, F &&f) -> bool {
+        std::string chunk;
+        std::string carry; // Line split across chunks
+        while (input(chunk, stop)) {
+            size_t start = 0;
+            for (size_t end; (end = chunk.find('\n', start)) != std::string::npos; start = end + 1) {
+                std::string_view line(chunk.data() + start, end - start);
+                if (!carry.empty()) {
+                    carry += line;
+                    line = carry;
+                }
+                if (!f(line)) {
+                    return false;
+                }
+                carry.clear();
+            }
+            carry.append(chunk, start);
+        }
+        return carry.empty() || f(std::string_view(carry));
+    }
+
+    // Bytes a stage may have queued ahead of the next one
+    static constexpr size_t LINK_MAX_BYTES = 1024 * 1024;
+};
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,92 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man3/posix_spawn.3.html
+ *    https://man7.org/linux/man-pages/man2/poll.2.html
+ *
+ * Runs a shell command as a child process and streams its stdout and
+ * stderr while it runs.
+ *
+ * ShellSession keeps one bash alive instead and writes each command to its
+ * stdin. The end of a command and its status are found by sentinel lines
+ * the shell prints after it, unique to the session and the command, so a
+ * command costs a pipe round trip and cd, export and functions persist.
+ */
+#ifndef PROCESS_HPP
+#define PROCESS_HPP
+
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <stop_token>
+#include <string>
+#include <string_view>
+
+#include <sys/types.h>
+
+class Process {
+
+public:
+    // Receives each chunk as soon as it is read; is_error marks stderr.
+    using ChunkHandler = std::function<void(std::string_view chunk, bool is_error)>;
+
+    // Supplies stdin: the next chunk, or false at the end of the input or
+    // once stop is requested.
+    using InputSource = std::function<bool(std::string &chunk, std::stop_token stop)>;
+
+    // Runs "/bin/sh -c command" and returns its exit status.
+    // Throws std::runtime_error if the process cannot be started.
+    // When stop is requested the process group of the child gets SIGTERM,
+    // then SIGKILL after KILL_GRACE; output read until then is delivered.
+    // stdin is /dev/null, or fed from input by a writer thread; it is
+    // closed when the input ends.
+    static auto run(const std::string_view command, const ChunkHandler &on_chunk,
+                    std::stop_token stop = {}, const InputSource *input = nullptr) -> int;
+
+    // Single-quoted shell literal reproducing text byte for byte
+    static auto quote(const std::string_view text) -> std::string;
+
+    static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+    static constexpr std::chrono::milliseconds KILL_GRACE{200};
+};
+
+class ShellSession {
+
+public:
+    ShellSession() = default;
+    ~ShellSession();
+
+    ShellSession(const ShellSession &) = delete;
+    auto operator=(const ShellSession &) -> ShellSession & = delete;
+
+    // Runs command in the session shell, started on first use, and returns
+    // its exit status. Commands read /dev/null, not the session's stdin.
+    // A stop request or an exiting shell (exit, exec) ends the session;
+    // the next command starts a new one. Not thread safe.
+    // Throws std::runtime_error if the shell cannot be started.
+    auto run(const std::string_view command, const Process::ChunkHandler &on_chunk,
+             std::stop_token stop = {}) -> int;
+
+    auto running() const -> bool { return m_pid > 0; }
+
+    // Starts the shell ahead of the first command. Throws like run.
+    void prepare();
+
+    // Current directory of the shell (cd persists), empty if not running.
+    auto working_directory() const -> std::string;
+
+    // Kills the shell and everything it started.
+    void close();
+
+private:
+    void start();
+    auto end() -> int; // Kills the group, returns the shell's status
+
+    pid_t m_pid{-1};
+    int m_stdin{-1};
+    int m_stdout{-1};
+    int m_stderr{-1};
+    std::string m_marker;
+    uint64_t m_commands{0};
+};
+
+#endif // PROCESS_HPP
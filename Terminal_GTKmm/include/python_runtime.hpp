@@ -0,0 +1,76 @@
+/*
+ * References:
+ *    https://docs.python.org/3/c-api/init.html
+ *    https://docs.python.org/3/c-api/init.html#a-per-interpreter-gil
+ *
+ * Embedded Python runtime. Commands run either in the main interpreter
+ * (one GIL shared by every job) or, on Python >= 3.12, in sub-interpreters
+ * that each own their GIL and can therefore use separate cores. Every
+ * terminal session has a PythonSession holding its own namespace.
+ */
+#ifndef PYTHON_RUNTIME_HPP
+#define PYTHON_RUNTIME_HPP
+
+#include "interpreter.hpp"
+
+#include <memory>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class PythonRuntime {
+
+public:
+    // Initializes the main interpreter once; later calls do nothing.
+    static void initialize();
+
+    // Ends the pooled sub-interpreters and finalizes Python.
+    static void shutdown();
+
+    // True when the runtime supports interpreters with their own GIL.
+    static auto subinterpreters_supported() -> bool;
+
+    // Creates sub-interpreters until the pool holds count of them.
+    static void prefill(size_t count);
+
+    // Imports modules into the main interpreter, so that sessions import
+    // them from sys.modules. Returns how many were found; stops early on
+    // a stop request. Call after initialize.
+    static auto import_modules(const std::vector<std::string> &modules, std::stop_token stop = {}) -> size_t;
+};
+
+// Namespace of one terminal session: a globals dictionary of its own in
+// the main interpreter and, once a command runs in sub-interpreter mode, a
+// sub-interpreter of its own. Destroy before PythonRuntime::shutdown.
+class PythonSession {
+
+public:
+    PythonSession();
+    ~PythonSession();
+
+    PythonSession(const PythonSession &) = delete;
+    auto operator=(const PythonSession &) -> PythonSession & = delete;
+
+    // Globals and builtins of the session namespace, or the attributes of
+    // the object at a dotted path, starting with prefix. Empty when Python
+    // is not running yet or the session is busy. Only evaluates attributes.
+    auto names(const std::string_view path, const std::string_view prefix, bool isolated)
+        -> std::vector<std::string>;
+
+    // Runs a command; isolated selects a sub-interpreter when supported.
+    // Returns false if it raised (SystemExit with a zero code is success).
+    // A stop request raises KeyboardInterrupt in the running code. name is
+    // the file name of tracebacks; large commands are compiled once and
+    // then loaded from the chunk cache. With input, the command is a
+    // pipeline stage run once per line (see Interpreter::execute_stage).
+    auto run(const std::string_view command, const Interpreter::OutputHandler &on_output,
+             bool isolated, std::stop_token stop = {}, const std::string_view name = "<string>",
+             const Interpreter::InputSource *input = nullptr) -> bool;
+
+private:
+    struct State;
+    std::unique_ptr<State> m_state;
+};
+
+#endif // PYTHON_RUNTIME_HPP
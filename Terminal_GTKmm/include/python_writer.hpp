@@ -0,0 +1,35 @@
+/*
+ * References:
+ *    https://docs.python.org/3/c-api/type.html#c.PyType_FromSpec
+ *
+ * Native replacement for sys.stdout/sys.stderr: write() appends the UTF-8
+ * text of its argument straight into the OutputSink of the running command.
+ */
+#ifndef PYTHON_WRITER_HPP
+#define PYTHON_WRITER_HPP
+
+#include <Python.h>
+
+class OutputSink;
+
+class PythonWriter {
+
+public:
+    // New references to a stdout and a stderr writer
+    struct Writers {
+        PyObject *out{nullptr};
+        PyObject *err{nullptr};
+    };
+
+    // Creates the writer type and both writers in the current interpreter.
+    // The GIL must be held. Returns null pointers on failure.
+    static auto create() -> Writers;
+
+    // Points both writers to the sink of the running command (or nullptr).
+    static void set_sink(const Writers &writers, OutputSink *sink);
+
+    // Makes the writers the current sys.stdout and sys.stderr.
+    static void install(const Writers &writers);
+};
+
+#endif // PYTHON_WRITER_HPP
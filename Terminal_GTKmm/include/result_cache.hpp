@@ -0,0 +1,95 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man2/stat.2.html
+ *
+ * Opt-in memoization of command output. A successful command is recorded
+ * under a key made of its language, the SHA-256 of its text, the directory
+ * it ran in and the size and modification time of every existing file its
+ * text names; a later command with the same key replays the recorded
+ * output instead of running. Entries are evicted least recently used first
+ * once their total size exceeds the byte budget. Only meant for commands
+ * without side effects: nothing tells a cached query from one that changes
+ * the world.
+ */
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class ResultCache {
+
+public:
+    struct Chunk {
+        std::string text;
+        bool is_error{false};
+    };
+
+    struct Result {
+        std::vector<Chunk> chunks;
+        size_t bytes{0};
+        std::chrono::system_clock::time_point time{std::chrono::system_clock::now()};
+    };
+
+    explicit ResultCache(size_t max_bytes = DEFAULT_MAX_BYTES);
+
+    ResultCache(const ResultCache &) = delete;
+    auto operator=(const ResultCache &) -> ResultCache & = delete;
+
+    // Off by default; lookups and stores do nothing while disabled.
+    void set_enabled(bool enabled);
+    auto enabled() const -> bool { return m_enabled; }
+
+    // Whether the key includes the directory commands run in.
+    void set_key_directory(bool include) { m_key_directory = include; }
+    auto key_directory() const -> bool { return m_key_directory; }
+
+    // Evicts down to the new budget.
+    void set_max_bytes(size_t max_bytes);
+    // Largest result kept, output and key included
+    auto max_result_bytes() const -> size_t;
+
+    // Key of a command: stats the files it names, relative to directory.
+    static auto key(int language, const std::string_view command, const std::string_view directory) -> std::string;
+
+    // Thread safe. A hit becomes the most recently used entry.
+    auto find(const std::string &key) -> std::shared_ptr<const Result>;
+    void store(std::string key, Result result);
+    void clear();
+
+    auto entries() const -> size_t;
+    auto bytes() const -> size_t;
+
+    // Recorded output is merged into chunks of about this size
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    // Results larger than this share of the budget are not kept
+    static constexpr size_t MAX_RESULT_SHARE = 4;
+    static constexpr size_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+    // Words of a command checked for file names
+    static constexpr size_t MAX_NAMED_FILES = 64;
+
+private:
+    using Entries = std::list<std::pair<std::string, std::shared_ptr<const Result>>>;
+
+    mutable std::mutex m_mutex;
+    Entries m_entries; // Most recently used first
+    std::unordered_map<std::string_view, Entries::iterator> m_index;
+    size_t m_bytes{0};
+    size_t m_max_bytes;
+
+    std::atomic<bool> m_enabled{false};
+    std::atomic<bool> m_key_directory{true};
+
+    void evict(size_t max_bytes);
+};
+
+#endif // RESULT_CACHE_HPP
@@ -0,0 +1,54 @@
+/*
+ * References:
+ *    https://gnome.pages.gitlab.gnome.org/gtkmm-documentation/sec-using-glib-dispatcher.html
+ *
+ * Saves data produced on the UI thread through a FileWriter. The source is
+ * asked for the next chunk only while the writer queue has room, and the
+ * writer thread wakes the UI through a Glib::Dispatcher as it drains, so
+ * memory stays bounded and the main loop never waits for the disk.
+ */
+#ifndef SAVE_TASK_HPP
+#define SAVE_TASK_HPP
+
+#include <glibmm/dispatcher.h>
+
+#include "file_writer.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+class SaveTask {
+
+public:
+    // Fills chunk with the next piece of data; returns false at the end.
+    // May throw std::runtime_error if the data changed under it.
+    using Source = std::function<bool(std::string &chunk)>;
+    // Receives an empty string on success, the reason otherwise.
+    using DoneHandler = std::function<void(const std::string &error)>;
+
+    SaveTask(const std::string &path, const Source &source, const DoneHandler &on_done);
+
+    SaveTask(const SaveTask &) = delete;
+    auto operator=(const SaveTask &) -> SaveTask & = delete;
+
+    void start();
+    [[ nodiscard ]] auto running() const -> bool { return m_running; }
+
+private:
+    std::string m_path;
+    Source m_source;
+    DoneHandler m_on_done;
+    bool m_running{false};
+    bool m_source_done{false};
+
+    // The writer (and its thread) goes first, so it never emits into a
+    // destroyed dispatcher
+    Glib::Dispatcher m_dispatcher;
+    std::unique_ptr<FileWriter> m_writer;
+
+    void pump();
+    void finish(const std::string &error);
+};
+
+#endif // SAVE_TASK_HPP
@@ -0,0 +1,50 @@
+/*
+ * References:
+ *    https://docs.gtk.org/glib/func.utf8_validate.html
+ *
+ * Inserts a mapped file into a TextBuffer a chunk at a time from an idle
+ * handler, so the window keeps painting and reacting while a large script
+ * is loaded. Each chunk ends on a line (or at least a character) boundary
+ * and is validated as UTF-8 before it is inserted.
+ */
+#ifndef SCRIPT_LOADER_HPP
+#define SCRIPT_LOADER_HPP
+
+#include <gtkmm-4.0/gtkmm/textbuffer.h>
+
+#include "mapped_file.hpp"
+
+#include <functional>
+#include <string>
+
+class ScriptLoader {
+
+public:
+    using ProgressHandler = std::function<void(double fraction)>;
+    // Receives an empty string on success, the reason otherwise
+    using DoneHandler = std::function<void(const std::string &error)>;
+
+    ScriptLoader(MappedFile file, const Glib::RefPtr<Gtk::TextBuffer> &buffer,
+                 const ProgressHandler &on_progress, const DoneHandler &on_done);
+    ~ScriptLoader();
+
+    ScriptLoader(const ScriptLoader &) = delete;
+    ScriptLoader &operator=(const ScriptLoader &) = delete;
+
+    // Clears the buffer and starts inserting; stops when destroyed
+    void start();
+
+    static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+private:
+    MappedFile m_file;
+    Glib::RefPtr<Gtk::TextBuffer> m_buffer;
+    ProgressHandler m_on_progress;
+    DoneHandler m_on_done;
+    size_t m_offset{0};
+    sigc::connection m_idle;
+
+    auto on_idle() -> bool;
+};
+
+#endif // SCRIPT_LOADER_HPP
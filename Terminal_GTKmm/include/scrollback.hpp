@@ -0,0 +1,204 @@
+/*
+ * Line indexed output history. Text is stored in fixed size blocks and each
+ * line is a small record (byte offset, length, first style run), all kept in
+ * ring buffers, so appending costs O(bytes appended) and memory is bounded
+ * by the byte and line limits. Past them the oldest output is dropped or,
+ * once spilling is set up, moved to unnamed files on disk (text, line and
+ * style records each to their own), which are read back through mapped
+ * windows when those lines are drawn. Memory use stays the same however
+ * much is kept on disk.
+ *
+ * Offsets are global (they keep growing as output is appended), so a line
+ * number or a byte offset stays valid until the data it refers to is dropped.
+ */
+#ifndef SCROLLBACK_HPP
+#define SCROLLBACK_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "spill_file.hpp"
+
+class Scrollback {
+
+public:
+    // Styles are ids into the palette of the view (0 output, 1 error)
+    using Style = uint16_t;
+
+    static constexpr Style STYLE_OUTPUT = 0;
+    static constexpr Style STYLE_ERROR = 1;
+
+    struct Line {
+        uint64_t offset{0};  // Global offset of the first byte
+        uint64_t length{0};  // Bytes, without the line break
+        uint64_t run{0};     // Global index of the run active at offset
+    };
+
+    struct Run {
+        uint64_t offset{0};  // Global offset where the style starts
+        Style style{STYLE_OUTPUT};
+    };
+
+    // Style of a span inside a line, start relative to the line
+    struct Span {
+        size_t start;
+        Style style;
+    };
+
+    explicit Scrollback(size_t max_bytes = DEFAULT_MAX_BYTES, size_t max_lines = DEFAULT_MAX_LINES);
+
+    // Output past the memory limits goes to files in directory (see
+    // SpillFile) instead of being dropped: up to max_bytes of text, and a
+    // quarter of that each for line and style records. Zero turns it off.
+    void set_spill(size_t max_bytes, const std::string &directory = {});
+
+    void append(const std::string_view text, Style style = STYLE_OUTPUT);
+    void clear();
+
+    // Line numbers are global; lines before first_line() were dropped.
+    [[ nodiscard ]] auto first_line() const -> uint64_t;
+    [[ nodiscard ]] auto end_line() const -> uint64_t;
+    [[ nodiscard ]] auto line_count() const -> size_t;
+
+    [[ nodiscard ]] auto line(uint64_t number) const -> Line;
+    // Number of the line holding a global offset (binary search)
+    [[ nodiscard ]] auto line_at(uint64_t offset) const -> uint64_t;
+    [[ nodiscard ]] auto line_text(uint64_t number) const -> std::string;
+    [[ nodiscard ]] auto line_spans(uint64_t number) const -> std::vector<Span>;
+
+    // Bytes currently retained, and the global offsets they span
+    [[ nodiscard ]] auto size() const -> uint64_t;
+    // Of which on disk
+    [[ nodiscard ]] auto spilled_size() const -> uint64_t;
+    [[ nodiscard ]] auto begin_offset() const -> uint64_t;
+    [[ nodiscard ]] auto end_offset() const -> uint64_t;
+
+    // Copies retained bytes in [offset, offset + length) into out
+    void read(uint64_t offset, size_t length, std::string &out) const;
+
+    // Calls f(std::string_view) for each stored block, oldest first;
+    // spilled text comes one mapped window at a time
+    template <typename F>
+    void for_each_block(F &&f) const {
+        for (uint64_t offset = m_begin_offset; offset < m_blocks_offset;) {
+            auto block = m_spilled_text.view(offset - m_text_base, m_blocks_offset - offset);
+            if (block.empty()) {
+                break;
+            }
+            f(block);
+            offset += block.size();
+        }
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            std::string_view block(m_blocks[i]);
+            if (i == 0 && m_begin_offset > m_blocks_offset) {
+                block.remove_prefix(m_begin_offset - m_blocks_offset);
+            }
+            f(block);
+        }
+    }
+
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+    static constexpr size_t DEFAULT_MAX_BYTES = 128 * BLOCK_SIZE;
+    static constexpr size_t DEFAULT_MAX_LINES = 2'000'000;
+    static constexpr size_t DEFAULT_MAX_SPILL_BYTES = size_t{4} << 30;
+
+private:
+    // Fixed capacity circular buffer; grows on demand up to its capacity.
+    template <typename T>
+    class Ring {
+    public:
+        explicit Ring(size_t capacity) : m_capacity(capacity) {}
+
+        auto size() const -> size_t { return m_size; }
+        auto full() const -> bool { return m_size == m_capacity; }
+
+        auto operator[](size_t i) -> T & { return m_items[(m_head + i) % m_items.size()]; }
+        auto operator[](size_t i) const -> const T & { return m_items[(m_head + i) % m_items.size()]; }
+        auto back() -> T & { return (*this)[m_size - 1]; }
+
+        // When full, the oldest item is overwritten.
+        void push_back(const T &item) {
+            if (m_size == m_items.size()) {
+                if (m_items.size() < m_capacity) {
+                    grow();
+                } else {
+                    pop_front();
+                }
+            }
+            (*this)[m_size++] = item;
+        }
+
+        void pop_front() {
+            m_head = (m_head + 1) % m_items.size();
+            --m_size;
+        }
+
+        void clear() {
+            m_items.clear();
+            m_items.shrink_to_fit();
+            m_head = 0;
+            m_size = 0;
+        }
+
+    private:
+        void grow() {
+            // Unroll the ring into a larger vector so that order is kept
+            std::vector<T> items(std::min(m_capacity, std::max<size_t>(64, m_items.size() * 2)));
+            for (size_t i = 0; i < m_size; ++i) {
+                items[i] = (*this)[i];
+            }
+            m_items.swap(items);
+            m_head = 0;
+        }
+
+        std::vector<T> m_items;
+        size_t m_capacity;
+        size_t m_head{0};
+        size_t m_size{0};
+    };
+
+    size_t m_max_bytes;
+    size_t m_max_lines;
+
+    std::deque<std::string> m_blocks;
+    uint64_t m_blocks_offset{0}; // Global offset of m_blocks.front()
+    uint64_t m_begin_offset{0};  // First retained byte, on disk or not
+    uint64_t m_end_offset{0};
+
+    // Records before the first one in memory are on disk
+    Ring<Line> m_lines;
+    uint64_t m_first_line{0};
+    uint64_t m_memory_first_line{0};
+    bool m_line_open{false};
+
+    Ring<Run> m_runs;
+    uint64_t m_first_run{0};
+    uint64_t m_memory_first_run{0};
+
+    // Spilled text is [m_begin_offset, m_blocks_offset), spilled records
+    // [m_first_line, m_memory_first_line) and [m_first_run,
+    // m_memory_first_run); the bases are what offset 0 of each file holds.
+    size_t m_max_spill_bytes{0};
+    SpillFile m_spilled_text;
+    SpillFile m_spilled_lines;
+    SpillFile m_spilled_runs;
+    uint64_t m_text_base{0};
+    uint64_t m_lines_base{0};
+    uint64_t m_runs_base{0};
+
+    [[ nodiscard ]] auto line_record(uint64_t number) const -> Line;
+    [[ nodiscard ]] auto run_record(uint64_t index) const -> Run;
+    [[ nodiscard ]] auto end_run() const -> uint64_t;
+
+    void spill_block(const std::string &block);
+    void spill_line(const Line &line);
+    void spill_run(const Run &run);
+    void drop_first_line();
+    void trim();
+};
+
+#endif // SCROLLBACK_HPP
@@ -0,0 +1,215 @@
+/*
+ * References:
+ *    https://www.gtkmm.org
+ *
+ * One tab of the terminal: an input editor and an output view bound to an
+ * Interpreter of its own, so the shell, Lua state and Python namespace of
+ * a session never see those of another. Commands of every session run at
+ * the same time on the shared executor.
+ */
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include <gtkmm-4.0/gtkmm/box.h>
+#include <gtkmm-4.0/gtkmm/button.h>
+#include <gtkmm-4.0/gtkmm/checkbutton.h>
+#include <gtkmm-4.0/gtkmm/label.h>
+#include <gtkmm-4.0/gtkmm/listbox.h>
+#include <gtkmm-4.0/gtkmm/popover.h>
+#include <gtkmm-4.0/gtkmm/progressbar.h>
+#include <gtkmm-4.0/gtkmm/scrolledwindow.h>
+#include <gtkmm-4.0/gtkmm/searchentry.h>
+#include <gtkmm-4.0/gtkmm/textbuffer.h>
+#include <gtkmm-4.0/gtkmm/textview.h>
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include "ansi_parser.hpp"
+#include "executor.hpp"
+#include "highlighter.hpp"
+#include "history.hpp"
+#include "interpreter.hpp"
+#include "output_queue.hpp"
+#include "output_search.hpp"
+#include "output_view.hpp"
+#include "save_task.hpp"
+#include "script_loader.hpp"
+#include "scrollback.hpp"
+#include "settings.hpp"
+
+class Session : public Gtk::Box {
+
+public:
+    // History of a language, shared by every session
+    using HistoryProvider = std::function<History &(int language)>;
+    // Messages for the status bar of the window
+    using StatusHandler = std::function<void(const std::string &text)>;
+
+    Session(Executor &executor, const Settings &settings, HistoryProvider history, StatusHandler on_status);
+    virtual ~Session();
+
+    // Command handling; bypass_cache runs the input even when its result
+    // is cached
+    void execute_input(bool bypass_cache = false);
+    void execute_file(const std::string &path, int language);
+    void stop_commands();
+
+    void set_language(int language);
+    auto language() const -> int { return m_interpreter_type; }
+    auto interpreter() const -> std::shared_ptr<Interpreter> { return m_interpreter; }
+
+    // Import
+    void load_script(const std::string &path, int language);
+
+    // Export of input and output into directory, streamed to disk.
+    // can_save is false (and says why) while input or output is empty.
+    auto can_save() -> bool;
+    void save(const std::string &directory);
+    auto saving() const -> bool;
+
+    // 0 (input and output), 1 (input), 2 (output)
+    void clear(int operation = 0);
+
+    // Shows the search bar over the output (Ctrl-F)
+    void find_in_output();
+
+private:
+    Executor &m_executor;
+    const Settings &m_settings;
+    HistoryProvider m_history;
+    StatusHandler m_on_status;
+
+    // Shared with the jobs of this session, which may outlive it
+    std::shared_ptr<Interpreter> m_interpreter{std::make_shared<Interpreter>()};
+    int m_interpreter_type{Interpreter::Languages::BASH};
+
+    // Output history shown by m_command_output
+    Scrollback m_scrollback{MAX_SCROLLBACK_BYTES, MAX_SCROLLBACK_LINES};
+
+    // UI Components
+    Gtk::Box m_input_tool_box{Gtk::Orientation::HORIZONTAL};
+    Gtk::Box m_output_tool_box{Gtk::Orientation::HORIZONTAL};
+
+    Gtk::Button m_btn_input_clear;
+    Gtk::Button m_btn_input_execute;
+    Gtk::Button m_btn_input_stop;
+    Gtk::Button m_btn_output_clear;
+
+    Gtk::Label m_info_input;
+    Gtk::Label m_info_output;
+
+    Gtk::ProgressBar m_load_progress;
+    Gtk::ScrolledWindow m_input_scroll;
+    Gtk::SearchEntry m_history_search;
+    Gtk::Popover m_completion;
+    Gtk::ScrolledWindow m_completion_scroll;
+    Gtk::ListBox m_completion_list;
+    Gtk::TextView m_command_input;
+    OutputView m_command_output{m_scrollback};
+
+    // Output search bar, hidden until Ctrl-F
+    Gtk::Box m_output_search_box{Gtk::Orientation::HORIZONTAL};
+    Gtk::SearchEntry m_output_search_entry;
+    Gtk::CheckButton m_output_search_regex;
+    Gtk::CheckButton m_output_search_case;
+    Gtk::Button m_btn_search_previous;
+    Gtk::Button m_btn_search_next;
+    Gtk::Label m_output_search_info;
+
+    // Buffers
+    Glib::RefPtr<Gtk::TextBuffer> m_command_input_buffer;
+    std::unique_ptr<Highlighter> m_input_highlighter;
+    std::unique_ptr<ScriptLoader> m_script_loader;
+    sigc::connection m_script_loader_release; // Idle reset once it is done
+
+    // Interface setup
+    void setup_command_area();
+    void setup_signals();
+
+    // Command handling
+    void append_to_output(const std::string_view text, bool is_error = false);
+
+    // Runs a job on the executor; its output is streamed to the output view.
+    // The token is signalled by Stop or when the command times out.
+    using Job = std::function<void(const Interpreter::OutputHandler &on_output,
+                                   std::stop_token stop)>;
+    void run_job(Job job);
+    auto on_output_tick(const Glib::RefPtr<Gdk::FrameClock> &clock) -> bool;
+    void update_running_status();
+
+    // One queue per running command, drained once per frame on the UI thread.
+    // Escape sequences are parsed there, one parser per stream.
+    struct RunningCommand {
+        std::shared_ptr<OutputQueue> queue;
+        std::array<AnsiParser, 2> parsers; // stdout, stderr
+        uint64_t id{0};                    // Trace command id
+        int64_t start_us{0};
+        std::stop_source stop;
+        sigc::connection timeout;
+    };
+
+    void append_styled(RunningCommand &command, const std::string_view text, bool is_error);
+
+    std::vector<RunningCommand> m_running;
+    std::vector<AnsiParser::Span> m_spans;
+    guint m_output_tick{0};
+
+    // Trace command ids, unique across sessions
+    static uint64_t s_next_command_id;
+
+    // History: Up/Down recall entries starting with the text typed before,
+    // Ctrl-R searches entries containing the text of m_history_search.
+    auto on_input_key_pressed(guint keyval, guint keycode, Gdk::ModifierType state) -> bool;
+    void history_recall(bool older);
+    void history_show(const std::string_view text);
+    void history_search_start();
+    void history_search(bool older);
+    void history_search_end(bool accept);
+
+    std::optional<size_t> m_history_position; // Entry shown
+    std::string m_history_draft; // Input before the recall started
+    bool m_history_showing{false};
+
+    // Tab: completes the word before the cursor up to the common prefix of
+    // the candidates, which are listed in m_completion when there are more.
+    auto complete_input() -> bool;
+    void show_completions(const std::vector<std::string> &items);
+    void apply_completion(const std::string &item);
+    auto input_cursor() -> Gtk::TextIter;
+
+    std::string m_completion_word; // Word replaced by the chosen item
+
+    // Output search: typing searches again and selects the match nearest
+    // to the bottom of the view, Enter (or Previous) goes to older matches
+    // and Shift-Enter (or Next) to newer ones, wrapping around.
+    void output_search_changed();
+    void output_search_step(bool older);
+    void output_search_end();
+    void output_search_show(const OutputSearch::Match &match);
+    void on_output_search_update();
+
+    OutputSearch m_output_search{m_scrollback, [this]() { on_output_search_update(); }};
+    uint64_t m_output_search_anchor{0}; // End of the bottom line of the view
+    bool m_output_search_jump{false};   // Show the first match found
+
+    // Instrumentation
+    void show_trace_summary(uint64_t command);
+
+    void stop_loading();
+
+    // Export, streamed to disk while the UI keeps running
+    std::unique_ptr<SaveTask> m_input_save;
+    std::unique_ptr<SaveTask> m_output_save;
+
+    static constexpr size_t MAX_SCROLLBACK_BYTES = Scrollback::DEFAULT_MAX_BYTES;
+    static constexpr size_t MAX_SCROLLBACK_LINES = Scrollback::DEFAULT_MAX_LINES;
+    static constexpr int SAVE_CHUNK_CHARS = 256 * 1024;
+};
+
+#endif // SESSION_HPP
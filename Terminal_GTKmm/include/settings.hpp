@@ -0,0 +1,75 @@
+/*
+ * References:
+ *    https://docs.gtk.org/glib/struct.KeyFile.html
+ *
+ * User settings, read from $XDG_CONFIG_HOME/terminal_gtkmm/settings.ini.
+ * Missing file or keys keep the defaults below. Example:
+ *
+ *    [Output]
+ *    max_latency_ms=100
+ *    max_queued_bytes=4194304
+ *    frame_budget_bytes=524288
+ *    spill_to_disk=true
+ *    spill_max_bytes=4294967296
+ *
+ *    [Execution]
+ *    timeout_s=0
+ *
+ *    [Cache]
+ *    max_bytes=67108864
+ *    key_directory=true
+ *    compiled_max_bytes=33554432
+ *    compiled_on_disk=true
+ *
+ *    [Startup]
+ *    warm_up=true
+ *    lua_states=2
+ *    python=true
+ *    python_modules=os;sys;re;json;collections
+ */
+#ifndef SETTINGS_HPP
+#define SETTINGS_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct Settings {
+    // Output batching: chunks older than max_latency are drawn even past
+    // the per frame budget; producers block beyond max_queued_bytes.
+    std::chrono::milliseconds output_max_latency{100};
+    size_t output_max_queued_bytes{4 * 1024 * 1024};
+    size_t output_frame_budget{512 * 1024};
+
+    // Output past the in-memory scrollback moves to unnamed files in
+    // $XDG_CACHE_HOME/terminal_gtkmm instead of being dropped, up to
+    // spill_max_bytes per session.
+    bool spill_to_disk{true};
+    size_t spill_max_bytes{size_t{4} << 30};
+
+    // Commands running longer are stopped; zero means no limit.
+    std::chrono::seconds command_timeout{0};
+
+    // Result cache (Tools > Cache): budget of the cached output, and
+    // whether the directory a command runs in is part of its key.
+    size_t cache_max_bytes{64 * 1024 * 1024};
+    bool cache_key_directory{true};
+
+    // Compiled Lua and Python chunks of large sources: memory budget, and
+    // whether they are also kept in $XDG_CACHE_HOME/terminal_gtkmm/chunks
+    // for later starts.
+    size_t compiled_max_bytes{32 * 1024 * 1024};
+    bool compiled_on_disk{true};
+
+    // Background work at startup (see WarmUp): Lua states opened into the
+    // pool, and Python initialized with these modules imported.
+    bool warm_up{true};
+    size_t warm_up_lua_states{2};
+    bool warm_up_python{true};
+    std::vector<std::string> warm_up_python_modules{"os", "sys", "re", "json", "collections"};
+
+    static auto path() -> std::string;
+    static auto load() -> Settings;
+};
+
+#endif // SETTINGS_HPP
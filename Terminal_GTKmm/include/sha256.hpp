@@ -0,0 +1,41 @@
+/*
+ * References:
+ *    https://csrc.nist.gov/pubs/fips/180-4/upd1/final
+ *
+ * SHA-256 digest (FIPS 180-4), for keys that name persistent data: stable
+ * across builds and platforms, unlike std::hash.
+ */
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class Sha256 {
+
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    Sha256();
+
+    void update(const std::string_view data);
+
+    // Digest of everything updated so far; the object is spent afterwards.
+    [[ nodiscard ]] auto finish() -> Digest;
+
+    // Lowercase hexadecimal digest of data
+    [[ nodiscard ]] static auto hex(const std::string_view data) -> std::string;
+    [[ nodiscard ]] static auto to_hex(const Digest &digest) -> std::string;
+
+private:
+    std::array<uint32_t, 8> m_state;
+    std::array<uint8_t, 64> m_block{};
+    size_t m_used{0};     // Bytes in m_block
+    uint64_t m_length{0}; // Bytes updated in total
+
+    void compress(const uint8_t *block);
+};
+
+#endif // SHA256_HPP
@@ -0,0 +1,79 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man2/open.2.html (O_TMPFILE)
+ *    https://man7.org/linux/man-pages/man2/mmap.2.html
+ *    https://man7.org/linux/man-pages/man2/fallocate.2.html
+ *
+ * Append-only scratch file for data moved out of memory. The file has no
+ * name, so it disappears with the process. Reads go through a few mapped
+ * windows that are only mapped when a region is touched, so gigabytes on
+ * disk cost little address space and no memory until they are read.
+ */
+#ifndef SPILL_FILE_HPP
+#define SPILL_FILE_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class SpillFile {
+
+public:
+    // Created in directory on the first append, else in $TMPDIR or /tmp.
+    explicit SpillFile(std::string directory = {});
+    ~SpillFile();
+
+    SpillFile(const SpillFile &) = delete;
+    auto operator=(const SpillFile &) -> SpillFile & = delete;
+
+    // False when the file cannot be created or written (disk full).
+    [[ nodiscard ]] auto append(const void *data, size_t size) -> bool;
+
+    // Bytes appended since the last reset, discarded ones included
+    [[ nodiscard ]] auto size() const -> uint64_t { return m_size; }
+
+    // Bytes from offset up to length, cut at the end of a mapped window;
+    // valid until the next call. Empty past the end of the file.
+    [[ nodiscard ]] auto view(uint64_t offset, size_t length) const -> std::string_view;
+
+    // Copies [offset, offset + length) into out, which must have room.
+    void read(uint64_t offset, size_t length, char *out) const;
+
+    // Gives the disk space of the bytes before offset back to the file
+    // system; offsets of the later bytes do not change.
+    void discard(uint64_t offset);
+
+    // Closes the file: the next append starts a new one at offset 0.
+    void reset();
+
+    // Where the next file is created
+    void set_directory(std::string directory) { m_directory = std::move(directory); }
+
+    static constexpr size_t WINDOW_SIZE = 16 * 1024 * 1024;
+    static constexpr size_t MAX_WINDOWS = 4;
+
+    // Holes are punched once this much more can be released
+    static constexpr size_t DISCARD_STEP = 4 * 1024 * 1024;
+
+private:
+    struct Window {
+        uint64_t start{0};
+        size_t length{0};
+        const char *data{nullptr};
+        uint64_t used{0}; // Tick of the last view, for replacement
+    };
+
+    std::string m_directory;
+    int m_fd{-1};
+    uint64_t m_size{0};
+    uint64_t m_discarded{0};
+
+    mutable std::array<Window, MAX_WINDOWS> m_windows{};
+    mutable uint64_t m_tick{0};
+
+    auto open() -> bool;
+    void unmap() const;
+};
+
+#endif // SPILL_FILE_HPP
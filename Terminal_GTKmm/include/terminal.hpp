@@ -12,88 +12,111 @@
 #ifndef TERMINAL_HPP
 #define TERMINAL_HPP
 
+#include <glibmm/dispatcher.h>
 #include <gtkmm-4.0/gtkmm/aboutdialog.h>
 #include <gtkmm-4.0/gtkmm/box.h>
-#include <gtkmm-4.0/gtkmm/button.h>
 #include <gtkmm-4.0/gtkmm/filechooserdialog.h>
 #include <gtkmm-4.0/gtkmm/label.h>
+#include <gtkmm-4.0/gtkmm/notebook.h>
 #include <gtkmm-4.0/gtkmm/popovermenubar.h>
-#include <gtkmm-4.0/gtkmm/scrolledwindow.h>
-#include <gtkmm-4.0/gtkmm/textbuffer.h>
-#include <gtkmm-4.0/gtkmm/textview.h>
 #include <gtkmm-4.0/gtkmm/window.h>
 
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "executor.hpp"
+#include "history.hpp"
 #include "interpreter.hpp"
+#include "session.hpp"
+#include "settings.hpp"
+#include "warm_up.hpp"
 
 class Terminal : public Gtk::Window {
 
 public:
     Terminal();
-    virtual ~Terminal() = default;
+    virtual ~Terminal();
 
 private:
     // UI Components
     Gtk::Box m_main_box{Gtk::Orientation::VERTICAL};
-    Gtk::Box m_input_tool_box{Gtk::Orientation::HORIZONTAL};
-    Gtk::Box m_output_tool_box{Gtk::Orientation::HORIZONTAL};
     Gtk::Box m_status_bar_box{Gtk::Orientation::HORIZONTAL};
 
-    Gtk::Button m_btn_input_clear;
-    Gtk::Button m_btn_input_execute;
-    Gtk::Button m_btn_output_clear;
-
-    Gtk::Label m_info_input;
-    Gtk::Label m_info_output;
     Gtk::Label m_info_status_bar;
 
     Gtk::PopoverMenuBar m_menu_bar;
-    Gtk::ScrolledWindow m_input_scroll;
-    Gtk::ScrolledWindow m_output_scroll;
-    Gtk::TextView m_command_input;
-    Gtk::TextView m_command_output;
+    Gtk::Notebook m_notebook;
 
     std::unique_ptr<Gtk::AboutDialog> m_pAboutDialog;
     std::unique_ptr<Gtk::FileChooserDialog> m_pFileDialog;
-
-    // Buffers
-    Glib::RefPtr<Gtk::TextBuffer> m_command_input_buffer;
-    Glib::RefPtr<Gtk::TextBuffer> m_command_output_buffer;
-    Glib::RefPtr<Gtk::TextTag> m_input_tag;
+    std::unique_ptr<Gtk::FileChooserDialog> m_pExecuteDialog;
+    std::unique_ptr<Gtk::FileChooserDialog> m_pSaveDialog;
 
     // Interface setup
     void create_menu();
-    void setup_command_area();
     void setup_interface();
-    void setup_signals();
-
-    // Command handling
-    auto execute_command(const std::string_view command) -> std::string;
-    void append_to_output(const std::string_view text, bool is_error = false);
-    void on_execute_command();
 
-    // Buttons handling
-    void on_btn_input_clear_clicked();
-    void on_btn_output_clear_clicked();
+    // Sessions, one per tab; menu actions apply to the current one
+    auto session() -> Session &;
+    void on_menu_session_new();
+    void on_menu_session_close();
+    void on_session_switched(Gtk::Widget *page, guint number);
+
+    // History of a language, shared by the sessions; mapped on the first
+    // recall, not at startup
+    auto history(int language) -> History &;
+    std::array<std::unique_ptr<History>, 4> m_histories;
+
+    // Result cache
+    void on_menu_cache_toggle();
+    void on_menu_cache_clear();
+
+    // Instrumentation. Traces are written on a worker, which reports back
+    // through the dispatcher: declared before m_executor, it outlives the
+    // workers and takes pending reports with it when the window goes.
+    void on_menu_trace_toggle();
+    void on_menu_trace_export();
+    void on_trace_exported();
+    Glib::Dispatcher m_trace_exported;
+    std::mutex m_trace_mutex;
+    std::string m_trace_report; // Guarded by m_trace_mutex
 
     // Menu actions
     void on_menu_file_quit();
     void on_menu_file_open();
+    void on_menu_file_execute();
     void on_menu_file_save();
     void on_menu_file_saveAs();
     void on_menu_help_about();
     void on_menu_tools_clear(int operation = 0);
     void on_menu_interpreter(int interpreter_type = Interpreter::Languages::DEFAULT);
-
-    // Export
-    auto save(std::string path, std::string text) -> bool;
+    void on_menu_bash_mode(int mode);
+    void on_menu_lua_reset(int policy);
+    void on_menu_python_mode(int mode);
 
     // Settings
+    Settings m_settings{Settings::load()};
     std::string m_path;
-    int m_interpreter_type;
+    int m_next_session{1};
+
+    // Workers finish before the rest of the window goes away
+    Executor m_executor;
+
+    // Interpreters started in the background (see WarmUp); first frame
+    // reported by --startup-profile
+    std::unique_ptr<WarmUp> m_warm_up;
+    sigc::connection m_first_frame;
 
-    static constexpr size_t MAX_OUTPUT_BUFFER_SIZE = 100000;
+    // Declared last: destroyed first, so that their commands are stopped
+    // and no worker waits on a session that is gone.
+    std::vector<std::unique_ptr<Session>> m_sessions;
 };
 
+// Runs the application. --startup-profile prints the time to the first
+// frame and to each interpreter being ready on stderr.
 auto terminal(int argc, char *argv[]) -> int;
 
 #endif // TERMINAL_HPP
@@ -0,0 +1,45 @@
+/*
+ * Line oriented lexers for the input editor (Bash, Python, Lua). Each line
+ * is lexed from the state left by the previous one (open multi-line strings
+ * or comments), so an edit only needs to re-lex lines until the state at
+ * the end of a line is unchanged.
+ */
+#ifndef TOKENIZER_HPP
+#define TOKENIZER_HPP
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class Tokenizer {
+
+public:
+    enum Kind : uint8_t {
+        KEYWORD,
+        STRING,
+        COMMENT,
+        NUMBER,
+        VARIABLE,
+        KIND_COUNT
+    };
+
+    struct Token {
+        size_t start;  // Byte offset in the line
+        size_t length;
+        Kind kind;
+    };
+
+    // 0 is the state at the start of a script
+    using State = uint32_t;
+
+    // Replaces tokens with those of line; returns the state at its end.
+    static auto lex_line(int language, const std::string_view line, State state,
+                         std::vector<Token> &tokens) -> State;
+
+private:
+    static auto lex_bash(const std::string_view line, State state, std::vector<Token> &tokens) -> State;
+    static auto lex_python(const std::string_view line, State state, std::vector<Token> &tokens) -> State;
+    static auto lex_lua(const std::string_view line, State state, std::vector<Token> &tokens) -> State;
+};
+
+#endif // TOKENIZER_HPP
@@ -0,0 +1,93 @@
+/*
+ * References:
+ *    https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+ *    https://ui.perfetto.dev
+ *
+ * Scoped spans over the execution path (wall time, thread CPU time, RSS
+ * delta and output bytes), exported in the Chrome trace event format.
+ * Recording is off by default; a disabled span costs one relaxed atomic
+ * load and touches neither the clock nor the event list.
+ */
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Trace {
+
+public:
+    struct Event {
+        const char *name;       // String literal
+        uint64_t command;       // 0 when not tied to a command
+        uint32_t thread;
+        int64_t start_us;       // Since the trace clock origin
+        int64_t wall_us;
+        int64_t cpu_us;         // CPU time of the recording thread
+        int64_t rss_delta_kb;
+        uint64_t bytes;
+    };
+
+    class Span {
+    public:
+        explicit Span(const char *name, uint64_t command = Trace::command()) {
+            if (Trace::enabled()) {
+                begin(name, command);
+            }
+        }
+        ~Span() { stop(); }
+
+        Span(const Span &) = delete;
+        auto operator=(const Span &) -> Span & = delete;
+
+        void add_bytes(uint64_t bytes) { m_bytes += bytes; }
+
+        // Records the span now instead of at the end of the scope
+        void stop() {
+            if (m_name) {
+                end();
+                m_name = nullptr;
+            }
+        }
+
+    private:
+        const char *m_name{nullptr};
+        uint64_t m_command{0};
+        int64_t m_start_us{0};
+        int64_t m_cpu_us{0};
+        int64_t m_rss_kb{0};
+        uint64_t m_bytes{0};
+
+        void begin(const char *name, uint64_t command);
+        void end();
+    };
+
+    static auto enabled() -> bool { return s_enabled.load(std::memory_order_relaxed); }
+    static void set_enabled(bool enabled);
+
+    // Command the calling thread is working for (thread local)
+    static auto command() -> uint64_t;
+    static void set_command(uint64_t command);
+
+    static auto now_us() -> int64_t;
+    static void record(const Event &event);
+
+    [[ nodiscard ]] static auto events(uint64_t command) -> std::vector<Event>;
+    static void clear();
+
+    // Writes every recorded event; returns an error message or "".
+    static auto export_chrome(const std::string &path) -> std::string;
+
+    static constexpr size_t MAX_EVENTS = 1 << 20;
+
+private:
+    static std::atomic<bool> s_enabled;
+    static std::mutex s_mutex;
+    static std::deque<Event> s_events;
+};
+
+#endif // TRACE_HPP
@@ -0,0 +1,51 @@
+/*
+ * References:
+ *    https://docs.python.org/3/c-api/init.html#c.Py_InitializeEx
+ *    https://docs.python.org/3/c-api/import.html
+ *
+ * Startup work moved off the UI thread and ahead of the first command, so
+ * that it costs what later ones do: pooled Lua states are opened, the disk
+ * chunk cache is pruned, Python is initialized and common modules are
+ * imported, on a background thread started with the window.
+ */
+#ifndef WARM_UP_HPP
+#define WARM_UP_HPP
+
+#include <functional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+class WarmUp {
+
+public:
+    struct Options {
+        size_t lua_states{0};
+        bool python{false};
+        std::vector<std::string> python_modules;
+        std::string chunk_directory; // Empty: the chunk cache stays in memory
+    };
+
+    // Called on the warm-up thread once a language is ready
+    using ReadyHandler = std::function<void(int language)>;
+
+    // Starts warming up.
+    WarmUp(Options options, ReadyHandler on_ready);
+
+    // Waits for the step in progress; the others are left to the first
+    // command that needs them.
+    ~WarmUp();
+
+    WarmUp(const WarmUp &) = delete;
+    auto operator=(const WarmUp &) -> WarmUp & = delete;
+
+private:
+    Options m_options;
+    ReadyHandler m_on_ready;
+    std::jthread m_thread;
+
+    void run(std::stop_token stop);
+};
+
+#endif // WARM_UP_HPP
@@ -0,0 +1,331 @@
+/*
+ * References:
+ *    https://vt100.net/emu/dec_ansi_parser
+ *    https://en.wikipedia.org/wiki/ANSI_escape_code#SGR
+ */
+#include "ansi_parser.hpp"
+
+#include <cstring>
+
+namespace {
+
+// Byte classes; the transition table is indexed by [state][class]
+enum Class : uint8_t {
+  C_TEXT,      // Printable text, UTF-8 bytes and C0 controls other than ESC
+  C_ESC,       // 0x1B
+  C_BEL,       // 0x07, terminates OSC strings
+  C_INTER,     // 0x20-0x2F
+  C_DIGIT,     // 0x30-0x39
+  C_SEPARATOR, // ';' ':'
+  C_PRIVATE,   // 0x3C-0x3F
+  C_CSI,       // '['
+  C_STRING,    // ']' 'P' 'X' '^' '_' : OSC, DCS, SOS, PM, APC
+  C_BACKSLASH, // '\'
+  C_FINAL,     // Other 0x40-0x7E
+  C_CLASS_COUNT
+};
+
+enum Action : uint8_t {
+  A_NONE,
+  A_TEXT,     // Byte belongs to the text (only in GROUND)
+  A_CLEAR,    // Start of a control sequence
+  A_PARAM,    // Digit or separator of a CSI parameter
+  A_PRIVATE,  // Private marker, the sequence is not SGR
+  A_DISPATCH, // Final byte of a CSI sequence
+};
+
+struct Transition {
+  AnsiParser::State next;
+  Action action;
+};
+
+using Table =
+    std::array<std::array<Transition, C_CLASS_COUNT>, AnsiParser::STATE_COUNT>;
+
+constexpr auto make_classes() -> std::array<Class, 256> {
+  std::array<Class, 256> classes{};
+  for (int c = 0; c < 256; ++c) {
+    Class k = C_TEXT;
+    if (c == 0x1B) {
+      k = C_ESC;
+    } else if (c == 0x07) {
+      k = C_BEL;
+    } else if (c >= 0x20 && c <= 0x2F) {
+      k = C_INTER;
+    } else if (c >= 0x30 && c <= 0x39) {
+      k = C_DIGIT;
+    } else if (c == ';' || c == ':') {
+      k = C_SEPARATOR;
+    } else if (c >= 0x3C && c <= 0x3F) {
+      k = C_PRIVATE;
+    } else if (c == '[') {
+      k = C_CSI;
+    } else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_') {
+      k = C_STRING;
+    } else if (c == '\\') {
+      k = C_BACKSLASH;
+    } else if (c >= 0x40 && c <= 0x7E) {
+      k = C_FINAL;
+    }
+    classes[c] = k;
+  }
+  return classes;
+}
+
+constexpr auto make_table() -> Table {
+  using S = AnsiParser::State;
+  Table t{};
+
+  // Anything not listed below is dropped and ends the sequence
+  for (auto &row : t) {
+    for (auto &cell : row) {
+      cell = {S::GROUND, A_NONE};
+    }
+    row[C_ESC] = {S::ESCAPE, A_CLEAR};
+  }
+
+  for (auto &cell : t[S::GROUND]) {
+    cell = {S::GROUND, A_TEXT};
+  }
+  t[S::GROUND][C_ESC] = {S::ESCAPE, A_CLEAR};
+
+  t[S::ESCAPE][C_CSI] = {S::CSI_PARAM, A_CLEAR};
+  t[S::ESCAPE][C_STRING] = {S::STRING, A_NONE};
+  t[S::ESCAPE][C_INTER] = {S::ESCAPE_INTERMEDIATE, A_NONE};
+
+  t[S::ESCAPE_INTERMEDIATE][C_INTER] = {S::ESCAPE_INTERMEDIATE, A_NONE};
+
+  t[S::CSI_PARAM][C_DIGIT] = {S::CSI_PARAM, A_PARAM};
+  t[S::CSI_PARAM][C_SEPARATOR] = {S::CSI_PARAM, A_PARAM};
+  t[S::CSI_PARAM][C_PRIVATE] = {S::CSI_PARAM, A_PRIVATE};
+  t[S::CSI_PARAM][C_INTER] = {S::CSI_IGNORE, A_NONE};
+  t[S::CSI_PARAM][C_FINAL] = {S::GROUND, A_DISPATCH};
+  t[S::CSI_PARAM][C_CSI] = {S::GROUND, A_DISPATCH};
+  t[S::CSI_PARAM][C_STRING] = {S::GROUND, A_DISPATCH};
+  t[S::CSI_PARAM][C_BACKSLASH] = {S::GROUND, A_DISPATCH};
+
+  for (auto &cell : t[S::CSI_IGNORE]) {
+    cell = {S::CSI_IGNORE, A_NONE};
+  }
+  t[S::CSI_IGNORE][C_ESC] = {S::ESCAPE, A_CLEAR};
+  t[S::CSI_IGNORE][C_FINAL] = {S::GROUND, A_NONE};
+  t[S::CSI_IGNORE][C_CSI] = {S::GROUND, A_NONE};
+  t[S::CSI_IGNORE][C_STRING] = {S::GROUND, A_NONE};
+  t[S::CSI_IGNORE][C_BACKSLASH] = {S::GROUND, A_NONE};
+
+  for (auto &cell : t[S::STRING]) {
+    cell = {S::STRING, A_NONE};
+  }
+  t[S::STRING][C_BEL] = {S::GROUND, A_NONE};
+  t[S::STRING][C_ESC] = {S::STRING_ESCAPE, A_NONE};
+
+  t[S::STRING_ESCAPE][C_BACKSLASH] = {S::GROUND, A_NONE};
+
+  return t;
+}
+
+constexpr auto s_classes = make_classes();
+constexpr auto s_table = make_table();
+
+} // namespace
+
+void AnsiParser::reset() {
+  m_state = GROUND;
+  m_attributes = {};
+  m_param_count = 0;
+  m_private = false;
+}
+
+void AnsiParser::feed(const std::string_view data, std::vector<Span> &spans) {
+  spans.clear();
+
+  const char *p = data.data();
+  const char *end = p + data.size();
+
+  // Appends text, merging with the previous span when attributes match
+  auto emit = [&spans, this](const char *from, const char *to) {
+    if (from == to) {
+      return;
+    }
+    if (!spans.empty() && spans.back().attributes == m_attributes &&
+        spans.back().text.data() + spans.back().text.size() == from) {
+      spans.back().text = std::string_view(spans.back().text.data(),
+                                           to - spans.back().text.data());
+      return;
+    }
+    spans.push_back({std::string_view(from, to - from), m_attributes});
+  };
+
+  while (p < end) {
+    if (m_state == GROUND) {
+      // Fast path: plain text runs up to the next ESC
+      const auto *esc =
+          static_cast<const char *>(std::memchr(p, 0x1B, end - p));
+      const char *stop = esc ? esc : end;
+      emit(p, stop);
+      p = stop;
+      if (p == end) {
+        break;
+      }
+    }
+
+    auto byte = static_cast<unsigned char>(*p++);
+    const auto &transition = s_table[m_state][s_classes[byte]];
+
+    switch (transition.action) {
+    case A_CLEAR:
+      m_params.fill(0);
+      m_param_count = 0;
+      m_private = false;
+      break;
+    case A_PARAM:
+      if (m_param_count == 0) {
+        m_param_count = 1;
+      }
+      if (byte == ';' || byte == ':') {
+        if (m_param_count < m_params.size()) {
+          ++m_param_count;
+        }
+      } else {
+        auto &param = m_params[m_param_count - 1];
+        param = std::min<size_t>(param * 10 + (byte - '0'), MAX_PARAM);
+      }
+      break;
+    case A_PRIVATE:
+      m_private = true;
+      break;
+    case A_DISPATCH:
+      dispatch_csi(static_cast<char>(byte));
+      break;
+    case A_TEXT:
+      emit(p - 1, p);
+      break;
+    case A_NONE:
+      break;
+    }
+    m_state = transition.next;
+  }
+}
+
+void AnsiParser::dispatch_csi(char final) {
+  // Only SGR affects the output; cursor motion, erase, etc. are dropped
+  if (final == 'm' && !m_private) {
+    apply_sgr();
+  }
+}
+
+void AnsiParser::apply_sgr() {
+  if (m_param_count == 0) {
+    m_attributes = {}; // ESC[m is ESC[0m
+    return;
+  }
+
+  // Extended color: 5;n (palette) or 2;r;g;b
+  auto extended = [this](size_t &i) -> uint32_t {
+    if (i + 2 < m_param_count && m_params[i + 1] == 5) {
+      i += 2;
+      return PALETTE | (m_params[i] & 0xFF);
+    }
+    if (i + 4 < m_param_count && m_params[i + 1] == 2) {
+      uint32_t rgb = (m_params[i + 2] & 0xFF) << 16 |
+                     (m_params[i + 3] & 0xFF) << 8 | (m_params[i + 4] & 0xFF);
+      i += 4;
+      return RGB | rgb;
+    }
+    i = m_param_count; // Malformed: ignore the rest
+    return DEFAULT_COLOR;
+  };
+
+  auto &a = m_attributes;
+  for (size_t i = 0; i < m_param_count; ++i) {
+    uint32_t code = m_params[i];
+    switch (code) {
+    case 0:
+      a = {};
+      break;
+    case 1:
+      a.flags |= BOLD;
+      break;
+    case 2:
+      a.flags |= DIM;
+      break;
+    case 3:
+      a.flags |= ITALIC;
+      break;
+    case 4:
+    case 21:
+      a.flags |= UNDERLINE;
+      break;
+    case 7:
+      a.flags |= INVERSE;
+      break;
+    case 9:
+      a.flags |= STRIKETHROUGH;
+      break;
+    case 22:
+      a.flags &= ~(BOLD | DIM);
+      break;
+    case 23:
+      a.flags &= ~ITALIC;
+      break;
+    case 24:
+      a.flags &= ~UNDERLINE;
+      break;
+    case 27:
+      a.flags &= ~INVERSE;
+      break;
+    case 29:
+      a.flags &= ~STRIKETHROUGH;
+      break;
+    case 38:
+      a.foreground = extended(i);
+      break;
+    case 39:
+      a.foreground = DEFAULT_COLOR;
+      break;
+    case 48:
+      a.background = extended(i);
+      break;
+    case 49:
+      a.background = DEFAULT_COLOR;
+      break;
+    default:
+      if (code >= 30 && code <= 37) {
+        a.foreground = PALETTE | (code - 30);
+      } else if (code >= 40 && code <= 47) {
+        a.background = PALETTE | (code - 40);
+      } else if (code >= 90 && code <= 97) {
+        a.foreground = PALETTE | (code - 90 + 8);
+      } else if (code >= 100 && code <= 107) {
+        a.background = PALETTE | (code - 100 + 8);
+      }
+      break;
+    }
+  }
+}
+
+auto AnsiParser::to_rgb(uint32_t color) -> uint32_t {
+  if ((color & 0xFF000000) == RGB) {
+    return color & 0xFFFFFF;
+  }
+
+  static constexpr std::array<uint32_t, 16> base{
+      0x000000, 0xCD0000, 0x00CD00, 0xCDCD00, 0x0000EE, 0xCD00CD,
+      0x00CDCD, 0xE5E5E5, 0x7F7F7F, 0xFF0000, 0x00FF00, 0xFFFF00,
+      0x5C5CFF, 0xFF00FF, 0x00FFFF, 0xFFFFFF};
+
+  uint32_t index = color & 0xFF;
+  if (index < 16) {
+    return base[index];
+  }
+  if (index < 232) {
+    // 6x6x6 color cube
+    index -= 16;
+    auto level = [](uint32_t v) -> uint32_t { return v ? 55 + v * 40 : 0; };
+    return level(index / 36) << 16 | level(index / 6 % 6) << 8 |
+           level(index % 6);
+  }
+  // Grayscale ramp
+  uint32_t gray = 8 + (index - 232) * 10;
+  return gray << 16 | gray << 8 | gray;
+}
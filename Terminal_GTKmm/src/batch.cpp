@@ -0,0 +1,302 @@
+#include "batch.hpp"
+#include "executor.hpp"
+#include "interpreter.hpp"
+#include "output_queue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+
+namespace {
+
+constexpr const char *USAGE =
+    "Usage: TerminalApp --batch MANIFEST [-j N] [-o DIR] [-q] [--timeout SEC] "
+    "[--python-subinterpreters]\n";
+
+auto language_from_name(std::string name) -> int {
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  for (int language = Interpreter::Languages::BASH;
+       language <= Interpreter::Languages::LUA; ++language) {
+    auto candidate = Interpreter::name(language);
+    std::transform(candidate.begin(), candidate.end(), candidate.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (candidate == name) {
+      return language;
+    }
+  }
+  return Interpreter::Languages::DEFAULT;
+}
+
+// Runs a job in a session of its own, stopping it once it has run for
+// longer than timeout
+auto execute_job(const Batch::Job &job, std::chrono::seconds timeout,
+                 const Interpreter::OutputHandler &on_output) -> bool {
+  Interpreter interpreter;
+  if (timeout.count() == 0) {
+    return interpreter.execute_file(job.path, job.language, on_output);
+  }
+
+  std::stop_source stop;
+  bool ok = false;
+  {
+    // Woken early when the job finishes first
+    std::jthread watchdog([&stop, timeout](std::stop_token finished) {
+      std::mutex mutex;
+      std::condition_variable_any wake;
+      std::unique_lock lock(mutex);
+      wake.wait_for(lock, finished, timeout, [] { return false; });
+      if (!finished.stop_requested()) {
+        stop.request_stop();
+      }
+    });
+    ok = interpreter.execute_file(job.path, job.language, on_output,
+                                  stop.get_token());
+  }
+  if (stop.stop_requested()) {
+    on_output("Timed out after " + std::to_string(timeout.count()) + " s\n",
+              true);
+    return false;
+  }
+  return ok;
+}
+
+void write_all(std::FILE *stream, const std::string_view text) {
+  std::fwrite(text.data(), 1, text.size(), stream);
+}
+
+} // namespace
+
+auto Batch::requested(int argc, char *argv[]) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--batch") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto Batch::main(int argc, char *argv[]) -> int {
+  Options options;
+  std::vector<Job> jobs;
+  try {
+    options = parse_arguments(argc, argv);
+    jobs = parse_manifest(options.manifest);
+  } catch (const std::runtime_error &e) {
+    std::fprintf(stderr, "%s\n%s", e.what(), USAGE);
+    return 2;
+  }
+
+  Interpreter::set_bash_mode(Interpreter::BashMode::FRESH_SHELL);
+  Interpreter::set_lua_reset(Interpreter::LuaReset::FRESH_STATE);
+  if (options.python_subinterpreters &&
+      !Interpreter::set_python_mode(Interpreter::PythonMode::SUBINTERPRETERS)) {
+    std::fprintf(stderr, "Sub-interpreters need Python 3.12 or newer, "
+                         "Python jobs will run one at a time\n");
+  }
+
+  size_t failed = 0;
+  try {
+    failed = run(jobs, options);
+  } catch (const std::runtime_error &e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    Interpreter::shutdown();
+    return 2;
+  }
+  Interpreter::shutdown();
+
+  std::fprintf(stderr, "%zu job(s), %zu failed\n", jobs.size(), failed);
+  return failed == 0 ? 0 : 1;
+}
+
+auto Batch::parse_arguments(int argc, char *argv[]) -> Options {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::runtime_error("Missing value for " + argument);
+      }
+      return argv[++i];
+    };
+    if (argument == "--batch") {
+      options.manifest = value();
+    } else if (argument == "-j" || argument == "--jobs") {
+      auto workers = value();
+      try {
+        options.workers = std::stoul(workers);
+      } catch (const std::exception &) {
+        throw std::runtime_error("Invalid number of workers: " + workers);
+      }
+    } else if (argument == "-o" || argument == "--output-dir") {
+      options.output_dir = value();
+    } else if (argument == "--timeout") {
+      auto seconds = value();
+      try {
+        options.timeout = std::chrono::seconds(std::stoul(seconds));
+      } catch (const std::exception &) {
+        throw std::runtime_error("Invalid timeout: " + seconds);
+      }
+    } else if (argument == "-q" || argument == "--quiet") {
+      options.quiet = true;
+    } else if (argument == "--python-subinterpreters") {
+      options.python_subinterpreters = true;
+    } else {
+      throw std::runtime_error("Unknown argument: " + argument);
+    }
+  }
+  if (options.manifest.empty()) {
+    throw std::runtime_error("Missing manifest");
+  }
+  return options;
+}
+
+auto Batch::parse_manifest(const std::string &path) -> std::vector<Job> {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("Failed to open manifest " + path);
+  }
+  auto base = std::filesystem::path(path).parent_path();
+
+  std::vector<Job> jobs;
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); ++number) {
+    auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    auto last = line.find_last_not_of(" \t\r");
+    line = line.substr(first, last - first + 1);
+
+    // "<language> <path>", or a path whose extension names the language
+    Job job{Interpreter::Languages::DEFAULT, line};
+    auto space = line.find_first_of(" \t");
+    if (space != std::string::npos) {
+      int language = language_from_name(line.substr(0, space));
+      if (language != Interpreter::Languages::DEFAULT) {
+        job.language = language;
+        job.path = line.substr(line.find_first_not_of(" \t", space));
+      }
+    }
+    if (job.language == Interpreter::Languages::DEFAULT) {
+      job.language = Interpreter::language_of(job.path);
+    }
+    if (job.language == Interpreter::Languages::DEFAULT) {
+      throw std::runtime_error(path + ":" + std::to_string(number) +
+                               ": unknown language for " + job.path);
+    }
+    if (std::filesystem::path(job.path).is_relative()) {
+      job.path = (base / job.path).string();
+    }
+    jobs.push_back(std::move(job));
+  }
+  return jobs;
+}
+
+auto Batch::run(const std::vector<Job> &jobs, const Options &options)
+    -> size_t {
+  return options.output_dir.empty() ? run_streamed(jobs, options)
+                                    : run_to_files(jobs, options);
+}
+
+auto Batch::run_streamed(const std::vector<Job> &jobs, const Options &options)
+    -> size_t {
+  // One bounded queue per job: the job being printed streams straight
+  // through, later ones run ahead until their queue is full.
+  std::vector<std::shared_ptr<OutputQueue>> queues;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    queues.push_back(std::make_shared<OutputQueue>(MAX_QUEUED_BYTES));
+  }
+
+  size_t failed = 0;
+  {
+    // Jobs are started in manifest order, so the one being printed never
+    // waits behind a blocked later job.
+    Executor executor(options.workers);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      executor.submit([&job = jobs[i], queue = queues[i], &options]() {
+        bool ok = execute_job(
+            job, options.timeout,
+            [&queue](std::string_view chunk, bool is_error) {
+              queue->push({std::string(chunk), is_error});
+            });
+        // The last chunk carries the result
+        queue->push({"", !ok, true});
+      });
+    }
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      if (!options.quiet) {
+        std::fprintf(stdout, "==> [%zu/%zu] %s: %s <==\n", i + 1, jobs.size(),
+                     Interpreter::name(jobs[i].language).c_str(),
+                     jobs[i].path.c_str());
+      }
+      while (true) {
+        auto *chunk = queues[i]->wait_front();
+        if (chunk->finished) {
+          failed += chunk->is_error;
+          queues[i]->pop();
+          break;
+        }
+        if (chunk->is_error) {
+          std::fflush(stdout); // Keep both streams in order on a terminal
+        }
+        write_all(chunk->is_error ? stderr : stdout, chunk->text);
+        queues[i]->pop();
+      }
+      std::fflush(stdout);
+      queues[i].reset();
+    }
+  }
+  return failed;
+}
+
+auto Batch::run_to_files(const std::vector<Job> &jobs, const Options &options)
+    -> size_t {
+  std::filesystem::create_directories(options.output_dir);
+
+  std::atomic<size_t> failed{0};
+  {
+    Executor executor(options.workers);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      // <n>_<script name>, n padded so that files sort in manifest order
+      auto width = std::to_string(jobs.size()).size();
+      auto number = std::to_string(i + 1);
+      number.insert(0, width - number.size(), '0');
+      auto name = std::filesystem::path(jobs[i].path).filename().string();
+      auto stem =
+          (std::filesystem::path(options.output_dir) / (number + "_" + name))
+              .string();
+
+      executor.submit([&job = jobs[i], stem, &failed, &options]() {
+        std::ofstream out(stem + ".out", std::ios::binary);
+        std::ofstream err(stem + ".err", std::ios::binary);
+        bool ok = execute_job(
+            job, options.timeout,
+            [&out, &err](std::string_view chunk, bool is_error) {
+              (is_error ? err : out).write(chunk.data(), chunk.size());
+            });
+        out.close();
+        err.close();
+        if (!ok || !out || !err) {
+          failed.fetch_add(1, std::memory_order_relaxed);
+        }
+      });
+    }
+  } // Waits for every job
+
+  if (!options.quiet) {
+    std::fprintf(stderr, "Output written to %s\n", options.output_dir.c_str());
+  }
+  return failed.load();
+}
@@ -0,0 +1,299 @@
+/*
+ * References:
+ *    https://www.lua.org/manual/5.4/manual.html#lua_dump
+ *    https://docs.python.org/3/c-api/marshal.html
+ *    https://man7.org/linux/man-pages/man2/rename.2.html
+ */
+#include "chunk_cache.hpp"
+#include "sha256.hpp"
+#include "trace.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace {
+
+// First line of every file of the on-disk store, followed by a line each
+// for the key, the source digest and the chunk digest
+constexpr std::string_view FILE_MAGIC = "terminal_gtkmm chunk 2\n";
+
+auto file_header(const ChunkCache::Key &key, const std::string &chunk_digest)
+    -> std::string {
+  return std::string(FILE_MAGIC) + key.id + "\n" + key.source + "\n" +
+         chunk_digest + "\n";
+}
+
+// Directory name of a runtime: "Lua 5.4.6" -> "Lua_5.4.6"
+auto runtime_directory(const std::string_view runtime) -> std::string {
+  std::string name;
+  for (char c : runtime) {
+    bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                 (c >= '0' && c <= '9') || c == '.' || c == '-';
+    name += plain ? c : '_';
+  }
+  return name.empty() ? "_" : name;
+}
+
+// Bytes an entry accounts for, key included
+auto entry_bytes(const std::string &key, const std::string &chunk) -> size_t {
+  return key.size() + chunk.size();
+}
+
+auto read_all(int fd, std::string &data) -> bool {
+  struct stat info{};
+  if (::fstat(fd, &info) != 0) {
+    return false;
+  }
+  data.resize(static_cast<size_t>(info.st_size));
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = ::read(fd, data.data() + done, data.size() - done);
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+auto write_all(int fd, const std::string_view data) -> bool {
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Removes files unused for too long, then the oldest ones over max_bytes
+void prune(const std::string &directory, size_t max_bytes) {
+  Trace::Span span("chunk_cache_prune");
+  struct File {
+    std::filesystem::file_time_type time;
+    uintmax_t size;
+    std::filesystem::path path;
+  };
+  std::vector<File> files;
+  std::error_code error;
+  for (std::filesystem::recursive_directory_iterator it(directory, error), end;
+       !error && it != end; it.increment(error)) {
+    std::error_code file_error;
+    if (!it->is_regular_file(file_error)) {
+      continue;
+    }
+    auto time = it->last_write_time(file_error);
+    auto size = it->file_size(file_error);
+    if (!file_error) {
+      files.push_back({time, size, it->path()});
+    }
+  }
+
+  std::sort(files.begin(), files.end(),
+            [](const File &a, const File &b) { return a.time > b.time; });
+  auto oldest = std::filesystem::file_time_type::clock::now() -
+                std::chrono::days(ChunkCache::MAX_DISK_AGE_DAYS);
+  uintmax_t total = 0;
+  for (const auto &file : files) {
+    total += file.size;
+    if (file.time < oldest || total > max_bytes) {
+      std::filesystem::remove(file.path, error);
+    }
+  }
+}
+
+} // namespace
+
+ChunkCache::ChunkCache(size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+auto ChunkCache::key(const std::string_view runtime,
+                     const std::string_view name,
+                     const std::string_view source) -> Key {
+  Trace::Span span("chunk_key");
+  Key key{std::string(runtime), Sha256::hex(source), {}};
+  // Lengths first, so that no two (runtime, name) pairs read the same
+  Sha256 id;
+  id.update(std::to_string(runtime.size()) + ":" +
+            std::to_string(name.size()) + ":");
+  id.update(runtime);
+  id.update(name);
+  id.update(key.source);
+  key.id = Sha256::to_hex(id.finish());
+  return key;
+}
+
+auto ChunkCache::find(const Key &key) -> std::shared_ptr<const std::string> {
+  {
+    std::lock_guard lock(m_mutex);
+    if (auto it = m_index.find(key.id); it != m_index.end()) {
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      return it->second->second;
+    }
+  }
+  auto chunk = load(key);
+  if (chunk) {
+    std::lock_guard lock(m_mutex);
+    insert(key.id, chunk);
+  }
+  return chunk;
+}
+
+void ChunkCache::store(const Key &key, std::string chunk) {
+  auto shared = std::make_shared<const std::string>(std::move(chunk));
+  {
+    std::lock_guard lock(m_mutex);
+    insert(key.id, shared);
+  }
+  save(key, *shared);
+}
+
+void ChunkCache::clear() {
+  std::lock_guard lock(m_mutex);
+  m_index.clear();
+  m_entries.clear();
+  m_bytes = 0;
+}
+
+void ChunkCache::set_max_bytes(size_t max_bytes) {
+  std::lock_guard lock(m_mutex);
+  m_max_bytes = max_bytes;
+  evict(m_max_bytes);
+}
+
+void ChunkCache::set_directory(std::string directory, size_t max_disk_bytes) {
+  if (!directory.empty()) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+      directory.clear(); // Memory only
+    } else {
+      prune(directory, max_disk_bytes);
+    }
+  }
+  std::lock_guard lock(m_mutex);
+  m_directory = std::move(directory);
+}
+
+auto ChunkCache::entries() const -> size_t {
+  std::lock_guard lock(m_mutex);
+  return m_entries.size();
+}
+
+auto ChunkCache::bytes() const -> size_t {
+  std::lock_guard lock(m_mutex);
+  return m_bytes;
+}
+
+void ChunkCache::insert(const std::string &key,
+                        std::shared_ptr<const std::string> chunk) {
+  size_t bytes = entry_bytes(key, *chunk);
+  if (bytes > m_max_bytes) {
+    return;
+  }
+  if (auto it = m_index.find(key); it != m_index.end()) {
+    auto entry = it->second;
+    m_bytes -= entry_bytes(entry->first, *entry->second);
+    m_index.erase(it);
+    m_entries.erase(entry);
+  }
+  evict(m_max_bytes - bytes);
+
+  // The index points into the key kept by the list node
+  m_entries.emplace_front(key, std::move(chunk));
+  m_index.emplace(m_entries.front().first, m_entries.begin());
+  m_bytes += bytes;
+}
+
+void ChunkCache::evict(size_t max_bytes) {
+  while (m_bytes > max_bytes && !m_entries.empty()) {
+    auto &oldest = m_entries.back();
+    m_bytes -= entry_bytes(oldest.first, *oldest.second);
+    m_index.erase(oldest.first);
+    m_entries.pop_back();
+  }
+}
+
+auto ChunkCache::path(const Key &key) const -> std::string {
+  std::lock_guard lock(m_mutex);
+  if (m_directory.empty()) {
+    return {};
+  }
+  return m_directory + "/" + runtime_directory(key.runtime) + "/" + key.id;
+}
+
+auto ChunkCache::load(const Key &key) const
+    -> std::shared_ptr<const std::string> {
+  std::string path = this->path(key);
+  if (path.empty()) {
+    return nullptr;
+  }
+
+  Trace::Span span("chunk_cache_load");
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  std::string data;
+  bool ok = read_all(fd, data);
+  if (ok) {
+    ::futimens(fd, nullptr); // Recently used, kept by the next prune
+  }
+  ::close(fd);
+
+  // The bytes are run as code: only a complete chunk written for this very
+  // source is accepted
+  std::string prefix = std::string(FILE_MAGIC) + key.id + "\n" + key.source +
+                       "\n";
+  constexpr size_t DIGEST_LINE = 65;
+  if (!ok || !data.starts_with(prefix) ||
+      data.size() < prefix.size() + DIGEST_LINE) {
+    return nullptr;
+  }
+  std::string_view chunk_digest(data.data() + prefix.size(), DIGEST_LINE - 1);
+  std::string_view chunk(data.data() + prefix.size() + DIGEST_LINE,
+                         data.size() - prefix.size() - DIGEST_LINE);
+  if (data[prefix.size() + DIGEST_LINE - 1] != '\n' ||
+      Sha256::hex(chunk) != chunk_digest) {
+    return nullptr;
+  }
+  return std::make_shared<const std::string>(chunk);
+}
+
+void ChunkCache::save(const Key &key, const std::string &chunk) const {
+  std::string path = this->path(key);
+  if (path.empty()) {
+    return;
+  }
+
+  // Written next to its final name and renamed, so that readers never see
+  // a partial chunk
+  Trace::Span span("chunk_cache_save");
+  std::error_code error;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), error);
+  if (error) {
+    return;
+  }
+  std::vector<char> temp(path.begin(), path.end());
+  const char suffix[] = ".XXXXXX";
+  temp.insert(temp.end(), suffix, suffix + sizeof(suffix));
+  int fd = ::mkostemp(temp.data(), O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  bool ok = write_all(fd, file_header(key, Sha256::hex(chunk))) &&
+            write_all(fd, chunk);
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || ::rename(temp.data(), path.c_str()) != 0) {
+    ::unlink(temp.data());
+  }
+}
@@ -0,0 +1,209 @@
+/*
+ * References:
+ *    https://www.gnu.org/software/bash/manual/html_node/Programmable-Completion.html
+ *    https://www.gnu.org/software/bash/manual/html_node/Quoting.html
+ *    https://en.cppreference.com/w/cpp/filesystem/directory_iterator
+ */
+#include "completion.hpp"
+#include "executable_index.hpp"
+#include "interpreter.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+std::once_flag s_index_once;
+std::unique_ptr<ExecutableIndex> s_index;
+
+constexpr std::array<std::string_view, 30> BASH_BUILTINS{
+    "alias", "bg",   "case",   "cd",     "declare",  "do",     "done",
+    "echo",  "elif", "else",   "esac",   "eval",     "exec",   "exit",
+    "export", "fg",  "fi",     "for",    "function", "if",     "jobs",
+    "local", "read", "return", "set",    "source",   "then",   "unalias",
+    "unset", "while"};
+
+constexpr std::string_view SHELL_SEPARATORS = " \t\n;|&()<>";
+constexpr std::string_view SHELL_SPECIAL = " \t\n;|&()<>'\"\\$`*?!#";
+
+// Start of the shell word ending at the end of text; escaped separators
+// belong to the word
+auto shell_word_start(const std::string_view text) -> size_t {
+  size_t start = text.size();
+  while (start > 0 && (SHELL_SEPARATORS.find(text[start - 1]) ==
+                           std::string_view::npos ||
+                       (start > 1 && text[start - 2] == '\\'))) {
+    --start;
+  }
+  return start;
+}
+
+auto shell_escape(const std::string_view name) -> std::string {
+  std::string escaped;
+  for (char c : name) {
+    if (SHELL_SPECIAL.find(c) != std::string_view::npos) {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+auto shell_unescape(const std::string_view word) -> std::string {
+  std::string plain;
+  for (size_t i = 0; i < word.size(); ++i) {
+    if (word[i] == '\\' && i + 1 < word.size()) {
+      ++i;
+    }
+    plain += word[i];
+  }
+  return plain;
+}
+
+// True when the word starting at start is in command position
+auto is_command_position(const std::string_view text, size_t start) -> bool {
+  auto before = text.substr(0, start);
+  auto last = before.find_last_not_of(" \t");
+  return last == std::string_view::npos ||
+         std::string_view(";|&(\n").find(before[last]) !=
+             std::string_view::npos;
+}
+
+auto complete_files(const std::string_view word, Interpreter &interpreter)
+    -> std::vector<std::string> {
+  std::vector<std::string> items;
+  auto plain = shell_unescape(word);
+  auto slash = plain.rfind('/');
+  std::string directory =
+      slash == std::string::npos ? "" : plain.substr(0, slash + 1);
+  std::string base =
+      slash == std::string::npos ? plain : plain.substr(slash + 1);
+
+  // The word keeps ~ and relative paths; only the lookup resolves them
+  std::filesystem::path lookup = directory.empty() ? "." : directory;
+  if (directory.starts_with("~/")) {
+    const char *home = std::getenv("HOME");
+    lookup = std::filesystem::path(home ? home : "") / directory.substr(2);
+  }
+  if (lookup.is_relative()) {
+    lookup = interpreter.working_directory() / lookup;
+  }
+
+  std::error_code error;
+  for (std::filesystem::directory_iterator it(lookup, error), end;
+       !error && it != end; it.increment(error)) {
+    auto name = it->path().filename().string();
+    if (!name.starts_with(base) ||
+        (name.starts_with('.') && !base.starts_with('.'))) {
+      continue;
+    }
+    std::error_code type_error;
+    bool is_directory = it->is_directory(type_error);
+    items.push_back(shell_escape(directory + name) +
+                    (is_directory ? "/" : ""));
+  }
+  return items;
+}
+
+auto complete_bash(const std::string_view text, Interpreter &interpreter)
+    -> Completion::Result {
+  Completion::Result result;
+  result.start = shell_word_start(text);
+  auto word = text.substr(result.start);
+
+  if (is_command_position(text, result.start) &&
+      word.find('/') == std::string_view::npos && !word.empty()) {
+    if (s_index) {
+      result.items = s_index->complete(word, Completion::MAX_ITEMS);
+    }
+    for (auto builtin : BASH_BUILTINS) {
+      if (builtin.starts_with(word)) {
+        result.items.emplace_back(builtin);
+      }
+    }
+  } else {
+    result.items = complete_files(word, interpreter);
+  }
+  return result;
+}
+
+// Python and Lua: a dotted path of names, the last one being completed
+auto complete_names(const std::string_view text, int language,
+                    Interpreter &interpreter) -> Completion::Result {
+  auto is_word = [language](unsigned char c) {
+    return std::isalnum(c) || c == '_' || c == '.' || c >= 0x80 ||
+           (c == ':' && language == Interpreter::Languages::LUA);
+  };
+  Completion::Result result;
+  result.start = text.size();
+  while (result.start > 0 && is_word(text[result.start - 1])) {
+    --result.start;
+  }
+  auto word = text.substr(result.start);
+  if (word.empty() || std::isdigit(static_cast<unsigned char>(word[0]))) {
+    return result;
+  }
+
+  auto separator = word.find_last_of(
+      language == Interpreter::Languages::LUA ? ".:" : ".");
+  auto path = separator == std::string_view::npos ? std::string_view()
+                                                  : word.substr(0, separator);
+  auto prefix = separator == std::string_view::npos
+                    ? word
+                    : word.substr(separator + 1);
+  auto head = separator == std::string_view::npos
+                  ? std::string()
+                  : std::string(word.substr(0, separator + 1));
+  for (auto &name : interpreter.session_names(language, path, prefix)) {
+    result.items.push_back(head + name);
+  }
+  return result;
+}
+
+} // namespace
+
+void Completion::prepare() {
+  std::call_once(s_index_once,
+                 [] { s_index = std::make_unique<ExecutableIndex>(); });
+}
+
+auto Completion::complete(const std::string_view text, int language,
+                          Interpreter &interpreter) -> Result {
+  Trace::Span span("complete", 0);
+  Result result = language == Interpreter::Languages::BASH
+                      ? complete_bash(text, interpreter)
+                      : complete_names(text, language, interpreter);
+  auto &items = result.items;
+  std::sort(items.begin(), items.end());
+  items.erase(std::unique(items.begin(), items.end()), items.end());
+  if (items.size() > MAX_ITEMS) {
+    items.resize(MAX_ITEMS);
+  }
+  return result;
+}
+
+auto Completion::common_prefix(const std::vector<std::string> &items)
+    -> std::string {
+  if (items.empty()) {
+    return "";
+  }
+  std::string_view prefix = items.front();
+  for (const auto &item : items) {
+    auto mismatch = std::mismatch(prefix.begin(), prefix.end(), item.begin(),
+                                  item.end());
+    prefix = prefix.substr(0, mismatch.first - prefix.begin());
+  }
+  // Never ends inside a UTF-8 sequence
+  const auto &first = items.front();
+  while (!prefix.empty() && prefix.size() < first.size() &&
+         (static_cast<unsigned char>(first[prefix.size()]) & 0xC0) == 0x80) {
+    prefix.remove_suffix(1);
+  }
+  return std::string(prefix);
+}
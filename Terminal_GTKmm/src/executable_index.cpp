@@ -0,0 +1,175 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man7/inotify.7.html
+ *    https://man7.org/linux/man-pages/man3/readdir.3.html
+ */
+#include "executable_index.hpp"
+#include "trace.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <set>
+
+namespace {
+
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF |
+                                IN_MOVE_SELF;
+
+// Directories of $PATH, in order and without repetitions
+auto path_directories() -> std::vector<std::string> {
+  std::vector<std::string> directories;
+  const char *path = std::getenv("PATH");
+  std::string_view rest = path ? path : "/usr/local/bin:/usr/bin:/bin";
+  while (!rest.empty()) {
+    auto colon = rest.find(':');
+    std::string directory(rest.substr(0, colon));
+    rest = colon == std::string_view::npos ? "" : rest.substr(colon + 1);
+    if (!directory.empty() && std::find(directories.begin(), directories.end(),
+                                        directory) == directories.end()) {
+      directories.push_back(std::move(directory));
+    }
+  }
+  return directories;
+}
+
+// Names of the executable files (or links to them) in a directory
+auto scan_directory(const std::string &directory) -> std::vector<std::string> {
+  std::vector<std::string> names;
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) {
+    return names;
+  }
+  int fd = dirfd(dir);
+  while (auto *entry = readdir(dir)) {
+    if (entry->d_name[0] == '.' ||
+        (entry->d_type != DT_REG && entry->d_type != DT_LNK &&
+         entry->d_type != DT_UNKNOWN)) {
+      continue;
+    }
+    if (faccessat(fd, entry->d_name, X_OK, 0) == 0) {
+      names.emplace_back(entry->d_name);
+    }
+  }
+  closedir(dir);
+  return names;
+}
+
+} // namespace
+
+ExecutableIndex::ExecutableIndex()
+    : m_thread([this](std::stop_token stop) { run(stop); }) {}
+
+ExecutableIndex::~ExecutableIndex() = default;
+
+auto ExecutableIndex::complete(const std::string_view prefix,
+                               size_t limit) const
+    -> std::vector<std::string> {
+  std::vector<std::string> matches;
+  auto names = m_names.load();
+  if (!names) {
+    return matches;
+  }
+  for (auto it = std::lower_bound(names->begin(), names->end(), prefix);
+       it != names->end() && it->starts_with(prefix) && matches.size() < limit;
+       ++it) {
+    matches.push_back(*it);
+  }
+  return matches;
+}
+
+void ExecutableIndex::run(std::stop_token stop) {
+  auto directories = path_directories();
+  std::vector<std::vector<std::string>> contents(directories.size());
+
+  // Watches are set before scanning, so no change slips in between
+  int inotify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  std::map<int, size_t> watches; // Watch descriptor -> directory
+  for (size_t i = 0; i < directories.size(); ++i) {
+    if (inotify >= 0) {
+      int wd = inotify_add_watch(inotify, directories[i].c_str(), WATCH_MASK);
+      if (wd >= 0) {
+        watches[wd] = i;
+      }
+    }
+  }
+
+  std::set<size_t> dirty;
+  for (size_t i = 0; i < directories.size(); ++i) {
+    dirty.insert(i);
+  }
+
+  int wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  std::array<pollfd, 2> fds{pollfd{wake, POLLIN, 0},
+                            pollfd{inotify, POLLIN, 0}};
+  alignas(inotify_event) char buffer[16 * 1024];
+  {
+    std::stop_callback on_stop(stop, [wake]() {
+      uint64_t one = 1;
+      if (wake >= 0) {
+        (void)!write(wake, &one, sizeof(one));
+      }
+    });
+    // Without an eventfd, nothing wakes poll: stop is checked periodically
+    int timeout = wake >= 0 ? -1 : static_cast<int>(STOP_POLL_INTERVAL.count());
+
+    while (true) {
+      if (!dirty.empty()) {
+        Trace::Span span("index_executables");
+        for (size_t i : dirty) {
+          contents[i] = scan_directory(directories[i]);
+        }
+        dirty.clear();
+
+        auto names = std::make_shared<Names>();
+        for (const auto &directory : contents) {
+          names->insert(names->end(), directory.begin(), directory.end());
+        }
+        std::sort(names->begin(), names->end());
+        names->erase(std::unique(names->begin(), names->end()), names->end());
+        m_names.store(std::move(names));
+      }
+
+      int ready = poll(fds.data(), inotify >= 0 ? 2 : 1, timeout);
+      if (stop.stop_requested() || (ready < 0 && errno != EINTR)) {
+        break;
+      }
+      if (ready <= 0) {
+        continue; // Interrupted or timed out: revents are stale
+      }
+      // Let a package upgrade settle, so that it costs a single rescan
+      if (fds[0].revents != 0 ||
+          poll(fds.data(), 1, SETTLE_DELAY.count()) > 0 ||
+          stop.stop_requested()) {
+        break;
+      }
+      ssize_t length;
+      while ((length = read(inotify, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + length;) {
+          auto *event = reinterpret_cast<inotify_event *>(p);
+          if (auto it = watches.find(event->wd); it != watches.end()) {
+            dirty.insert(it->second);
+          }
+          p += sizeof(inotify_event) + event->len;
+        }
+      }
+    }
+  }
+
+  if (wake >= 0) {
+    close(wake);
+  }
+  if (inotify >= 0) {
+    close(inotify);
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * References:
+ *    https://en.cppreference.com/w/cpp/thread
+ */
+#include "executor.hpp"
+
+#include <algorithm>
+
+Executor::Executor(size_t workers) {
+  if (workers == 0) {
+    // One per core, so sub-interpreters can run CPU bound jobs in parallel
+    workers = std::max<size_t>(std::thread::hardware_concurrency(),
+                               MIN_WORKERS);
+  }
+
+  m_workers.reserve(workers);
+  for (size_t i = 0; i < workers; ++i) {
+    m_workers.emplace_back(
+        [this](std::stop_token stop) { run(std::move(stop)); });
+  }
+}
+
+Executor::~Executor() {
+  // Wake every worker; queued tasks are drained before the threads exit.
+  for (auto &worker : m_workers) {
+    worker.request_stop();
+  }
+  m_condition.notify_all();
+  m_workers.clear();
+}
+
+void Executor::submit(Task task) {
+  {
+    std::lock_guard lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+  m_condition.notify_one();
+}
+
+auto Executor::workers() const -> size_t { return m_workers.size(); }
+
+auto Executor::pending() const -> size_t {
+  std::lock_guard lock(m_mutex);
+  return m_tasks.size();
+}
+
+void Executor::run(std::stop_token stop) {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock lock(m_mutex);
+      if (!m_condition.wait(lock, stop, [this] { return !m_tasks.empty(); })) {
+        return; // Stop requested and nothing left to do
+      }
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+
+    try {
+      task();
+    } catch (...) {
+      // Tasks report their own errors; never let one kill the worker.
+    }
+  }
+}
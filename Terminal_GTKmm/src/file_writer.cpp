@@ -0,0 +1,176 @@
+#include "file_writer.hpp"
+#include "trace.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+FileWriter::FileWriter(const std::string &path, const Notify &notify,
+                       size_t max_queued_bytes)
+    : m_path(path), m_notify(notify), m_max_queued_bytes(max_queued_bytes) {
+  // Same directory as the target, so that rename() is atomic
+  std::vector<char> temp(path.begin(), path.end());
+  const char suffix[] = ".XXXXXX";
+  temp.insert(temp.end(), suffix, suffix + sizeof(suffix));
+  m_fd = ::mkostemp(temp.data(), O_CLOEXEC);
+  if (m_fd < 0) {
+    throw std::runtime_error("Failed to create a file next to " + path + ": " +
+                             std::strerror(errno));
+  }
+  m_temp_path = temp.data();
+  ::fchmod(m_fd, 0644); // mkstemp creates files readable by the owner only
+
+  m_thread = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+FileWriter::~FileWriter() {
+  m_thread.request_stop();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+  std::lock_guard lock(m_mutex);
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+  if (!m_finished || !m_error.empty()) {
+    ::unlink(m_temp_path.c_str());
+  }
+}
+
+auto FileWriter::can_write() const -> bool {
+  std::lock_guard lock(m_mutex);
+  return m_error.empty() && !m_closed && m_queued_bytes < m_max_queued_bytes;
+}
+
+void FileWriter::write(std::string chunk) {
+  {
+    std::lock_guard lock(m_mutex);
+    if (!m_error.empty() || m_closed || chunk.empty()) {
+      return;
+    }
+    m_queued_bytes += chunk.size();
+    m_chunks.push_back(std::move(chunk));
+  }
+  m_condition.notify_one();
+}
+
+void FileWriter::close() {
+  {
+    std::lock_guard lock(m_mutex);
+    m_closed = true;
+  }
+  m_condition.notify_one();
+}
+
+auto FileWriter::finished() const -> bool {
+  std::lock_guard lock(m_mutex);
+  return m_finished;
+}
+
+auto FileWriter::error() const -> std::string {
+  std::lock_guard lock(m_mutex);
+  return m_error;
+}
+
+void FileWriter::run(std::stop_token stop) {
+  while (true) {
+    std::string chunk;
+    {
+      std::unique_lock lock(m_mutex);
+      if (!m_condition.wait(lock, stop, [this] {
+            return !m_chunks.empty() || m_closed;
+          })) {
+        return; // Cancelled; the destructor removes the temporary file
+      }
+      if (m_chunks.empty()) {
+        break; // Closed and fully written
+      }
+      // Stays counted until written, so the producer cannot run ahead
+      chunk = std::move(m_chunks.front());
+      m_chunks.pop_front();
+    }
+
+    if (!write_all(chunk)) {
+      m_notify();
+      return;
+    }
+    {
+      std::lock_guard lock(m_mutex);
+      m_queued_bytes -= chunk.size();
+    }
+    m_notify();
+  }
+
+  if (commit()) {
+    std::lock_guard lock(m_mutex);
+    m_finished = true;
+  }
+  m_notify();
+}
+
+auto FileWriter::write_all(const std::string &chunk) -> bool {
+  Trace::Span span("write_chunk");
+  span.add_bytes(chunk.size());
+  const char *data = chunk.data();
+  size_t left = chunk.size();
+  while (left > 0) {
+    ssize_t n = ::write(m_fd, data, left);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail("Failed to write " + m_path);
+      return false;
+    }
+    data += n;
+    left -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+auto FileWriter::commit() -> bool {
+  Trace::Span span("commit_file");
+  // Data must be on disk before the rename makes it visible
+  if (::fsync(m_fd) != 0) {
+    fail("Failed to sync " + m_path);
+    return false;
+  }
+  int fd = m_fd;
+  {
+    std::lock_guard lock(m_mutex);
+    m_fd = -1;
+  }
+  if (::close(fd) != 0) {
+    fail("Failed to close " + m_path);
+    return false;
+  }
+  if (::rename(m_temp_path.c_str(), m_path.c_str()) != 0) {
+    fail("Failed to replace " + m_path);
+    return false;
+  }
+
+  // Persist the rename itself
+  auto slash = m_path.rfind('/');
+  std::string directory =
+      slash == std::string::npos ? "." : m_path.substr(0, slash + 1);
+  int dir = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir >= 0) {
+    ::fsync(dir);
+    ::close(dir);
+  }
+  return true;
+}
+
+void FileWriter::fail(const std::string &what) {
+  std::string error = what + ": " + std::strerror(errno);
+  std::lock_guard lock(m_mutex);
+  m_error = std::move(error);
+  m_finished = true;
+  m_chunks.clear();
+  m_queued_bytes = 0;
+}
@@ -0,0 +1,158 @@
+#include "highlighter.hpp"
+
+#include <glibmm/main.h>
+#include <pangomm/fontdescription.h>
+
+#include <algorithm>
+
+Highlighter::Highlighter(const Glib::RefPtr<Gtk::TextBuffer> &buffer,
+                         int language)
+    : m_buffer(buffer), m_language(language) {
+  // Created first: lowest priority, token tags override it
+  m_base_tag = m_buffer->create_tag();
+  m_base_tag->property_foreground() = "#00FF00"; // Define green color
+
+  static constexpr std::array<const char *, Tokenizer::KIND_COUNT> colors{
+      "#5FAFFF",  // KEYWORD
+      "#FFAF00",  // STRING
+      "#8A8A8A",  // COMMENT
+      "#D787FF",  // NUMBER
+      "#00D7D7"}; // VARIABLE
+  for (size_t kind = 0; kind < m_tags.size(); ++kind) {
+    m_tags[kind] = m_buffer->create_tag();
+    m_tags[kind]->property_foreground() = colors[kind];
+  }
+  m_tags[Tokenizer::KEYWORD]->property_weight() = Pango::Weight::BOLD;
+  m_tags[Tokenizer::COMMENT]->property_style() = Pango::Style::ITALIC;
+
+  m_states.assign(m_buffer->get_line_count(), 0);
+  mark_dirty(0, m_buffer->get_line_count() - 1);
+
+  // Insert runs after the default handler (the iterator points past the new
+  // text), erase before it (both ends are still known).
+  m_connections.push_back(m_buffer->signal_insert().connect(
+      sigc::mem_fun(*this, &Highlighter::on_insert), true));
+  m_connections.push_back(m_buffer->signal_erase().connect(
+      sigc::mem_fun(*this, &Highlighter::on_erase), false));
+  m_connections.push_back(m_buffer->signal_changed().connect(
+      sigc::mem_fun(*this, &Highlighter::on_changed)));
+}
+
+Highlighter::~Highlighter() {
+  m_idle.disconnect();
+  for (auto &connection : m_connections) {
+    connection.disconnect();
+  }
+}
+
+void Highlighter::set_language(int language) {
+  if (language == m_language) {
+    return;
+  }
+  m_language = language;
+  mark_dirty(0, m_buffer->get_line_count() - 1);
+  on_changed();
+}
+
+void Highlighter::on_insert(const Gtk::TextBuffer::iterator &end,
+                            const Glib::ustring &text, int /*bytes*/) {
+  auto start = end;
+  start.backward_chars(static_cast<int>(text.size()));
+  int first = start.get_line();
+  int added = end.get_line() - first;
+
+  m_states.insert(m_states.begin() + first + 1, added, 0);
+  if (m_dirty_first >= 0 && m_dirty_last > first) {
+    m_dirty_last += added;
+  }
+  mark_dirty(first, first + added);
+}
+
+void Highlighter::on_erase(const Gtk::TextBuffer::iterator &start,
+                           const Gtk::TextBuffer::iterator &end) {
+  int first = start.get_line();
+  int removed = end.get_line() - first;
+
+  m_states.erase(m_states.begin() + first + 1,
+                 m_states.begin() + first + 1 + removed);
+  if (m_dirty_first >= 0 && m_dirty_last > first) {
+    m_dirty_last = std::max(first, m_dirty_last - removed);
+  }
+  mark_dirty(first, first);
+}
+
+void Highlighter::on_changed() {
+  if (m_dirty_first < 0) {
+    return;
+  }
+  // The edited lines are painted right away, the rest is left to idle time
+  if (!relex(EDIT_BUDGET) && !m_idle.connected()) {
+    m_idle = Glib::signal_idle().connect(
+        [this]() { return !relex(IDLE_BUDGET); },
+        Glib::PRIORITY_DEFAULT_IDLE);
+  }
+}
+
+void Highlighter::mark_dirty(int first, int last) {
+  if (m_dirty_first < 0) {
+    m_dirty_first = first;
+    m_dirty_last = last;
+    return;
+  }
+  m_dirty_first = std::min(m_dirty_first, first);
+  m_dirty_last = std::max(m_dirty_last, last);
+}
+
+auto Highlighter::relex(std::chrono::microseconds budget) -> bool {
+  auto deadline = std::chrono::steady_clock::now() + budget;
+  int lines = m_buffer->get_line_count();
+  m_states.resize(lines, 0);
+
+  while (m_dirty_first >= 0 && m_dirty_first < lines &&
+         m_dirty_first <= m_dirty_last) {
+    // A changed end state makes the next line dirty as well
+    if (relex_line(m_dirty_first)) {
+      m_dirty_last = std::max(m_dirty_last, m_dirty_first + 1);
+    }
+    ++m_dirty_first;
+    if ((m_dirty_first & 63) == 0 &&
+        std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+  }
+  m_dirty_first = -1;
+  m_dirty_last = -1;
+  return true;
+}
+
+auto Highlighter::relex_line(int line) -> bool {
+  // Changing tags invalidates iterators, so each one is looked up again
+  auto start = m_buffer->get_iter_at_line(line);
+  auto end = start;
+  if (!end.ends_line()) {
+    end.forward_to_line_end();
+  }
+  auto text = m_buffer->get_slice(start, end);
+  int length = static_cast<int>(text.bytes());
+
+  for (auto &tag : m_tags) {
+    m_buffer->remove_tag(tag, m_buffer->get_iter_at_line(line),
+                         m_buffer->get_iter_at_line_index(line, length));
+  }
+  m_buffer->apply_tag(m_base_tag, m_buffer->get_iter_at_line(line),
+                      m_buffer->get_iter_at_line_index(line, length));
+
+  auto state = Tokenizer::lex_line(m_language, text.raw(),
+                                   line > 0 ? m_states[line - 1] : 0, m_tokens);
+  for (const auto &token : m_tokens) {
+    m_buffer->apply_tag(
+        m_tags[token.kind],
+        m_buffer->get_iter_at_line_index(line, static_cast<int>(token.start)),
+        m_buffer->get_iter_at_line_index(
+            line, static_cast<int>(token.start + token.length)));
+  }
+
+  bool changed = m_states[line] != state;
+  m_states[line] = state;
+  return changed;
+}
@@ -0,0 +1,192 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man3/memmem.3.html
+ *    https://man7.org/linux/man-pages/man2/open.2.html
+ */
+#include "history.hpp"
+#include "trace.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace {
+
+// Start of the entry holding the byte at offset
+auto entry_start(std::string_view data, size_t offset) -> size_t {
+  auto *nul = static_cast<const char *>(memrchr(data.data(), '\0', offset));
+  return nul ? nul - data.data() + 1 : 0;
+}
+
+// Start of the newest matching entry ending before end, an entry start
+auto find_last(std::string_view data, size_t end, std::string_view query,
+               bool prefix) -> size_t {
+  if (end == 0) {
+    return std::string_view::npos;
+  }
+  if (query.empty()) {
+    return entry_start(data, end - 1);
+  }
+
+  for (size_t high = end; high > 0;) {
+    size_t low = high > History::SEARCH_BLOCK_SIZE
+                     ? high - History::SEARCH_BLOCK_SIZE
+                     : 0;
+    // Matches starting in [low, high): the window reaches past high by
+    // the query length, but never past end
+    size_t limit = std::min(end, high + query.size() - 1);
+    const char *block = data.data() + low;
+    size_t found = std::string_view::npos;
+    for (size_t from = 0; from + query.size() <= limit - low;) {
+      auto *match = static_cast<const char *>(memmem(
+          block + from, limit - low - from, query.data(), query.size()));
+      if (!match) {
+        break;
+      }
+      size_t offset = match - data.data();
+      if (!prefix || offset == 0 || data[offset - 1] == '\0') {
+        found = offset;
+      }
+      from = offset - low + 1;
+    }
+    if (found != std::string_view::npos) {
+      return entry_start(data, found);
+    }
+    high = low;
+  }
+  return std::string_view::npos;
+}
+
+// Start of the oldest matching entry from begin, an entry start
+auto find_first(std::string_view data, size_t begin, std::string_view query,
+                bool prefix) -> size_t {
+  while (begin < data.size()) {
+    if (query.empty()) {
+      return begin;
+    }
+    auto *match = static_cast<const char *>(
+        memmem(data.data() + begin, data.size() - begin, query.data(),
+               query.size()));
+    if (!match) {
+      break;
+    }
+    size_t offset = match - data.data();
+    if (!prefix || offset == 0 || data[offset - 1] == '\0') {
+      return entry_start(data, offset);
+    }
+    begin = offset + 1;
+  }
+  return std::string_view::npos;
+}
+
+} // namespace
+
+History::History(std::string path) : m_path(std::move(path)) {}
+
+History::~History() {
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+void History::load() {
+  if (m_ready) {
+    return;
+  }
+  m_ready = true;
+  Trace::Span span("history_load");
+  try {
+    m_file.emplace(m_path);
+  } catch (const std::runtime_error &) {
+    return; // No history yet
+  }
+  // A partial entry left by a crash is ignored
+  auto data = m_file->data();
+  m_loaded = data.substr(0, entry_start(data, data.size()));
+}
+
+auto History::segments() -> std::array<std::string_view, 2> {
+  load();
+  return {m_loaded, m_added};
+}
+
+auto History::end() -> size_t {
+  load();
+  return m_loaded.size() + m_added.size();
+}
+
+auto History::entry_at(size_t position) -> Match {
+  auto data = position < m_loaded.size() ? m_loaded : std::string_view(m_added);
+  size_t offset =
+      position < m_loaded.size() ? position : position - m_loaded.size();
+  return {position, std::string_view(data.data() + offset)};
+}
+
+void History::add(const std::string_view command) {
+  std::string entry(command.substr(0, command.find('\0')));
+  auto newest = previous(end(), "", false);
+  if (entry.empty() || (newest && newest->text == entry)) {
+    return;
+  }
+  entry += '\0';
+
+  if (m_fd < 0) {
+    std::error_code error;
+    std::filesystem::create_directories(
+        std::filesystem::path(m_path).parent_path(), error);
+    m_fd = open(m_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                0600);
+    if (m_fd >= 0 && m_file && m_file->size() != m_loaded.size()) {
+      (void)!write(m_fd, "", 1); // Terminates the partial entry
+    }
+  }
+  // One write per entry: concurrent instances never interleave entries
+  if (m_fd >= 0) {
+    (void)!write(m_fd, entry.data(), entry.size());
+  }
+  m_added += entry;
+}
+
+auto History::previous(size_t position, const std::string_view query,
+                       bool prefix) -> std::optional<Match> {
+  auto [loaded, added] = segments();
+  if (position > loaded.size()) {
+    size_t found = find_last(added, std::min(position - loaded.size(),
+                                             added.size()),
+                             query, prefix);
+    if (found != std::string_view::npos) {
+      return entry_at(loaded.size() + found);
+    }
+  }
+  size_t found =
+      find_last(loaded, std::min(position, loaded.size()), query, prefix);
+  if (found != std::string_view::npos) {
+    return entry_at(found);
+  }
+  return std::nullopt;
+}
+
+auto History::next(size_t position, const std::string_view query,
+                   bool prefix) -> std::optional<Match> {
+  auto [loaded, added] = segments();
+  if (position >= loaded.size() + added.size()) {
+    return std::nullopt;
+  }
+  size_t begin = position + entry_at(position).text.size() + 1;
+  if (begin < loaded.size()) {
+    size_t found = find_first(loaded, begin, query, prefix);
+    if (found != std::string_view::npos) {
+      return entry_at(found);
+    }
+    begin = loaded.size();
+  }
+  size_t found = find_first(added, begin - loaded.size(), query, prefix);
+  if (found != std::string_view::npos) {
+    return entry_at(loaded.size() + found);
+  }
+  return std::nullopt;
+}
@@ -10,243 +10,754 @@
  *    lua
  */
 #include "interpreter.hpp"
-
-#include <Python.h>
+#include "chunk_cache.hpp"
+#include "lua_pool.hpp"
+#include "mapped_file.hpp"
+#include "output_sink.hpp"
+#include "pipeline.hpp"
+#include "process.hpp"
+#include "python_runtime.hpp"
+#include "result_cache.hpp"
+#include "trace.hpp"
 
 #include <lua.hpp>
 
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
+#include <filesystem>
 #include <memory>
-#include <sstream>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
 
 const std::vector<std::string> Interpreter::s_names{"", "Bash", "Python",
                                                     "Lua"};
 
-Interpreter::~Interpreter() {
-  // Release the Python Interpreter before exiting.
-  if (Py_IsInitialized()) {
-    Py_FinalizeEx();
-  }
+namespace {
+
+// Registry key of the userdata holding the sink of the running command.
+// The same userdata is bound as upvalue 1 of print and io.write.
+constexpr const char *LUA_OUTPUT_SLOT = "terminal_output_slot";
+
+auto lua_output_slot(lua_State *L) -> OutputSink ** {
+  lua_getfield(L, LUA_REGISTRYINDEX, LUA_OUTPUT_SLOT);
+  auto *slot = static_cast<OutputSink **>(lua_touserdata(L, -1));
+  lua_pop(L, 1);
+  return slot;
 }
 
-auto Interpreter::name(int index) -> std::string {
-  if (index >= 0 and index < s_names.size()) {
-    return s_names.at(index);
+// Writes to the sink of the command. A C++ exception must not unwind
+// through the Lua frames of the caller: it is turned into a Lua error.
+void lua_sink_write(lua_State *L, OutputSink &sink, std::string_view text) {
+  char message[256] = "";
+  try {
+    sink.write(text);
+    return;
+  } catch (const std::exception &e) {
+    std::snprintf(message, sizeof(message), "output failed: %s", e.what());
+  } catch (...) {
+    std::snprintf(message, sizeof(message), "output failed");
   }
-  return s_names.at(0);
+  luaL_error(L, "%s", message);
 }
 
-auto Interpreter::execute_command(const std::string_view command,
-                                  size_t language_type) -> std::string {
+// Replaces the standard print so output goes to the current command
+auto lua_print(lua_State *L) -> int {
+  auto *sink = *static_cast<OutputSink **>(
+      lua_touserdata(L, lua_upvalueindex(1)));
+  if (!sink) {
+    return 0;
+  }
 
-  if (language_type == Languages::BASH) {
-    return execute_bash(command);
-  } else if (language_type == Languages::PYTHON) {
-    return execute_python(command);
-  } else if (language_type == Languages::LUA) {
-    return execute_lua(command);
+  int nargs = lua_gettop(L);
+  for (int i = 1; i <= nargs; ++i) {
+    if (i > 1) {
+      lua_sink_write(L, *sink, "\t");
+    }
+    // Same conversion as the standard print (honours __tostring)
+    size_t length = 0;
+    const char *text = luaL_tolstring(L, i, &length);
+    lua_sink_write(L, *sink, std::string_view(text, length));
+    lua_pop(L, 1);
   }
+  lua_sink_write(L, *sink, "\n");
 
-  return "Language not supported!";
+  return 0;
 }
 
-auto Interpreter::execute_bash(const std::string_view command) -> std::string {
-
-  // Custom deleter for FILE
-  struct PipeDeleter {
-    void operator()(FILE *pipe) {
-      if (pipe) {
-        pclose(pipe);
-      }
+// Replaces io.write; only strings and numbers are accepted, as in Lua.
+// Returns io.stdout (upvalue 2) like the original, so calls can chain.
+auto lua_write(lua_State *L) -> int {
+  auto *sink = *static_cast<OutputSink **>(
+      lua_touserdata(L, lua_upvalueindex(1)));
+
+  int nargs = lua_gettop(L);
+  for (int i = 1; i <= nargs; ++i) {
+    size_t length = 0;
+    const char *text = luaL_checklstring(L, i, &length);
+    if (sink) {
+      lua_sink_write(L, *sink, std::string_view(text, length));
     }
-  };
+  }
 
-  // Custom Smart Pointer Type
-  using PipePtr = std::unique_ptr<FILE, PipeDeleter>;
+  lua_pushvalue(L, lua_upvalueindex(2));
+  return 1;
+}
 
-  try {
-    // popen : pipe stream to or from a process (Standard C library)
-    PipePtr pipe(popen(command.data(), "r"));
-    if (!pipe) {
-      return "Failed to execute command";
+// Stop token of the command running on this thread, polled by the hook
+thread_local const std::stop_token *s_lua_stop = nullptr;
+
+void lua_stop_hook(lua_State *L, lua_Debug *) {
+  if (s_lua_stop && s_lua_stop->stop_requested()) {
+    luaL_error(L, "cancelled");
+  }
+}
+
+LuaStatePool s_lua_pool([](lua_State *L) {
+  auto *slot = static_cast<OutputSink **>(
+      lua_newuserdatauv(L, sizeof(OutputSink *), 0));
+  *slot = nullptr;
+  lua_pushvalue(L, -1);
+  lua_setfield(L, LUA_REGISTRYINDEX, LUA_OUTPUT_SLOT);
+
+  lua_pushvalue(L, -1);
+  lua_pushcclosure(L, lua_print, 1);
+  lua_setglobal(L, "print");
+
+  lua_getglobal(L, "io");
+  lua_insert(L, -2);
+  lua_getfield(L, -2, "stdout");
+  lua_pushcclosure(L, lua_write, 2);
+  lua_setfield(L, -2, "write");
+  lua_pop(L, 1);
+});
+
+// Binds the sink and stop token of a command to a state while it runs.
+// Undone even when an exception ends the command, so that a pooled state
+// never keeps a pointer to the sink of a finished one.
+class LuaCommandScope {
+public:
+  LuaCommandScope(lua_State *L, OutputSink &sink, const std::stop_token &stop,
+                  int check_interval)
+      : m_state(L), m_slot(lua_output_slot(L)) {
+    *m_slot = &sink;
+    // Coroutines created by the chunk inherit the hook
+    if (stop.stop_possible()) {
+      s_lua_stop = &stop;
+      lua_sethook(L, lua_stop_hook, LUA_MASKCOUNT, check_interval);
     }
+  }
 
-    std::array<char, 128> buffer;
-    std::ostringstream result;
+  ~LuaCommandScope() {
+    lua_sethook(m_state, nullptr, 0, 0);
+    s_lua_stop = nullptr;
+    *m_slot = nullptr;
+    lua_settop(m_state, 0);
+  }
 
-    try {
-      while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result << buffer.data();
-      }
-    } catch (const std::exception &e) {
-      return std::string("Error reading command output: ") + e.what();
+  LuaCommandScope(const LuaCommandScope &) = delete;
+  auto operator=(const LuaCommandScope &) -> LuaCommandScope & = delete;
+
+private:
+  lua_State *m_state;
+  OutputSink **m_slot;
+};
+
+// Literals that reproduce any path byte for byte
+auto python_bytes_literal(const std::string_view text) -> std::string {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (unsigned char c : text) {
+    hex += digits[c >> 4];
+    hex += digits[c & 0xF];
+  }
+  return "bytes.fromhex('" + hex + "')";
+}
+
+auto lua_string_literal(const std::string_view text) -> std::string {
+  std::string literal = "\"";
+  for (unsigned char c : text) {
+    literal += "\\" + std::to_string(c);
+  }
+  return literal + "\"";
+}
+
+ResultCache s_result_cache;
+
+ChunkCache s_chunk_cache;
+
+// lua_Writer collecting the bytecode of lua_dump
+auto lua_append_chunk(lua_State *, const void *data, size_t size,
+                      void *chunk) -> int {
+  static_cast<std::string *>(chunk)->append(static_cast<const char *>(data),
+                                            size);
+  return 0;
+}
+
+// Pushes the function of a chunk like luaL_loadbuffer. Large sources are
+// compiled once: later loads read the bytecode kept by the chunk cache.
+auto lua_load_chunk(lua_State *L, const std::string_view source,
+                    const char *name) -> int {
+  if (!ChunkCache::worth_caching(source)) {
+    return luaL_loadbuffer(L, source.data(), source.size(), name);
+  }
+
+  auto key = ChunkCache::key(LUA_RELEASE, name, source);
+  if (auto chunk = s_chunk_cache.find(key)) {
+    Trace::Span span("lua_load_bytecode");
+    if (luaL_loadbufferx(L, chunk->data(), chunk->size(), name, "b") ==
+        LUA_OK) {
+      return LUA_OK;
     }
+    lua_pop(L, 1); // Unreadable by this build: compiled again below
+  }
 
-    auto status = pclose(pipe.release());
-    if (status != 0) {
-      return std::string("Command execution failed with status " +
-                         std::to_string(WEXITSTATUS(status)) +
-                         "\nCommand: " + std::string(command));
+  Trace::Span span("lua_compile");
+  int status = luaL_loadbuffer(L, source.data(), source.size(), name);
+  if (status == LUA_OK) {
+    // Debug information kept, for line numbers in errors
+    std::string chunk;
+    if (lua_dump(L, lua_append_chunk, &chunk, 0) == 0) {
+      s_chunk_cache.store(key, std::move(chunk));
     }
+  }
+  return status;
+}
 
-    // Successfully executed
-    return result.str();
+// Writes the value on top of the stack (popped) as an output line, through
+// tostring; nil writes nothing
+auto lua_emit(lua_State *L, OutputSink &sink) -> int {
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    return LUA_OK;
+  }
+  lua_getglobal(L, "tostring");
+  lua_insert(L, -2);
+  int status = lua_pcall(L, 1, 1, 0);
+  if (status == LUA_OK) {
+    size_t length = 0;
+    if (const char *text = lua_tolstring(L, -1, &length)) {
+      sink.write(std::string_view(text, length));
+      sink.write("\n");
+    }
+    lua_pop(L, 1);
+  }
+  return status;
+}
 
-  } catch (const std::runtime_error &e) {
-    return std::string("Bash execution error: ") + e.what();
-  } catch (const std::exception &e) {
-    return std::string("Unexpected error in bash execution: ") + e.what();
-  } catch (...) {
-    return std::string("Unknown error in bash execution\n");
+// Pipeline stage: the chunk runs once per input line, with the line in the
+// global `line`. An expression is tried first ("return " + command), so
+// that its value is written; a function value is called with the line,
+// and with nil once the input ends. The error is left on the stack.
+auto lua_run_lines(lua_State *L, const std::string_view command,
+                   const char *name, const Interpreter::InputSource &input,
+                   OutputSink &sink, std::stop_token stop) -> int {
+  std::string expression = "return " + std::string(command);
+  int status =
+      luaL_loadbuffer(L, expression.data(), expression.size(), name);
+  if (status != LUA_OK) {
+    lua_pop(L, 1);
+    status = luaL_loadbuffer(L, command.data(), command.size(), name);
+  }
+  if (status != LUA_OK) {
+    return status;
+  }
+  int chunk = lua_gettop(L);
+  lua_pushnil(L); // Last function value
+  int function = chunk + 1;
+
+  Pipeline::for_each_line(input, stop, [&](std::string_view line) {
+    lua_pushlstring(L, line.data(), line.size());
+    lua_setglobal(L, "line");
+    lua_pushvalue(L, chunk);
+    status = lua_pcall(L, 0, 1, 0);
+    if (status == LUA_OK && lua_isfunction(L, -1)) {
+      lua_copy(L, -1, function);
+      lua_pushlstring(L, line.data(), line.size());
+      status = lua_pcall(L, 1, 1, 0);
+    }
+    if (status == LUA_OK) {
+      status = lua_emit(L, sink);
+    }
+    return status == LUA_OK;
+  });
+
+  if (status == LUA_OK && !lua_isnil(L, function)) {
+    lua_pushvalue(L, function);
+    lua_pushnil(L);
+    status = lua_pcall(L, 1, 1, 0);
+    if (status == LUA_OK) {
+      status = lua_emit(L, sink);
+    }
   }
+  return status;
 }
 
-auto Interpreter::execute_python(const std::string_view command)
-    -> std::string {
-  // Initializes the Python interpreter (if not already initialized)
-  if (!Py_IsInitialized()) {
-    Py_Initialize();
+std::atomic<Interpreter::BashMode> s_bash_mode{Interpreter::SHELL_SESSION};
+
+std::atomic<Interpreter::LuaReset> s_lua_reset{Interpreter::KEEP_STATE};
+
+std::atomic<Interpreter::PythonMode> s_python_mode{
+    Interpreter::SHARED_INTERPRETER};
+
+// Keys of _G, or of the table at a path of names separated by . or :, that
+// start with prefix. Tables are read raw; for other values (a string before
+// ':') the __index table of their metatable is listed.
+auto lua_names(lua_State *L, const std::string_view path,
+               const std::string_view prefix) -> std::vector<std::string> {
+  std::vector<std::string> names;
+  int top = lua_gettop(L);
+  lua_pushglobaltable(L);
+  for (size_t start = 0; !path.empty() && start <= path.size();) {
+    size_t end = std::min(path.find_first_of(".:", start), path.size());
+    if (!lua_istable(L, -1) &&
+        luaL_getmetafield(L, -1, "__index") != LUA_TTABLE) {
+      lua_settop(L, top);
+      return names;
+    }
+    lua_pushlstring(L, path.data() + start, end - start);
+    lua_rawget(L, -2);
+    start = end + 1;
+  }
+  if (!lua_istable(L, -1) && luaL_getmetafield(L, -1, "__index") != LUA_TTABLE) {
+    lua_settop(L, top);
+    return names;
   }
 
-  // Custom deleter for PyObject*
-  // Called automatically when the Smart Pointer goes out of scope
-  struct PyObjectDeleter {
-    void operator()(PyObject *obj) {
-      if (obj) {
-        Py_DECREF(obj);
+  lua_pushnil(L);
+  while (lua_next(L, -2) != 0) {
+    if (lua_type(L, -2) == LUA_TSTRING) {
+      size_t length = 0;
+      const char *key = lua_tolstring(L, -2, &length);
+      std::string_view name(key, length);
+      if (name.starts_with(prefix)) {
+        names.emplace_back(name);
       }
     }
-  };
+    lua_pop(L, 1);
+  }
+  lua_settop(L, top);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+} // namespace
+
+// Shell, Lua state and Python namespace shared by consecutive commands of
+// a session; each is used by one command at a time
+struct Interpreter::Context {
+  ShellSession shell;
+  std::mutex shell_mutex;
+
+  LuaStatePool::StatePtr lua;
+  std::mutex lua_mutex;
+
+  PythonSession python;
+};
 
-  // Custom Smart Pointer Type
-  using PyObjectPtr = std::unique_ptr<PyObject, PyObjectDeleter>;
+Interpreter::Interpreter() : m_context(std::make_unique<Context>()) {}
 
-  // Create PyObjectPtr
-  auto make_py_object = [](PyObject *obj) -> PyObjectPtr {
-    return PyObjectPtr(obj);
-  };
+Interpreter::~Interpreter() = default;
 
-  // Creates context dictionary for globals and locals
-  PyObject *main_module =
-      PyImport_AddModule("__main__"); // No DECREF, it's singleton
-  PyObject *main_dict = PyModule_GetDict(main_module);
+void Interpreter::prepare_lua(size_t count) { s_lua_pool.prefill(count); }
 
-  // Redirect sys.stdout to capture Python output
-  PyObjectPtr sys_module(PyImport_ImportModule("sys"));
-  if (!sys_module) {
-    PyErr_Print();
-    return "Error: Failed to import sys module.\n";
+auto Interpreter::prepare_python(const std::vector<std::string> &modules,
+                                 std::stop_token stop) -> size_t {
+  PythonRuntime::initialize();
+  return PythonRuntime::import_modules(modules, stop);
+}
+
+void Interpreter::shutdown() { PythonRuntime::shutdown(); }
+
+auto Interpreter::prepare() -> bool {
+  if (bash_mode() != BashMode::SHELL_SESSION) {
+    return false;
   }
+  std::unique_lock session(m_context->shell_mutex, std::try_to_lock);
+  if (!session.owns_lock()) {
+    return false;
+  }
+  try {
+    m_context->shell.prepare();
+  } catch (const std::runtime_error &) {
+    // Reported by the first command, which tries again
+  }
+  return m_context->shell.running();
+}
+
+auto Interpreter::result_cache() -> ResultCache & { return s_result_cache; }
 
-  PyObjectPtr io_module(PyImport_ImportModule("io"));
-  if (!io_module) {
-    PyErr_Print();
-    return "Error: Failed to import io modules.\n";
+auto Interpreter::chunk_cache() -> ChunkCache & { return s_chunk_cache; }
+
+auto Interpreter::name(int index) -> std::string {
+  if (index >= 0 and index < s_names.size()) {
+    return s_names.at(index);
   }
+  return s_names.at(0);
+}
 
-  PyObjectPtr string_io(PyObject_CallMethod(io_module.get(), "StringIO", NULL));
-  if (!string_io) {
-    PyErr_Print();
-    return "Error: Failed to create StringIO.\n";
+auto Interpreter::language_of(const std::string_view path) -> int {
+  if (path.ends_with(".py")) {
+    return Languages::PYTHON;
   }
+  if (path.ends_with(".lua")) {
+    return Languages::LUA;
+  }
+  if (path.ends_with(".sh")) {
+    return Languages::BASH;
+  }
+  return Languages::DEFAULT;
+}
+
+void Interpreter::set_bash_mode(BashMode mode) { s_bash_mode = mode; }
+
+auto Interpreter::bash_mode() -> BashMode { return s_bash_mode; }
 
-  // Don't check for errors: string_io has already been validated.
-  PyObject_SetAttrString(sys_module.get(), "stdout", string_io.get());
-  PyObject_SetAttrString(sys_module.get(), "stderr", string_io.get());
+void Interpreter::set_lua_reset(LuaReset policy) { s_lua_reset = policy; }
 
-  // Execute the Python code
-  PyObjectPtr py_result(
-      PyRun_String(command.data(), Py_file_input, main_dict, main_dict));
-  if (!py_result) {
-    PyErr_Print();
+auto Interpreter::lua_reset() -> LuaReset { return s_lua_reset; }
+
+auto Interpreter::set_python_mode(PythonMode mode) -> bool {
+  if (mode == PythonMode::SUBINTERPRETERS &&
+      !PythonRuntime::subinterpreters_supported()) {
+    s_python_mode = PythonMode::SHARED_INTERPRETER;
+    return false;
   }
+  s_python_mode = mode;
+  return true;
+}
 
-  // Retrieves the contents of StringIO
-  PyObjectPtr output(PyObject_CallMethod(string_io.get(), "getvalue", NULL));
-  std::string result;
+auto Interpreter::python_mode() -> PythonMode { return s_python_mode; }
 
-  if (output && PyUnicode_Check(output.get())) {
-    result = PyUnicode_AsUTF8(output.get());
-  } else {
-    result = "Error: Could not retrieve output.\n";
+auto Interpreter::session_names(size_t language, const std::string_view path,
+                                const std::string_view prefix)
+    -> std::vector<std::string> {
+  if (language == Languages::PYTHON) {
+    return m_context->python.names(
+        path, prefix, python_mode() == PythonMode::SUBINTERPRETERS);
+  }
+  if (language == Languages::LUA) {
+    std::unique_lock session(m_context->lua_mutex, std::try_to_lock);
+    if (session.owns_lock() && m_context->lua) {
+      return lua_names(m_context->lua.get(), path, prefix);
+    }
+  }
+  return {};
+}
+
+auto Interpreter::working_directory() -> std::string {
+  if (bash_mode() == BashMode::SHELL_SESSION) {
+    std::unique_lock session(m_context->shell_mutex, std::try_to_lock);
+    if (session.owns_lock()) {
+      if (auto directory = m_context->shell.working_directory();
+          !directory.empty()) {
+        return directory;
+      }
+    }
   }
+  std::error_code error;
+  return std::filesystem::current_path(error).string();
+}
 
+auto Interpreter::execute_command(const std::string_view command,
+                                  size_t language_type) -> std::string {
+  std::string result;
+  execute_command(command, language_type,
+                  [&result](std::string_view chunk, bool) { result += chunk; });
   return result;
 }
 
-auto Interpreter::execute_lua(const std::string_view command) -> std::string {
+auto Interpreter::execute_command(const std::string_view command,
+                                  size_t language_type,
+                                  const OutputHandler &on_output,
+                                  std::stop_token stop, bool bypass_cache)
+    -> bool {
+  return execute_cached(command, {}, language_type, on_output, stop,
+                        bypass_cache);
+}
 
-  // Custom deleter for lua_State*
-  struct LuaStateDeleter {
-    void operator()(lua_State *L) {
-      if (L) {
-        lua_close(L);
+auto Interpreter::execute_cached(const std::string_view command,
+                                 const std::string_view name,
+                                 size_t language_type,
+                                 const OutputHandler &on_output,
+                                 std::stop_token stop, bool bypass_cache)
+    -> bool {
+  auto &cache = s_result_cache;
+  if (!cache.enabled()) {
+    return run_command(command, name, language_type, on_output, stop);
+  }
+
+  // Keyed before running, so a command changing its own inputs is cached
+  // under their old state and runs again next time
+  std::string directory;
+  if (cache.key_directory()) {
+    std::error_code error;
+    directory = language_type == Languages::BASH
+                    ? working_directory()
+                    : std::filesystem::current_path(error).string();
+  }
+  auto key = ResultCache::key(static_cast<int>(language_type), command,
+                              directory);
+
+  if (!bypass_cache) {
+    if (auto hit = cache.find(key)) {
+      Trace::Span span("cache_hit");
+      auto age = std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::system_clock::now() - hit->time);
+      on_output("[cached result, " + std::to_string(age.count()) +
+                    " s old]\n",
+                true);
+      for (const auto &chunk : hit->chunks) {
+        on_output(chunk.text, chunk.is_error);
       }
+      return true;
     }
-  };
+  }
+
+  // Recorded while streamed; dropped once over the size of an entry
+  ResultCache::Result result;
+  size_t limit = cache.max_result_bytes();
+  bool recording = true;
+  bool ok = run_command(
+      command, name, language_type,
+      [&](std::string_view chunk, bool is_error) {
+        on_output(chunk, is_error);
+        if (!recording) {
+          return;
+        }
+        if (result.bytes + chunk.size() > limit) {
+          recording = false;
+          result = {};
+          return;
+        }
+        auto &chunks = result.chunks;
+        if (chunks.empty() || chunks.back().is_error != is_error ||
+            chunks.back().text.size() >= ResultCache::CHUNK_SIZE) {
+          chunks.push_back({std::string(chunk), is_error});
+        } else {
+          chunks.back().text += chunk;
+        }
+        result.bytes += chunk.size();
+      },
+      stop);
+  // Failed and cancelled commands are never replayed
+  if (ok && recording) {
+    cache.store(std::move(key), std::move(result));
+  }
+  return ok;
+}
 
-  // Custom Smart Pointer Type
-  using LuaStatePtr = std::unique_ptr<lua_State, LuaStateDeleter>;
+auto Interpreter::run_command(const std::string_view command,
+                              const std::string_view name,
+                              size_t language_type,
+                              const OutputHandler &on_output,
+                              std::stop_token stop) -> bool {
+  bool ok = false;
+  if (language_type == Languages::BASH) {
+    ok = execute_bash(command, on_output, stop);
+  } else if (language_type == Languages::PYTHON) {
+    ok = execute_python(command, name, on_output, stop);
+  } else if (language_type == Languages::LUA) {
+    ok = execute_lua(command, name, on_output, stop);
+  } else {
+    on_output("Language not supported!", true);
+    return false;
+  }
+  if (stop.stop_requested()) {
+    on_output("Command cancelled\n", true);
+    return false;
+  }
+  return ok;
+}
 
+auto Interpreter::execute_file(const std::string_view path,
+                                size_t language_type,
+                                const OutputHandler &on_output,
+                                std::stop_token stop) -> bool {
+  if (language_type == Languages::BASH) {
+    return execute_command("sh " + Process::quote(path), language_type,
+                           on_output, stop);
+  }
+
+  // Python and Lua scripts run as the source of one command, in the same
+  // session as commands typed in the editor; the chunk cache and the
+  // result cache then key on their content, read from the mapping
+  std::optional<MappedFile> file;
   try {
-    LuaStatePtr L(luaL_newstate());
-    if (!L) {
-      return "Error: Failed to create Lua state.\n";
-    }
+    file.emplace(std::string(path));
+  } catch (const std::runtime_error &e) {
+    on_output(std::string(e.what()) + "\n", true);
+    return false;
+  }
 
-    // Buffer to capture Lua output
-    std::ostringstream output;
+  // Hashing and caching a large script would cost more than they save
+  if (file->size() > MAX_CACHED_SCRIPT_BYTES) {
+    file.reset();
+    std::string command;
+    if (language_type == Languages::PYTHON) {
+      auto literal = python_bytes_literal(path);
+      command = "exec(compile(open(" + literal + ", 'rb').read(), " +
+                literal + ".decode(errors='replace'), 'exec'))";
+    } else {
+      command = "dofile(" + lua_string_literal(path) + ")";
+    }
+    return run_command(command, {}, language_type, on_output, stop);
+  }
 
-    lua_pushcfunction(L.get(), [](lua_State *L) -> int {
-      int nargs = lua_gettop(L);
-      std::ostringstream oss;
-      for (int i = 1; i <= nargs; ++i) {
-        if (i > 1) {
-          oss << "\t";
-        }
-        if (lua_isstring(L, i)) {
-          oss << lua_tostring(L, i);
-        } else {
-          oss << "[non-string value]";
-        }
-      }
-      oss << "\n";
+  std::string name(path);
+  if (language_type == Languages::LUA) {
+    name.insert(0, "@"); // As dofile names its chunks
+  }
+  return execute_cached(file->data(), name, language_type, on_output, stop,
+                        false);
+}
 
-      // Retrieve pointer to std::ostringstream from Lua registry
-      lua_getfield(L, LUA_REGISTRYINDEX, "cpp_output_stream");
-      auto *out = static_cast<std::ostringstream *>(lua_touserdata(L, -1));
-      lua_pop(L, 1);
+auto Interpreter::execute_stage(const std::string_view command,
+                                size_t language_type, const InputSource *input,
+                                const OutputHandler &on_output,
+                                std::stop_token stop) -> bool {
+  if (!input) {
+    return run_command(command, {}, language_type, on_output, stop);
+  }
+  bool ok = false;
+  if (language_type == Languages::BASH) {
+    ok = execute_bash(command, on_output, stop, input);
+  } else if (language_type == Languages::PYTHON) {
+    ok = execute_python(command, {}, on_output, stop, input);
+  } else if (language_type == Languages::LUA) {
+    ok = execute_lua(command, {}, on_output, stop, input);
+  } else {
+    on_output("Language not supported!", true);
+    return false;
+  }
+  if (stop.stop_requested()) {
+    on_output("Command cancelled\n", true);
+    return false;
+  }
+  return ok;
+}
 
-      if (out) {
-        *out << oss.str();
+auto Interpreter::execute_bash(const std::string_view command,
+                               const OutputHandler &on_output,
+                               std::stop_token stop, const InputSource *input)
+    -> bool {
+  Trace::Span span("execute_bash");
+  try {
+    // Output is streamed while the child runs; nothing is buffered here.
+    // The session shell runs one command at a time, parallel commands and
+    // commands reading input get a fresh shell.
+    int status = 0;
+    std::unique_lock session(m_context->shell_mutex, std::defer_lock);
+    if (input) {
+      status = Process::run(command, on_output, stop, input);
+    } else if (session.try_lock() &&
+               bash_mode() == BashMode::SHELL_SESSION) {
+      status = m_context->shell.run(command, on_output, stop);
+    } else {
+      if (session.owns_lock()) {
+        m_context->shell.close(); // Not left idle after a switch of mode
       }
+      status = Process::run(command, on_output, stop);
+    }
+    if (status != 0 && !stop.stop_requested()) {
+      on_output("Command execution failed with status " +
+                    std::to_string(status) + "\n",
+                true);
+    }
+    return status == 0;
+  } catch (const std::runtime_error &e) {
+    on_output(std::string("Bash execution error: ") + e.what() + "\n", true);
+  } catch (const std::exception &e) {
+    on_output(std::string("Unexpected error in bash execution: ") + e.what() +
+                  "\n",
+              true);
+  } catch (...) {
+    on_output("Unknown error in bash execution\n", true);
+  }
+  return false;
+}
 
-      return 0;
-    });
-
-    lua_setglobal(L.get(), "print");
+auto Interpreter::execute_python(const std::string_view command,
+                                 const std::string_view name,
+                                 const OutputHandler &on_output,
+                                 std::stop_token stop, const InputSource *input)
+    -> bool {
+  Trace::Span span("execute_python");
+  return m_context->python.run(command, on_output,
+                               python_mode() == PythonMode::SUBINTERPRETERS,
+                               stop, name.empty() ? "<string>" : name, input);
+}
 
-    // Store pointer to output stream in Lua registry
-    lua_pushlightuserdata(L.get(), static_cast<void *>(&output));
-    lua_setfield(L.get(), LUA_REGISTRYINDEX, "cpp_output_stream");
+auto Interpreter::execute_lua(const std::string_view command,
+                              const std::string_view name,
+                              const OutputHandler &on_output,
+                              std::stop_token stop, const InputSource *input)
+    -> bool {
+  Trace::Span span("execute_lua");
+  try {
+    // print and io.write append straight into the sink
+    OutputSink sink(on_output);
+
+    // The session state is used unless another command holds it; parallel
+    // commands run in an isolated state borrowed from the pool.
+    std::unique_lock session(m_context->lua_mutex, std::try_to_lock);
+    auto policy = lua_reset();
+
+    LuaStatePool::StatePtr isolated;
+    lua_State *L = nullptr;
+    Trace::Span state_span("lua_state");
+    if (session.owns_lock()) {
+      auto &state = m_context->lua;
+      if (!state || policy == LuaReset::FRESH_STATE) {
+        s_lua_pool.release(std::move(state), false);
+        state = s_lua_pool.acquire();
+      } else if (policy == LuaReset::RESET_GLOBALS) {
+        LuaStatePool::reset_globals(state.get());
+      }
+      L = state.get();
+    } else {
+      isolated = s_lua_pool.acquire();
+      L = isolated.get();
+    }
+    state_span.stop();
+
+    int status = LUA_OK;
+    {
+      LuaCommandScope scope(L, sink, stop, LUA_STOP_CHECK_INTERVAL);
+
+      // Execute Lua code
+      std::string chunk_name = name.empty() ? "=input" : std::string(name);
+      if (input) {
+        status = lua_run_lines(L, command, chunk_name.c_str(), *input, sink,
+                               stop);
+      } else {
+        status = lua_load_chunk(L, command, chunk_name.c_str());
+        if (status == LUA_OK) {
+          status = lua_pcall(L, 0, 0, 0);
+        }
+      }
 
-    // Execute Lua code
-    int status = luaL_dostring(L.get(), command.data());
-    if (status != LUA_OK) {
-      const char *error_msg = lua_tostring(L.get(), -1);
-      std::string error_str = error_msg ? error_msg : "Unknown error";
-      lua_pop(L.get(), 1);
-      output << "Lua Error: " << error_str << "\n";
+      if (status != LUA_OK && !stop.stop_requested()) {
+        const char *error_msg = lua_tostring(L, -1);
+        std::string error_str = error_msg ? error_msg : "Unknown error";
+        sink.write("Lua Error: " + error_str + "\n", true);
+      }
     }
 
-    return output.str();
+    if (isolated) {
+      s_lua_pool.release(std::move(isolated),
+                         policy != LuaReset::FRESH_STATE);
+    }
+    return status == LUA_OK;
 
   } catch (const std::exception &e) {
-    return std::string("Lua execution error: ") + e.what() + "\n";
+    on_output(std::string("Lua execution error: ") + e.what() + "\n", true);
   } catch (...) {
-    return "Unknown error during Lua execution\n";
+    on_output("Unknown error during Lua execution\n", true);
   }
+  return false;
 }
@@ -0,0 +1,134 @@
+/*
+ * References:
+ *    https://www.lua.org/manual/5.4/manual.html#4
+ */
+#include "lua_pool.hpp"
+
+#include <lua.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Registry key of the copy of the pristine global table
+constexpr const char *PRISTINE_GLOBALS = "terminal_pristine_globals";
+
+void snapshot_globals(lua_State *L) {
+  lua_newtable(L);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+  lua_pushnil(L);
+  while (lua_next(L, -2) != 0) {
+    // Stack: snapshot, _G, key, value
+    lua_pushvalue(L, -2);
+    lua_insert(L, -2);
+    lua_rawset(L, -5);
+  }
+  lua_pop(L, 1);
+  lua_setfield(L, LUA_REGISTRYINDEX, PRISTINE_GLOBALS);
+}
+
+} // namespace
+
+void LuaStatePool::StateDeleter::operator()(lua_State *L) const {
+  if (L) {
+    lua_close(L);
+  }
+}
+
+LuaStatePool::LuaStatePool(Setup setup, size_t capacity)
+    : m_setup(std::move(setup)), m_capacity(capacity) {}
+
+auto LuaStatePool::create() const -> StatePtr {
+  StatePtr L(luaL_newstate());
+  if (!L) {
+    throw std::runtime_error("Failed to create Lua state.");
+  }
+  luaL_openlibs(L.get());
+  if (m_setup) {
+    m_setup(L.get());
+  }
+  snapshot_globals(L.get());
+  return L;
+}
+
+auto LuaStatePool::acquire() -> StatePtr {
+  {
+    std::lock_guard lock(m_mutex);
+    if (!m_states.empty()) {
+      auto L = std::move(m_states.back());
+      m_states.pop_back();
+      return L;
+    }
+  }
+  return create();
+}
+
+void LuaStatePool::release(StatePtr state, bool reuse) {
+  if (!state || !reuse) {
+    return; // Closed by the deleter
+  }
+
+  lua_settop(state.get(), 0);
+  reset_globals(state.get());
+
+  std::lock_guard lock(m_mutex);
+  if (m_states.size() < m_capacity) {
+    m_states.push_back(std::move(state));
+  }
+}
+
+void LuaStatePool::prefill(size_t count) {
+  count = std::min(count, m_capacity);
+  while (size() < count) {
+    auto L = create();
+    std::lock_guard lock(m_mutex);
+    m_states.push_back(std::move(L));
+  }
+}
+
+auto LuaStatePool::size() const -> size_t {
+  std::lock_guard lock(m_mutex);
+  return m_states.size();
+}
+
+void LuaStatePool::reset_globals(lua_State *L) {
+  lua_getfield(L, LUA_REGISTRYINDEX, PRISTINE_GLOBALS);
+  if (!lua_istable(L, -1)) {
+    lua_pop(L, 1);
+    return;
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+
+  // Collect globals that were not in the snapshot. Keys cannot be removed
+  // while traversing, so they are gathered in a temporary table first.
+  lua_newtable(L);
+  lua_Integer extra = 0;
+  lua_pushnil(L);
+  while (lua_next(L, -3) != 0) {
+    // Stack: snapshot, _G, extra, key, value
+    lua_pop(L, 1);
+    lua_pushvalue(L, -1);
+    if (lua_rawget(L, -5) == LUA_TNIL) {
+      lua_pushvalue(L, -2);
+      lua_rawseti(L, -4, ++extra);
+    }
+    lua_pop(L, 1);
+  }
+  for (lua_Integer i = 1; i <= extra; ++i) {
+    lua_rawgeti(L, -1, i);
+    lua_pushnil(L);
+    lua_rawset(L, -4);
+  }
+  lua_pop(L, 1);
+
+  // Put back every original global (covers replaced and deleted ones)
+  lua_pushnil(L);
+  while (lua_next(L, -3) != 0) {
+    // Stack: snapshot, _G, key, value
+    lua_pushvalue(L, -2);
+    lua_insert(L, -2);
+    lua_rawset(L, -4);
+  }
+  lua_pop(L, 2);
+}
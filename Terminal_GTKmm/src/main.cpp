@@ -9,6 +9,13 @@
  *    python.h
  *    lua
  */
+#include "batch.hpp"
 #include "terminal.hpp"
 
-auto main(int argc, char *argv[]) -> int { terminal(argc, argv); }
+auto main(int argc, char *argv[]) -> int {
+  // Headless: no window, no display needed
+  if (Batch::requested(argc, argv)) {
+    return Batch::main(argc, argv);
+  }
+  return terminal(argc, argv);
+}
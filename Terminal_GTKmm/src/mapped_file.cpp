@@ -0,0 +1,72 @@
+#include "mapped_file.hpp"
+#include "trace.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+MappedFile::MappedFile(const std::string &path) {
+  Trace::Span span("map_file");
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open " + path + ": " +
+                             std::strerror(errno));
+  }
+
+  struct stat info {};
+  if (::fstat(fd, &info) != 0) {
+    int error = errno;
+    ::close(fd);
+    throw std::runtime_error("Failed to stat " + path + ": " +
+                             std::strerror(error));
+  }
+  if (!S_ISREG(info.st_mode)) {
+    ::close(fd);
+    throw std::runtime_error("Not a regular file: " + path);
+  }
+
+  // mmap rejects empty mappings; an empty file is just an empty view
+  m_size = static_cast<size_t>(info.st_size);
+  if (m_size > 0) {
+    void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      int error = errno;
+      ::close(fd);
+      throw std::runtime_error("Failed to map " + path + ": " +
+                               std::strerror(error));
+    }
+    // Read front to back once
+    ::madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char *>(data);
+  }
+  ::close(fd); // The mapping keeps the file referenced
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    unmap();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+void MappedFile::unmap() {
+  if (m_data) {
+    ::munmap(const_cast<char *>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+  }
+}
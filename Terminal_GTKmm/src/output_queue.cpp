@@ -0,0 +1,72 @@
+/*
+ * References:
+ *    https://en.cppreference.com/w/cpp/atomic/atomic/wait
+ */
+#include "output_queue.hpp"
+
+#include <algorithm>
+
+OutputQueue::OutputQueue(size_t max_bytes, size_t capacity)
+    : m_slots(std::max<size_t>(capacity, 2)), m_max_bytes(max_bytes) {}
+
+auto OutputQueue::push(Chunk chunk) -> bool {
+  const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+
+  while (true) {
+    // Read the wake-up counter first so that no pop can be missed
+    auto wakeups = m_wakeups.load(std::memory_order_acquire);
+    if (m_closed.load(std::memory_order_acquire)) {
+      return false;
+    }
+    const uint64_t head = m_head.load(std::memory_order_acquire);
+    bool has_slot = tail - head < m_slots.size();
+    // A chunk larger than the budget still goes through an empty queue
+    bool has_room = head == tail or
+                    m_bytes.load(std::memory_order_acquire) < m_max_bytes;
+    if (has_slot and has_room) {
+      break;
+    }
+    m_wakeups.wait(wakeups, std::memory_order_acquire);
+  }
+
+  m_bytes.fetch_add(chunk.text.size(), std::memory_order_release);
+  m_slots[tail % m_slots.size()] = std::move(chunk);
+  m_tail.store(tail + 1, std::memory_order_release);
+  m_tail.notify_one();
+  return true;
+}
+
+auto OutputQueue::front() -> Chunk * {
+  const uint64_t head = m_head.load(std::memory_order_relaxed);
+  if (head == m_tail.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return &m_slots[head % m_slots.size()];
+}
+
+auto OutputQueue::wait_front() -> Chunk * {
+  const uint64_t head = m_head.load(std::memory_order_relaxed);
+  m_tail.wait(head, std::memory_order_acquire);
+  return &m_slots[head % m_slots.size()];
+}
+
+void OutputQueue::pop() {
+  const uint64_t head = m_head.load(std::memory_order_relaxed);
+  auto &slot = m_slots[head % m_slots.size()];
+  m_bytes.fetch_sub(slot.text.size(), std::memory_order_release);
+  slot.text = std::string(); // Release the memory now, not on reuse
+  m_head.store(head + 1, std::memory_order_release);
+
+  m_wakeups.fetch_add(1, std::memory_order_release);
+  m_wakeups.notify_one();
+}
+
+void OutputQueue::close() {
+  m_closed.store(true, std::memory_order_release);
+  m_wakeups.fetch_add(1, std::memory_order_release);
+  m_wakeups.notify_all();
+}
+
+auto OutputQueue::queued_bytes() const -> size_t {
+  return m_bytes.load(std::memory_order_relaxed);
+}
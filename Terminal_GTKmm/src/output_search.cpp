@@ -0,0 +1,402 @@
+/*
+ * References:
+ *    https://docs.gtk.org/glib/struct.Regex.html
+ *    https://man7.org/linux/man-pages/man3/memchr.3.html
+ */
+#include "output_search.hpp"
+#include "trace.hpp"
+
+#include <glibmm/main.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+
+// Rough frequency of bytes in program output, most common first; bytes
+// not listed are assumed rare
+constexpr std::string_view COMMON_BYTES =
+    " etaoinsrlhdcu.m/pf-_g0=1ywb:2,v3k\"5x4()89'76";
+
+auto byte_rank(unsigned char c) -> size_t {
+  auto position = COMMON_BYTES.find(static_cast<char>(c));
+  return position == std::string_view::npos ? 0
+                                            : COMMON_BYTES.size() - position;
+}
+
+auto to_lower(unsigned char c) -> char {
+  return static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+}
+
+} // namespace
+
+OutputSearch::OutputSearch(const Scrollback &scrollback,
+                           UpdateHandler on_update)
+    : m_scrollback(scrollback), m_on_update(std::move(on_update)) {}
+
+OutputSearch::~OutputSearch() { reset(); }
+
+void OutputSearch::reset() {
+  m_idle.disconnect();
+  if (m_regex) {
+    g_regex_unref(m_regex);
+    m_regex = nullptr;
+  }
+  m_active = false;
+  m_needle.clear();
+  m_matches.clear();
+  m_truncated = false;
+  m_current.reset();
+}
+
+auto OutputSearch::set_query(const std::string &query, bool regex,
+                             bool ignore_case) -> std::string {
+  Trace::Span span("search_query", 0);
+  reset();
+  if (query.empty()) {
+    m_on_update();
+    return {};
+  }
+
+  if (regex) {
+    // Raw: offsets are bytes and output need not be valid UTF-8
+    int flags = G_REGEX_RAW | G_REGEX_MULTILINE | G_REGEX_OPTIMIZE;
+    if (ignore_case) {
+      flags |= G_REGEX_CASELESS;
+    }
+    GError *error = nullptr;
+    m_regex = g_regex_new(query.c_str(), static_cast<GRegexCompileFlags>(flags),
+                          G_REGEX_MATCH_NOTEMPTY, &error);
+    if (!m_regex) {
+      std::string message = error ? error->message : "invalid expression";
+      g_clear_error(&error);
+      m_on_update();
+      return message;
+    }
+  } else {
+    m_needle = query;
+    m_ignore_case = ignore_case;
+    if (ignore_case) {
+      std::transform(m_needle.begin(), m_needle.end(), m_needle.begin(),
+                     [](char c) { return to_lower(c); });
+    }
+    m_rare = 0;
+    for (size_t i = 1; i < m_needle.size(); ++i) {
+      if (byte_rank(m_needle[i]) < byte_rank(m_needle[m_rare])) {
+        m_rare = i;
+      }
+    }
+  }
+  m_active = true;
+
+  // From the start of the last line: newer output is scanned as it comes,
+  // older output backwards from here
+  auto lines = m_scrollback.line_count();
+  m_scanned_end = lines > 0
+                      ? m_scrollback.line(m_scrollback.end_line() - 1).offset
+                      : m_scrollback.end_offset();
+  m_scanned_begin = m_scanned_end;
+  scan_new();
+  if (!scan(QUERY_BUDGET)) {
+    schedule();
+  }
+  m_on_update();
+  return {};
+}
+
+void OutputSearch::update() {
+  if (!m_active) {
+    return;
+  }
+  // Cleared, or trimmed past what was scanned: start over at the new begin
+  auto begin = m_scrollback.begin_offset();
+  if (m_scanned_end < begin) {
+    m_matches.clear();
+    m_scanned_begin = m_scanned_end = begin;
+    m_truncated = false;
+  }
+  while (!m_matches.empty() && m_matches.front().offset < begin) {
+    m_matches.pop_front();
+  }
+  m_scanned_begin = std::max(m_scanned_begin, begin);
+  if (m_current && m_current->offset < begin) {
+    m_current.reset();
+  }
+
+  scan_new();
+  m_on_update();
+}
+
+auto OutputSearch::complete() const -> bool {
+  return !m_active || m_truncated ||
+         m_scanned_begin <= m_scrollback.begin_offset();
+}
+
+auto OutputSearch::matches_in(uint64_t begin, uint64_t end) const
+    -> std::vector<Match> {
+  // Matches do not overlap, so their ends are sorted as well
+  std::vector<Match> matches;
+  auto it = std::partition_point(
+      m_matches.begin(), m_matches.end(),
+      [begin](const Match &m) { return m.offset + m.length <= begin; });
+  for (; it != m_matches.end() && it->offset < end; ++it) {
+    matches.push_back(*it);
+  }
+  return matches;
+}
+
+auto OutputSearch::find_next(uint64_t offset) -> std::optional<Match> {
+  while (!complete() && m_scanned_begin > offset) {
+    scan_older();
+  }
+  auto it = std::partition_point(
+      m_matches.begin(), m_matches.end(),
+      [offset](const Match &m) { return m.offset < offset; });
+  if (it == m_matches.end()) {
+    return std::nullopt;
+  }
+  return *it;
+}
+
+auto OutputSearch::find_previous(uint64_t offset) -> std::optional<Match> {
+  while (true) {
+    auto it = std::partition_point(
+        m_matches.begin(), m_matches.end(),
+        [offset](const Match &m) { return m.offset < offset; });
+    if (it != m_matches.begin()) {
+      return *(it - 1);
+    }
+    if (complete()) {
+      return std::nullopt;
+    }
+    scan_older();
+  }
+}
+
+auto OutputSearch::nearest(uint64_t offset) const -> std::optional<Match> {
+  if (m_matches.empty()) {
+    return std::nullopt;
+  }
+  auto it = std::partition_point(
+      m_matches.begin(), m_matches.end(),
+      [offset](const Match &m) { return m.offset < offset; });
+  return it != m_matches.begin() ? *(it - 1) : *it;
+}
+
+auto OutputSearch::current_index() const -> size_t {
+  if (!m_current) {
+    return 0;
+  }
+  auto it = std::partition_point(
+      m_matches.begin(), m_matches.end(),
+      [this](const Match &m) { return m.offset < m_current->offset; });
+  if (it == m_matches.end() || it->offset != m_current->offset) {
+    return 0;
+  }
+  return static_cast<size_t>(it - m_matches.begin()) + 1;
+}
+
+void OutputSearch::find_all(const std::string_view text, uint64_t base) {
+  m_found.clear();
+  if (m_regex) {
+    find_regex(text, base);
+  } else {
+    find_literal(text, base);
+  }
+}
+
+void OutputSearch::find_literal(const std::string_view text, uint64_t base) {
+  size_t n = m_needle.size();
+  if (text.size() < n) {
+    return;
+  }
+
+  // Candidates are the positions of the rarest byte (of either case);
+  // only there is the whole needle compared
+  std::array<char, 2> bytes{m_needle[m_rare], m_needle[m_rare]};
+  if (m_ignore_case && bytes[0] >= 'a' && bytes[0] <= 'z') {
+    bytes[1] = static_cast<char>(bytes[0] - ('a' - 'A'));
+  }
+  size_t streams = bytes[0] == bytes[1] ? 1 : 2;
+
+  const char *data = text.data();
+  const char *p = data + m_rare;
+  const char *end = data + text.size() - (n - 1 - m_rare);
+  std::array<const char *, 2> hits{nullptr, nullptr};
+
+  auto equal = [this, n](const char *start) {
+    if (!m_ignore_case) {
+      return std::memcmp(start, m_needle.data(), n) == 0;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      if (to_lower(start[i]) != m_needle[i]) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  while (p < end) {
+    for (size_t i = 0; i < streams; ++i) {
+      if (!hits[i] || hits[i] < p) {
+        const auto *hit = static_cast<const char *>(
+            std::memchr(p, bytes[i], static_cast<size_t>(end - p)));
+        hits[i] = hit ? hit : end;
+      }
+    }
+    p = streams == 1 ? hits[0] : std::min(hits[0], hits[1]);
+    if (p >= end) {
+      break;
+    }
+    const char *start = p - m_rare;
+    if (equal(start)) {
+      m_found.push_back({base + static_cast<uint64_t>(start - data),
+                         static_cast<uint64_t>(n)});
+      // Matches do not overlap
+      p = static_cast<size_t>(end - p) > n ? p + n : end;
+    } else {
+      ++p;
+    }
+  }
+}
+
+void OutputSearch::find_regex(const std::string_view text, uint64_t base) {
+  GMatchInfo *info = nullptr;
+  g_regex_match_full(m_regex, text.data(), static_cast<gssize>(text.size()), 0,
+                     G_REGEX_MATCH_NOTEMPTY, &info, nullptr);
+  while (g_match_info_matches(info)) {
+    int start = 0, end = 0;
+    if (g_match_info_fetch_pos(info, 0, &start, &end) && end > start) {
+      m_found.push_back({base + static_cast<uint64_t>(start),
+                         static_cast<uint64_t>(end - start)});
+    }
+    g_match_info_next(info, nullptr);
+  }
+  g_match_info_free(info);
+}
+
+void OutputSearch::scan_new() {
+  Trace::Span span("search_new", 0);
+  // The unfinished last line scanned before is scanned again
+  while (!m_matches.empty() && m_matches.back().offset >= m_scanned_end) {
+    m_matches.pop_back();
+  }
+
+  auto end = m_scrollback.end_offset();
+  for (uint64_t position = m_scanned_end; position < end;) {
+    m_scrollback.read(position, std::min<uint64_t>(CHUNK_SIZE, end - position),
+                      m_chunk);
+    if (m_chunk.empty()) {
+      break;
+    }
+    find_all(m_chunk, position);
+    span.add_bytes(m_chunk.size());
+
+    uint64_t next = position + m_chunk.size();
+    if (next < end) {
+      // Pieces end after their last line break, so that no match is split
+      // between two of them. A line longer than a piece is cut short of
+      // the piece end by the longest match that could cross it; matches
+      // starting past the cut are found again in the next piece.
+      auto newline = m_chunk.rfind('\n');
+      if (newline != std::string::npos) {
+        next = position + newline + 1;
+      } else {
+        size_t overlap = m_regex ? REGEX_OVERLAP : m_needle.size() - 1;
+        next -= std::min(overlap, m_chunk.size() - 1);
+      }
+      while (!m_found.empty() && m_found.back().offset >= next) {
+        m_found.pop_back();
+      }
+      if (!m_found.empty()) {
+        next = std::max(next, m_found.back().offset + m_found.back().length);
+      }
+    }
+    m_matches.insert(m_matches.end(), m_found.begin(), m_found.end());
+
+    if (next == end) {
+      auto newline = m_chunk.rfind('\n');
+      m_scanned_end =
+          newline == std::string::npos ? position : position + newline + 1;
+    } else {
+      m_scanned_end = next;
+    }
+    position = next;
+  }
+
+  // Over the limit the oldest matches go, and older output is not scanned
+  if (m_matches.size() > MAX_MATCHES) {
+    m_matches.erase(m_matches.begin(),
+                    m_matches.begin() + (m_matches.size() - MAX_MATCHES));
+    m_scanned_begin = m_matches.front().offset;
+    m_truncated = true;
+  }
+}
+
+auto OutputSearch::scan_older() -> bool {
+  auto begin = m_scrollback.begin_offset();
+  if (complete()) {
+    return true;
+  }
+  Trace::Span span("search_older", 0);
+
+  // Chunks start at a line, unless a single line is longer than a chunk.
+  // They reach past high by the longest match that could cross it, as a
+  // line may have been cut there; matches found again past it are dropped.
+  uint64_t high = m_scanned_begin;
+  uint64_t low = high - std::min<uint64_t>(CHUNK_SIZE, high - begin);
+  uint64_t overlap = std::min<uint64_t>(
+      m_regex ? REGEX_OVERLAP : m_needle.size() - 1, m_scanned_end - high);
+  m_scrollback.read(low, high + overlap - low, m_chunk);
+  if (low > begin) {
+    auto newline = m_chunk.find('\n');
+    if (newline != std::string::npos && newline + 1 < high - low) {
+      m_chunk.erase(0, newline + 1);
+      low += newline + 1;
+    }
+  }
+  span.add_bytes(m_chunk.size());
+
+  find_all(m_chunk, low);
+  auto known = [this, high](const Match &m) {
+    return m.offset >= high ||
+           (!m_matches.empty() &&
+            m.offset + m.length > m_matches.front().offset);
+  };
+  while (!m_found.empty() && known(m_found.back())) {
+    m_found.pop_back();
+  }
+  auto first = m_found.begin();
+  if (m_matches.size() + m_found.size() > MAX_MATCHES) {
+    first = m_found.end() - (MAX_MATCHES - m_matches.size());
+    m_truncated = true;
+  }
+  m_matches.insert(m_matches.begin(), first, m_found.end());
+  m_scanned_begin = m_truncated && !m_matches.empty() ? m_matches.front().offset
+                                                      : low;
+  return complete();
+}
+
+auto OutputSearch::scan(std::chrono::microseconds budget) -> bool {
+  auto deadline = std::chrono::steady_clock::now() + budget;
+  while (!scan_older()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void OutputSearch::schedule() {
+  if (m_idle.connected()) {
+    return;
+  }
+  m_idle = Glib::signal_idle().connect(
+      [this]() {
+        bool done = scan(IDLE_BUDGET);
+        m_on_update();
+        return !done;
+      },
+      Glib::PRIORITY_DEFAULT_IDLE);
+}
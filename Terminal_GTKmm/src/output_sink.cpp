@@ -0,0 +1,38 @@
+#include "output_sink.hpp"
+
+OutputSink::OutputSink(const Interpreter::OutputHandler &on_output)
+    : m_on_output(on_output), m_last_flush(std::chrono::steady_clock::now()) {
+  m_buffer.reserve(FLUSH_SIZE);
+}
+
+OutputSink::~OutputSink() {
+  try {
+    flush();
+  } catch (...) {
+    // Never throw from a destructor
+  }
+}
+
+void OutputSink::write(const std::string_view text, bool is_error) {
+  // Keep stdout and stderr chunks in the order they were written
+  if (is_error != m_is_error) {
+    flush();
+    m_is_error = is_error;
+  }
+
+  m_buffer.append(text);
+
+  if (m_buffer.size() >= FLUSH_SIZE or
+      std::chrono::steady_clock::now() - m_last_flush >= FLUSH_INTERVAL) {
+    flush();
+  }
+}
+
+void OutputSink::flush() {
+  m_last_flush = std::chrono::steady_clock::now();
+  if (m_buffer.empty()) {
+    return;
+  }
+  m_on_output(m_buffer, m_is_error);
+  m_buffer.clear(); // Keeps the capacity for the next chunk
+}
@@ -0,0 +1,416 @@
+/*
+ * References:
+ *    https://gnome.pages.gitlab.gnome.org/gtkmm-documentation/sec-drawing-area.html
+ *    https://docs.gtk.org/Pango/
+ */
+#include "output_view.hpp"
+#include "trace.hpp"
+
+#include <gdk/gdkkeysyms.h>
+#include <gtkmm-4.0/gtkmm/eventcontrollerkey.h>
+#include <gtkmm-4.0/gtkmm/eventcontrollerscroll.h>
+#include <gtkmm-4.0/gtkmm/gesturedrag.h>
+
+#include <cmath>
+
+OutputView::OutputView(Scrollback &scrollback)
+    : Gtk::Box(Gtk::Orientation::VERTICAL), m_scrollback(scrollback),
+      m_adjustment(Gtk::Adjustment::create(0, 0, 0, 1, 10, 0)),
+      m_scrollbar(m_adjustment, Gtk::Orientation::VERTICAL),
+      m_hadjustment(Gtk::Adjustment::create(0, 0, 0, 1, 10, 0)),
+      m_hscrollbar(m_hadjustment, Gtk::Orientation::HORIZONTAL) {
+
+  m_styles = {{Gdk::RGBA("#95A3FC")}, {Gdk::RGBA("#FF0000")}};
+
+  m_area.set_hexpand(true);
+  m_area.set_vexpand(true);
+  m_area.set_focusable(true);
+  m_area.set_draw_func(sigc::mem_fun(*this, &OutputView::on_draw));
+  m_area.signal_resize().connect(sigc::mem_fun(*this, &OutputView::on_resize));
+
+  // Mouse wheel / touchpad
+  auto scroll = Gtk::EventControllerScroll::create();
+  scroll->set_flags(Gtk::EventControllerScroll::Flags::BOTH_AXES);
+  scroll->signal_scroll().connect(sigc::mem_fun(*this, &OutputView::on_scroll),
+                                  false);
+  m_area.add_controller(scroll);
+
+  // Line selection
+  auto drag = Gtk::GestureDrag::create();
+  drag->signal_drag_begin().connect(
+      sigc::mem_fun(*this, &OutputView::on_drag_begin));
+  drag->signal_drag_update().connect(
+      sigc::mem_fun(*this, &OutputView::on_drag_update));
+  m_area.add_controller(drag);
+
+  // Ctrl+C, Page Up/Down, Home/End, Left/Right
+  auto keys = Gtk::EventControllerKey::create();
+  keys->signal_key_pressed().connect(
+      sigc::mem_fun(*this, &OutputView::on_key_pressed), false);
+  m_area.add_controller(keys);
+
+  m_adjustment->signal_value_changed().connect([this]() {
+    m_follow = m_adjustment->get_value() + m_adjustment->get_page_size() >=
+               m_adjustment->get_upper();
+    update_hadjustment();
+    m_area.queue_draw();
+  });
+  m_hadjustment->signal_value_changed().connect(
+      [this]() { m_area.queue_draw(); });
+
+  m_row.set_vexpand(true);
+  m_row.append(m_area);
+  m_row.append(m_scrollbar);
+  append(m_row);
+  append(m_hscrollbar);
+
+  update_metrics();
+}
+
+void OutputView::set_style(Scrollback::Style id, const Style &style) {
+  if (id >= m_styles.size()) {
+    m_styles.resize(id + 1, m_styles.front());
+  }
+  m_styles[id] = style;
+  m_area.queue_draw();
+}
+
+auto OutputView::intern(const AnsiParser::Attributes &attributes,
+                        Scrollback::Style base) -> Scrollback::Style {
+  if (attributes == AnsiParser::Attributes{}) {
+    return base;
+  }
+
+  uint64_t key = uint64_t(attributes.foreground) |
+                 uint64_t(attributes.background) << 26 |
+                 uint64_t(attributes.flags) << 52 | uint64_t(base) << 58;
+  if (auto it = m_style_ids.find(key); it != m_style_ids.end()) {
+    return it->second;
+  }
+  if (m_styles.size() >= MAX_STYLES) {
+    return base;
+  }
+
+  auto color = [](uint32_t rgb) {
+    Gdk::RGBA c;
+    c.set_rgba_u((rgb >> 16 & 0xFF) * 257, (rgb >> 8 & 0xFF) * 257,
+                 (rgb & 0xFF) * 257);
+    return c;
+  };
+
+  Style style = m_styles.at(base);
+  if (attributes.foreground != AnsiParser::DEFAULT_COLOR) {
+    style.foreground = color(AnsiParser::to_rgb(attributes.foreground));
+  }
+  if (attributes.background != AnsiParser::DEFAULT_COLOR) {
+    style.background = color(AnsiParser::to_rgb(attributes.background));
+  }
+  style.flags = attributes.flags;
+  if (attributes.flags & AnsiParser::INVERSE) {
+    auto foreground = style.foreground;
+    style.foreground = style.background.value_or(Gdk::RGBA("#000000"));
+    style.background = foreground;
+  }
+
+  auto id = static_cast<Scrollback::Style>(m_styles.size());
+  m_styles.push_back(style);
+  m_style_ids.emplace(key, id);
+  return id;
+}
+
+void OutputView::refresh() {
+  update_adjustment();
+  m_area.queue_draw();
+}
+
+auto OutputView::selected_text() const -> std::string {
+  if (!m_has_selection) {
+    return {};
+  }
+  auto first = std::max(std::min(m_selection_anchor, m_selection_end),
+                        m_scrollback.first_line());
+  auto last = std::min(std::max(m_selection_anchor, m_selection_end) + 1,
+                       m_scrollback.end_line());
+  std::string text;
+  for (auto n = first; n < last; ++n) {
+    text += m_scrollback.line_text(n);
+    text += '\n';
+  }
+  return text;
+}
+
+void OutputView::set_search(const OutputSearch *search) {
+  m_search = search;
+  m_area.queue_draw();
+}
+
+void OutputView::show_line(uint64_t number) {
+  double page = m_adjustment->get_page_size();
+  double value = std::clamp(static_cast<double>(number) - std::floor(page / 2),
+                            m_adjustment->get_lower(),
+                            std::max(m_adjustment->get_lower(),
+                                     m_adjustment->get_upper() - page));
+  m_follow = false;
+  m_adjustment->set_value(value);
+  m_area.queue_draw();
+}
+
+auto OutputView::last_visible_line() const -> uint64_t {
+  auto end = std::min(static_cast<uint64_t>(m_adjustment->get_value()) +
+                          static_cast<uint64_t>(visible_lines()),
+                      m_scrollback.end_line());
+  return end > m_scrollback.first_line() ? end - 1 : m_scrollback.first_line();
+}
+
+void OutputView::update_metrics() {
+  m_layout = m_area.create_pango_layout("");
+  m_layout->set_font_description(Pango::FontDescription("Monospace 10"));
+  m_layout->set_text("M");
+  m_layout->get_pixel_size(m_char_width, m_line_height);
+  m_line_height = std::max(m_line_height, 1);
+  m_layout->set_text("");
+}
+
+auto OutputView::visible_lines() const -> int {
+  return std::max(1, (m_area.get_height() - MARGIN) / m_line_height);
+}
+
+auto OutputView::visible_columns() const -> int {
+  return std::max(1, (m_area.get_width() - MARGIN) / m_char_width + 1);
+}
+
+void OutputView::update_adjustment() {
+  // The adjustment counts lines in global numbering
+  double lower = m_scrollback.first_line();
+  double upper = m_scrollback.end_line();
+  double page = visible_lines();
+  double value = m_follow ? std::max(lower, upper - page)
+                          : std::clamp(m_adjustment->get_value(), lower,
+                                       std::max(lower, upper - page));
+  m_adjustment->configure(value, lower, upper, 1, page, page);
+  update_hadjustment();
+}
+
+void OutputView::update_hadjustment() {
+  // Wide enough for the longest line in view
+  auto first = static_cast<uint64_t>(m_adjustment->get_value());
+  auto last = std::min<uint64_t>(first + visible_lines() + 1,
+                                 m_scrollback.end_line());
+  uint64_t longest = 0;
+  for (auto n = std::max(first, m_scrollback.first_line()); n < last; ++n) {
+    longest = std::max<uint64_t>(longest, m_scrollback.line(n).length);
+  }
+  double page = visible_columns();
+  double upper = std::max(static_cast<double>(longest) + 1, page);
+  double value = std::clamp(m_hadjustment->get_value(), 0.0, upper - page);
+  m_hadjustment->configure(value, 0, upper, HORIZONTAL_STEP, page, page);
+}
+
+void OutputView::on_resize(int, int) { update_adjustment(); }
+
+auto OutputView::line_at(double y) const -> uint64_t {
+  auto row = std::max(0.0, std::floor((y - MARGIN) / m_line_height));
+  return static_cast<uint64_t>(m_adjustment->get_value() + row);
+}
+
+auto OutputView::on_scroll(double dx, double dy) -> bool {
+  m_adjustment->set_value(m_adjustment->get_value() + dy * 3);
+  m_hadjustment->set_value(m_hadjustment->get_value() + dx * HORIZONTAL_STEP);
+  return true;
+}
+
+void OutputView::on_drag_begin(double, double y) {
+  m_area.grab_focus();
+  m_drag_start_y = y;
+  m_selection_anchor = line_at(y);
+  m_selection_end = m_selection_anchor;
+  m_has_selection = true;
+  m_area.queue_draw();
+}
+
+void OutputView::on_drag_update(double, double offset_y) {
+  m_selection_end = line_at(m_drag_start_y + offset_y);
+  m_area.queue_draw();
+}
+
+auto OutputView::on_key_pressed(guint keyval, guint, Gdk::ModifierType state)
+    -> bool {
+  bool control = (state & Gdk::ModifierType::CONTROL_MASK) ==
+                 Gdk::ModifierType::CONTROL_MASK;
+  double page = m_adjustment->get_page_size();
+
+  if (control && (keyval == GDK_KEY_c || keyval == GDK_KEY_C)) {
+    if (auto text = selected_text(); !text.empty()) {
+      get_clipboard()->set_text(text);
+    }
+    return true;
+  }
+  if (keyval == GDK_KEY_Page_Up) {
+    m_adjustment->set_value(m_adjustment->get_value() - page);
+  } else if (keyval == GDK_KEY_Page_Down) {
+    m_adjustment->set_value(m_adjustment->get_value() + page);
+  } else if (keyval == GDK_KEY_Home && control) {
+    m_adjustment->set_value(m_adjustment->get_lower());
+  } else if (keyval == GDK_KEY_End && control) {
+    m_adjustment->set_value(m_adjustment->get_upper() - page);
+  } else if (keyval == GDK_KEY_Left) {
+    m_hadjustment->set_value(m_hadjustment->get_value() - HORIZONTAL_STEP);
+  } else if (keyval == GDK_KEY_Right) {
+    m_hadjustment->set_value(m_hadjustment->get_value() + HORIZONTAL_STEP);
+  } else if (keyval == GDK_KEY_Home) {
+    m_hadjustment->set_value(0);
+  } else if (keyval == GDK_KEY_End) {
+    m_hadjustment->set_value(m_hadjustment->get_upper() -
+                             m_hadjustment->get_page_size());
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void OutputView::on_draw(const Cairo::RefPtr<Cairo::Context> &cr, int width,
+                         int height) {
+  Trace::Span span("draw_output", 0);
+  auto first = static_cast<uint64_t>(m_adjustment->get_value());
+  auto last = std::min<uint64_t>(first + visible_lines() + 1,
+                                 m_scrollback.end_line());
+
+  auto sel_first = std::min(m_selection_anchor, m_selection_end);
+  auto sel_last = std::max(m_selection_anchor, m_selection_end);
+
+  auto column = static_cast<uint64_t>(m_hadjustment->get_value());
+  auto max_bytes = static_cast<uint64_t>(visible_columns()) * MAX_CHAR_BYTES;
+
+  double y = MARGIN;
+  for (auto n = first; n < last && y < height; ++n, y += m_line_height) {
+    if (m_has_selection && n >= sel_first && n <= sel_last) {
+      cr->set_source_rgba(0.3, 0.4, 0.8, 0.35);
+      cr->rectangle(0, y, width, m_line_height);
+      cr->fill();
+    }
+
+    // Only the part of the line in view: a line of megabytes costs what
+    // a short one does
+    auto line = m_scrollback.line(n);
+    uint64_t start = std::min<uint64_t>(column, line.length);
+    uint64_t count = std::min<uint64_t>(line.length - start, max_bytes);
+    std::string text;
+    m_scrollback.read(line.offset + start, count, text);
+
+    // Cut at characters: no continuation byte first, no partial one last
+    size_t front = 0;
+    while (start > 0 && front < text.size() && front + 1 < MAX_CHAR_BYTES &&
+           (static_cast<unsigned char>(text[front]) & 0xC0) == 0x80) {
+      ++front;
+    }
+    text.erase(0, front);
+    start += front;
+    const char *invalid = nullptr;
+    bool valid_text = g_utf8_validate(text.data(), text.size(), &invalid);
+    if (!valid_text && start + text.size() < line.length &&
+        static_cast<size_t>(text.data() + text.size() - invalid) <
+            MAX_CHAR_BYTES) {
+      text.resize(static_cast<size_t>(invalid - text.data()));
+      valid_text = g_utf8_validate(text.data(), text.size(), nullptr);
+    }
+
+    // Binary output: show it with replacement characters, single style and
+    // no search highlights (byte offsets no longer match)
+    auto spans = m_scrollback.line_spans(n);
+    if (!valid_text) {
+      auto *valid = g_utf8_make_valid(text.data(), text.size());
+      text = valid;
+      g_free(valid);
+      spans.resize(std::min<size_t>(spans.size(), 1));
+    }
+
+    // Spans start relative to the line, attributes to the text shown
+    Pango::AttrList attributes;
+    for (size_t i = 0; i < spans.size(); ++i) {
+      uint64_t span_end = i + 1 < spans.size() ? spans[i + 1].start
+                                               : line.length;
+      if (valid_text && span_end <= start) {
+        continue;
+      }
+      if (valid_text && spans[i].start >= start + text.size()) {
+        break;
+      }
+      const auto &style =
+          m_styles.at(std::min<size_t>(spans[i].style, m_styles.size() - 1));
+      add_attributes(attributes, style,
+                     valid_text && spans[i].start > start
+                         ? spans[i].start - start
+                         : 0,
+                     valid_text && i + 1 < spans.size() ? span_end - start
+                                                        : G_MAXUINT);
+    }
+    if (m_search && valid_text) {
+      add_matches(attributes, line.offset + start,
+                  line.offset + start + text.size());
+    }
+
+    m_layout->set_text(text);
+    m_layout->set_attributes(attributes);
+    cr->move_to(MARGIN, y);
+    m_layout->show_in_cairo_context(cr);
+  }
+}
+
+void OutputView::add_matches(Pango::AttrList &attributes, uint64_t begin,
+                             uint64_t end) const {
+  // Inserted after the style attributes, so they win where both apply.
+  // [begin, end) is the shown part of a line, in scrollback offsets.
+  auto current = m_search->current();
+  for (const auto &match : m_search->matches_in(begin, end)) {
+    auto match_start = std::max(match.offset, begin) - begin;
+    auto match_end =
+        std::min<uint64_t>(match.offset + match.length, end) - begin;
+    bool is_current = current && current->offset == match.offset;
+    auto background =
+        is_current ? Pango::Attribute::create_attr_background(0xFFFF, 0x8C00, 0)
+                   : Pango::Attribute::create_attr_background(0x6000, 0x5800,
+                                                              0x1000);
+    background.set_start_index(match_start);
+    background.set_end_index(match_end);
+    attributes.insert(background);
+    if (is_current) {
+      auto foreground = Pango::Attribute::create_attr_foreground(0, 0, 0);
+      foreground.set_start_index(match_start);
+      foreground.set_end_index(match_end);
+      attributes.insert(foreground);
+    }
+  }
+}
+
+void OutputView::add_attributes(Pango::AttrList &attributes, const Style &style,
+                                size_t start, size_t end) const {
+  auto insert = [&](Pango::Attribute attribute) {
+    attribute.set_start_index(start);
+    attribute.set_end_index(end);
+    attributes.insert(attribute);
+  };
+
+  const auto &fg = style.foreground;
+  insert(Pango::Attribute::create_attr_foreground(
+      fg.get_red_u(), fg.get_green_u(), fg.get_blue_u()));
+  if (style.background) {
+    const auto &bg = *style.background;
+    insert(Pango::Attribute::create_attr_background(
+        bg.get_red_u(), bg.get_green_u(), bg.get_blue_u()));
+  }
+  if (style.flags & AnsiParser::BOLD) {
+    insert(Pango::Attribute::create_attr_weight(Pango::Weight::BOLD));
+  }
+  if (style.flags & AnsiParser::DIM) {
+    insert(Pango::Attribute::create_attr_foreground_alpha(0x8000));
+  }
+  if (style.flags & AnsiParser::ITALIC) {
+    insert(Pango::Attribute::create_attr_style(Pango::Style::ITALIC));
+  }
+  if (style.flags & AnsiParser::UNDERLINE) {
+    insert(Pango::Attribute::create_attr_underline(Pango::Underline::SINGLE));
+  }
+  if (style.flags & AnsiParser::STRIKETHROUGH) {
+    insert(Pango::Attribute::create_attr_strikethrough(true));
+  }
+}
@@ -0,0 +1,316 @@
+/*
+ * References:
+ *    https://en.cppreference.com/w/cpp/thread/condition_variable_any/wait
+ */
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// Bounded queue between two stages. Unlike OutputQueue both ends may give
+// up: the consumer closes it when its stage ends early, and a wait for
+// input ends when its stop token is signalled.
+class Link {
+public:
+  struct Chunk {
+    std::string text;
+    bool is_error{false};
+  };
+
+  explicit Link(size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+  // Blocks while full; false once the consumer closed the link
+  auto push(std::string text, bool is_error) -> bool {
+    std::unique_lock lock(m_mutex);
+    // A chunk larger than the budget still goes through an empty link
+    m_changed.wait(lock, [this] {
+      return m_closed || m_chunks.empty() || m_bytes < m_max_bytes;
+    });
+    if (m_closed) {
+      return false;
+    }
+    m_bytes += text.size();
+    m_chunks.push_back({std::move(text), is_error});
+    m_changed.notify_all();
+    return true;
+  }
+
+  // No more chunks from the producer
+  void finish() {
+    std::lock_guard lock(m_mutex);
+    m_finished = true;
+    m_changed.notify_all();
+  }
+
+  // Next chunk; false at the end or when stop is requested
+  auto pop(Chunk &chunk, std::stop_token stop) -> bool {
+    std::unique_lock lock(m_mutex);
+    if (!m_changed.wait(lock, stop,
+                        [this] { return !m_chunks.empty() || m_finished; }) ||
+        m_chunks.empty()) {
+      return false;
+    }
+    chunk = std::move(m_chunks.front());
+    m_chunks.pop_front();
+    m_bytes -= chunk.text.size();
+    m_changed.notify_all();
+    return true;
+  }
+
+  // The consumer is gone: pending and later chunks are dropped
+  void close() {
+    std::lock_guard lock(m_mutex);
+    m_closed = true;
+    m_chunks.clear();
+    m_bytes = 0;
+    m_changed.notify_all();
+  }
+
+  // True when everything the producer sent was taken
+  auto drained() -> bool {
+    std::lock_guard lock(m_mutex);
+    return m_finished && m_chunks.empty();
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable_any m_changed;
+  std::deque<Chunk> m_chunks;
+  size_t m_bytes{0};
+  size_t m_max_bytes;
+  bool m_finished{false};
+  bool m_closed{false};
+};
+
+// Language of a "name:" prefix at position (after blanks); sets end past
+// the colon. DEFAULT when there is none.
+auto stage_prefix(const std::string_view text, size_t position, size_t &end)
+    -> int {
+  static constexpr std::array<std::pair<std::string_view, int>, 3> prefixes{
+      {{"bash:", Interpreter::Languages::BASH},
+       {"python:", Interpreter::Languages::PYTHON},
+       {"lua:", Interpreter::Languages::LUA}}};
+  while (position < text.size() &&
+         std::isspace(static_cast<unsigned char>(text[position]))) {
+    ++position;
+  }
+  for (const auto &[prefix, language] : prefixes) {
+    if (text.substr(position).starts_with(prefix)) {
+      end = position + prefix.size();
+      return language;
+    }
+  }
+  return Interpreter::Languages::DEFAULT;
+}
+
+// Position past the quoted string or Lua long string starting at position
+// in a stage of language, or position itself if none starts there. An
+// unterminated one runs to the end of text.
+auto skip_quoted(const std::string_view text, size_t position, int language)
+    -> size_t {
+  char c = text[position];
+  if (c == '\\') {
+    return std::min(position + 2, text.size());
+  }
+
+  if (c == '\'' || c == '"') {
+    // Bash has no escapes inside single quotes
+    bool escapes = c == '"' || language != Interpreter::Languages::BASH;
+    std::string_view close(&text[position], 1);
+    if (language == Interpreter::Languages::PYTHON &&
+        text.substr(position, 3) == std::string(3, c)) {
+      close = text.substr(position, 3);
+    }
+    for (size_t i = position + close.size(); i < text.size(); ++i) {
+      if (escapes && text[i] == '\\') {
+        ++i;
+      } else if (text.substr(i).starts_with(close)) {
+        return i + close.size();
+      }
+    }
+    return text.size();
+  }
+
+  // Lua [[...]], [=[...]=], ...
+  if (c == '[' && language == Interpreter::Languages::LUA) {
+    size_t level = 0;
+    while (position + 1 + level < text.size() &&
+           text[position + 1 + level] == '=') {
+      ++level;
+    }
+    if (position + 1 + level < text.size() &&
+        text[position + 1 + level] == '[') {
+      std::string close = "]" + std::string(level, '=') + "]";
+      auto end = text.find(close, position + 2 + level);
+      return end == std::string_view::npos ? text.size() : end + close.size();
+    }
+  }
+  return position;
+}
+
+auto trim(std::string_view text) -> std::string {
+  auto blank = [](char c) { return std::isspace(static_cast<unsigned char>(c)); };
+  while (!text.empty() && blank(text.front())) {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() && blank(text.back())) {
+    text.remove_suffix(1);
+  }
+  return std::string(text);
+}
+
+} // namespace
+
+auto Pipeline::parse(const std::string_view text) -> std::vector<Stage> {
+  size_t start = 0;
+  int language = stage_prefix(text, 0, start);
+  if (language == Interpreter::Languages::DEFAULT) {
+    return {};
+  }
+
+  // Quoted "|" belong to the stage, whatever follows them
+  std::vector<Stage> stages;
+  for (size_t i = start; i < text.size(); ++i) {
+    if (size_t skipped = skip_quoted(text, i, language); skipped != i) {
+      i = skipped - 1;
+      continue;
+    }
+    if (text[i] != '|') {
+      continue;
+    }
+    if (i + 1 < text.size() && text[i + 1] == '|') {
+      ++i; // Shell "||"
+      continue;
+    }
+    size_t next_start = 0;
+    int next = stage_prefix(text, i + 1, next_start);
+    if (next == Interpreter::Languages::DEFAULT) {
+      continue;
+    }
+    stages.push_back({language, trim(text.substr(start, i - start))});
+    language = next;
+    start = next_start;
+    i = next_start - 1;
+  }
+  stages.push_back({language, trim(text.substr(start))});
+
+  bool empty = std::any_of(stages.begin(), stages.end(),
+                           [](const Stage &s) { return s.command.empty(); });
+  if (stages.size() < 2 || empty) {
+    return {};
+  }
+  return stages;
+}
+
+auto Pipeline::run(Interpreter &interpreter, const std::vector<Stage> &stages,
+                   const Interpreter::OutputHandler &on_output,
+                   std::stop_token stop) -> bool {
+  Trace::Span span("pipeline");
+  size_t count = stages.size();
+  if (count == 0) {
+    return true;
+  }
+
+  // The session shares one main interpreter and GIL between its Python
+  // stages: one would wait for the other while it waits for its input
+  auto python_stages =
+      std::count_if(stages.begin(), stages.end(), [](const Stage &s) {
+        return s.language == Interpreter::Languages::PYTHON;
+      });
+  if (python_stages > 1 &&
+      Interpreter::python_mode() != Interpreter::PythonMode::SUBINTERPRETERS) {
+    on_output("Pipelines with several Python stages need sub-interpreters "
+              "(Tools > Python Mode)\n",
+              true);
+    return false;
+  }
+
+  // links[i] carries the output of stage i to stage i + 1
+  std::vector<std::unique_ptr<Link>> links;
+  for (size_t i = 0; i + 1 < count; ++i) {
+    links.push_back(std::make_unique<Link>(LINK_MAX_BYTES));
+  }
+  std::vector<std::stop_source> stops(count);
+  std::stop_callback on_stop(stop, [&stops]() {
+    for (auto &source : stops) {
+      source.request_stop();
+    }
+  });
+
+  // A stage writes from its interpreter and forwards the errors of the
+  // stages before it, maybe from another thread (Bash stdin): each output
+  // takes a lock. A full link that was closed stops the stage.
+  std::vector<std::mutex> output_mutexes(count);
+  std::vector<Interpreter::OutputHandler> outputs(count);
+  for (size_t i = 0; i < count; ++i) {
+    outputs[i] = [&, i](std::string_view chunk, bool is_error) {
+      std::lock_guard lock(output_mutexes[i]);
+      if (i + 1 == count) {
+        on_output(chunk, is_error);
+      } else if (!links[i]->push(std::string(chunk), is_error)) {
+        stops[i].request_stop();
+      }
+    };
+  }
+
+  std::vector<Interpreter::InputSource> inputs(count);
+  for (size_t i = 1; i < count; ++i) {
+    inputs[i] = [&, i](std::string &chunk, std::stop_token input_stop) {
+      Link::Chunk next;
+      while (links[i - 1]->pop(next, input_stop)) {
+        if (!next.is_error) {
+          chunk = std::move(next.text);
+          return true;
+        }
+        outputs[i](next.text, true);
+      }
+      return false;
+    };
+  }
+
+  // Stages cut short by a later stage are not failures
+  std::vector<char> ok(count, false);
+  std::vector<std::atomic<bool>> cut(count);
+  auto run_stage = [&](size_t i) {
+    Trace::Span stage_span("pipeline_stage");
+    ok[i] = interpreter.execute_stage(stages[i].command, stages[i].language,
+                                      i > 0 ? &inputs[i] : nullptr, outputs[i],
+                                      stops[i].get_token());
+    if (i > 0 && !links[i - 1]->drained()) {
+      links[i - 1]->close();
+      for (size_t j = 0; j < i; ++j) {
+        cut[j] = true;
+        stops[j].request_stop();
+      }
+    }
+    if (i + 1 < count) {
+      links[i]->finish();
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    for (size_t i = 0; i + 1 < count; ++i) {
+      workers.emplace_back(run_stage, i);
+    }
+    run_stage(count - 1);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (!ok[i] && !(cut[i] && !stop.stop_requested())) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,557 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man3/posix_spawn.3.html
+ *    https://man7.org/linux/man-pages/man2/poll.2.html
+ *    https://man7.org/linux/man-pages/man2/eventfd.2.html
+ *    https://www.gnu.org/software/bash/manual/bash.html#Bourne-Shell-Builtins
+ */
+#include "process.hpp"
+#include "trace.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+extern char **environ;
+
+namespace {
+
+// Owns a file descriptor, closing it when going out of scope
+class FileDescriptor {
+public:
+  FileDescriptor() = default;
+  explicit FileDescriptor(int fd) : m_fd(fd) {}
+  ~FileDescriptor() { reset(); }
+
+  FileDescriptor(const FileDescriptor &) = delete;
+  auto operator=(const FileDescriptor &) -> FileDescriptor & = delete;
+  FileDescriptor(FileDescriptor &&other) noexcept : m_fd(other.release()) {}
+  auto operator=(FileDescriptor &&other) noexcept -> FileDescriptor & {
+    reset(other.release());
+    return *this;
+  }
+
+  auto get() const -> int { return m_fd; }
+  auto release() -> int { return std::exchange(m_fd, -1); }
+  void reset(int fd = -1) {
+    if (m_fd >= 0) {
+      close(m_fd);
+    }
+    m_fd = fd;
+  }
+
+private:
+  int m_fd{-1};
+};
+
+struct Pipe {
+  FileDescriptor read;
+  FileDescriptor write;
+};
+
+auto make_pipe() -> Pipe {
+  // Both ends close on exec; the child gets its copies through dup2.
+  std::array<int, 2> fds;
+  if (pipe2(fds.data(), O_CLOEXEC) != 0) {
+    throw std::runtime_error(std::string("pipe: ") + std::strerror(errno));
+  }
+  Pipe p;
+  p.read.reset(fds[0]);
+  p.write.reset(fds[1]);
+  fcntl(p.read.get(), F_SETFL, fcntl(p.read.get(), F_GETFL) | O_NONBLOCK);
+  return p;
+}
+
+// Stdin of the session shell: a socket, so that writing to a shell that
+// has exited fails with EPIPE instead of raising SIGPIPE. read is the
+// child end.
+auto make_socket_pipe() -> Pipe {
+  std::array<int, 2> fds;
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data()) != 0) {
+    throw std::runtime_error(std::string("socketpair: ") +
+                             std::strerror(errno));
+  }
+  Pipe p;
+  p.write.reset(fds[0]);
+  p.read.reset(fds[1]);
+  return p;
+}
+
+auto send_all(int fd, std::string_view data) -> bool {
+  while (!data.empty()) {
+    ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+auto exit_status(int status) -> int {
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return status;
+}
+
+auto wait_child(pid_t pid) -> int {
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  return exit_status(status);
+}
+
+// Passes a stream through up to the sentinel line "\n<head><rest>\n"
+class SentinelFilter {
+public:
+  explicit SentinelFilter(std::string head) : m_head("\n" + std::move(head)) {}
+
+  // True once the sentinel was read; its rest is then in line().
+  auto feed(std::string_view chunk, bool is_error,
+            const Process::ChunkHandler &on_chunk) -> bool {
+    if (m_done) {
+      return true;
+    }
+    m_buffer += chunk;
+    auto pos = m_buffer.find(m_head);
+    if (pos == std::string::npos) {
+      // Hold back only a tail that may begin the sentinel
+      size_t keep = m_buffer.rfind('\n');
+      if (keep == std::string::npos ||
+          !m_head.starts_with(std::string_view(m_buffer).substr(keep))) {
+        keep = m_buffer.size();
+      }
+      emit(keep, is_error, on_chunk);
+      return false;
+    }
+    emit(pos, is_error, on_chunk);
+    auto end = m_buffer.find('\n', m_head.size());
+    if (end == std::string::npos) {
+      return false;
+    }
+    m_line = m_buffer.substr(m_head.size(), end - m_head.size());
+    m_buffer.clear();
+    m_done = true;
+    return true;
+  }
+
+  // Output held back when the stream ends without a sentinel
+  void flush(bool is_error, const Process::ChunkHandler &on_chunk) {
+    emit(m_buffer.size(), is_error, on_chunk);
+  }
+
+  auto done() const -> bool { return m_done; }
+  auto line() const -> const std::string & { return m_line; }
+
+private:
+  void emit(size_t length, bool is_error,
+            const Process::ChunkHandler &on_chunk) {
+    if (length > 0) {
+      on_chunk(std::string_view(m_buffer).substr(0, length), is_error);
+      m_buffer.erase(0, length);
+    }
+  }
+
+  std::string m_head;
+  std::string m_buffer;
+  std::string m_line;
+  bool m_done{false};
+};
+
+struct SpawnActions {
+  posix_spawn_file_actions_t actions;
+  SpawnActions() { posix_spawn_file_actions_init(&actions); }
+  ~SpawnActions() { posix_spawn_file_actions_destroy(&actions); }
+};
+
+struct SpawnAttributes {
+  posix_spawnattr_t attributes;
+  SpawnAttributes() { posix_spawnattr_init(&attributes); }
+  ~SpawnAttributes() { posix_spawnattr_destroy(&attributes); }
+};
+
+} // namespace
+
+auto Process::run(const std::string_view command, const ChunkHandler &on_chunk,
+                  std::stop_token stop, const InputSource *input) -> int {
+  if (stop.stop_requested()) {
+    return 128 + SIGTERM;
+  }
+
+  auto out = make_pipe();
+  auto err = make_pipe();
+
+  // A socket for stdin: writing after the child exited fails with EPIPE
+  Pipe in;
+  if (input) {
+    in = make_socket_pipe();
+  }
+
+  SpawnActions spawn;
+  if (input) {
+    posix_spawn_file_actions_adddup2(&spawn.actions, in.read.get(),
+                                     STDIN_FILENO);
+  } else {
+    posix_spawn_file_actions_addopen(&spawn.actions, STDIN_FILENO,
+                                     "/dev/null", O_RDONLY, 0);
+  }
+  posix_spawn_file_actions_adddup2(&spawn.actions, out.write.get(),
+                                   STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&spawn.actions, err.write.get(),
+                                   STDERR_FILENO);
+
+  // Own process group, so that cancelling reaches every process of the
+  // pipeline and not just the shell
+  SpawnAttributes attributes;
+  posix_spawnattr_setflags(&attributes.attributes, POSIX_SPAWN_SETPGROUP);
+  posix_spawnattr_setpgroup(&attributes.attributes, 0);
+
+  std::string cmd(command);
+  std::array<char *, 4> argv{const_cast<char *>("sh"),
+                             const_cast<char *>("-c"), cmd.data(), nullptr};
+
+  pid_t pid;
+  int rc = 0;
+  {
+    Trace::Span span("spawn");
+    rc = posix_spawn(&pid, "/bin/sh", &spawn.actions, &attributes.attributes,
+                     argv.data(), environ);
+  }
+  if (rc != 0) {
+    throw std::runtime_error(std::string("posix_spawn: ") + std::strerror(rc));
+  }
+
+  // Only the child keeps the write ends, so EOF arrives when it exits.
+  out.write.reset();
+  err.write.reset();
+
+  // stdin is written on a thread of its own, so a child that reads slowly
+  // never holds up its output; it ends with the input, the child or stop
+  std::jthread writer;
+  std::optional<std::stop_callback<std::function<void()>>> stop_writer;
+  if (input) {
+    in.read.reset();
+    writer = std::jthread([input, fd = in.write.release()](
+                              std::stop_token writer_stop) {
+      FileDescriptor stdin_fd(fd);
+      std::string chunk;
+      while ((*input)(chunk, writer_stop) && send_all(stdin_fd.get(), chunk)) {
+      }
+    });
+    stop_writer.emplace(stop, [&writer]() { writer.request_stop(); });
+  }
+
+  // A stop request wakes the poll below through this eventfd
+  FileDescriptor wake;
+  if (stop.stop_possible()) {
+    wake.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  }
+  std::stop_callback on_stop(stop, [fd = wake.get()]() {
+    uint64_t one = 1;
+    if (fd >= 0) {
+      (void)!write(fd, &one, sizeof(one));
+    }
+  });
+
+  auto buffer = std::make_unique<char[]>(READ_BUFFER_SIZE);
+  std::array<pollfd, 3> fds{pollfd{out.read.get(), POLLIN, 0},
+                            pollfd{err.read.get(), POLLIN, 0},
+                            pollfd{wake.get(), POLLIN, 0}};
+  int open_streams = 2;
+
+  // After SIGTERM: SIGKILL once the grace period is over, and after that
+  // stop waiting for pipes held open by processes that left the group
+  int signals_sent = 0;
+  auto deadline = std::chrono::steady_clock::time_point::max();
+  auto terminate = [&](int signal) {
+    kill(-pid, signal);
+    ++signals_sent;
+    deadline = std::chrono::steady_clock::now() + KILL_GRACE;
+  };
+
+  while (open_streams > 0) {
+    int timeout = -1;
+    if (signals_sent > 0) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      timeout = static_cast<int>(std::max<int64_t>(left.count(), 0));
+    }
+
+    int ready = poll(fds.data(), fds.size(), timeout);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (ready == 0) {
+      if (signals_sent > 1) {
+        break;
+      }
+      terminate(SIGKILL);
+      continue;
+    }
+
+    if (fds[2].fd >= 0 && fds[2].revents != 0) {
+      fds[2].fd = -1;
+      terminate(SIGTERM);
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      // Drain everything available; a closed pipe reads 0 bytes.
+      while (true) {
+        ssize_t n = read(fds[i].fd, buffer.get(), READ_BUFFER_SIZE);
+        if (n > 0) {
+          on_chunk(std::string_view(buffer.get(), n), i == 1);
+          continue;
+        }
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+          fds[i].fd = -1; // poll ignores negative descriptors
+          --open_streams;
+        }
+        break;
+      }
+    }
+  }
+
+  if (writer.joinable()) {
+    writer.request_stop();
+    writer.join();
+  }
+  return wait_child(pid);
+}
+
+auto Process::quote(const std::string_view text) -> std::string {
+  std::string quoted = "'";
+  for (char c : text) {
+    quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  }
+  return quoted + "'";
+}
+
+ShellSession::~ShellSession() { close(); }
+
+void ShellSession::start() {
+  Trace::Span span("shell_start");
+  auto in = make_socket_pipe();
+  auto out = make_pipe();
+  auto err = make_pipe();
+
+  SpawnActions spawn;
+  posix_spawn_file_actions_adddup2(&spawn.actions, in.read.get(),
+                                   STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&spawn.actions, out.write.get(),
+                                   STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&spawn.actions, err.write.get(),
+                                   STDERR_FILENO);
+
+  // Own process group: stopping a command kills the session with it
+  SpawnAttributes attributes;
+  posix_spawnattr_setflags(&attributes.attributes, POSIX_SPAWN_SETPGROUP);
+  posix_spawnattr_setpgroup(&attributes.attributes, 0);
+
+  // bash without startup files; any POSIX shell understands the protocol
+  std::array<char *, 4> bash{const_cast<char *>("bash"),
+                             const_cast<char *>("--noprofile"),
+                             const_cast<char *>("--norc"), nullptr};
+  std::array<char *, 2> sh{const_cast<char *>("sh"), nullptr};
+  pid_t pid;
+  int rc = posix_spawnp(&pid, "bash", &spawn.actions, &attributes.attributes,
+                        bash.data(), environ);
+  if (rc != 0) {
+    rc = posix_spawn(&pid, "/bin/sh", &spawn.actions, &attributes.attributes,
+                     sh.data(), environ);
+  }
+  if (rc != 0) {
+    throw std::runtime_error(std::string("posix_spawn: ") + std::strerror(rc));
+  }
+
+  std::random_device random;
+  char marker[64];
+  std::snprintf(marker, sizeof(marker), "__terminal_gtkmm_%08x%08x_",
+                random(), random());
+
+  m_pid = pid;
+  m_stdin = in.write.release();
+  m_stdout = out.read.release();
+  m_stderr = err.read.release();
+  m_marker = marker;
+  m_commands = 0;
+}
+
+auto ShellSession::working_directory() const -> std::string {
+  if (!running()) {
+    return "";
+  }
+  std::error_code error;
+  auto path = std::filesystem::read_symlink(
+      "/proc/" + std::to_string(m_pid) + "/cwd", error);
+  return error ? "" : path.string();
+}
+
+void ShellSession::close() {
+  if (running()) {
+    end();
+  }
+}
+
+auto ShellSession::end() -> int {
+  kill(-m_pid, SIGKILL);
+  ::close(m_stdin);
+  ::close(m_stdout);
+  ::close(m_stderr);
+  int status = wait_child(m_pid);
+  m_pid = -1;
+  m_stdin = m_stdout = m_stderr = -1;
+  return status;
+}
+
+void ShellSession::prepare() {
+  if (!running()) {
+    start();
+  }
+}
+
+auto ShellSession::run(const std::string_view command,
+                       const Process::ChunkHandler &on_chunk,
+                       std::stop_token stop) -> int {
+  if (stop.stop_requested()) {
+    return 128 + SIGTERM;
+  }
+  if (!running()) {
+    start();
+  }
+
+  // eval runs the command in the session shell itself, and a syntax error
+  // in it cannot swallow the sentinels that follow
+  std::string done = m_marker + std::to_string(++m_commands) + "_";
+  std::string script = "eval " + Process::quote(command) + " </dev/null\n" +
+                       "printf '\\n%s %d\\n' '" + done + "' \"$?\"\n" +
+                       "printf '\\n%s\\n' '" + done + "' >&2\n";
+  if (!send_all(m_stdin, script)) {
+    close();
+    throw std::runtime_error("The shell session has ended");
+  }
+
+  std::array<SentinelFilter, 2> filters{SentinelFilter(done + " "),
+                                        SentinelFilter(done)};
+
+  FileDescriptor wake;
+  if (stop.stop_possible()) {
+    wake.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  }
+  std::stop_callback on_stop(stop, [fd = wake.get()]() {
+    uint64_t one = 1;
+    if (fd >= 0) {
+      (void)!write(fd, &one, sizeof(one));
+    }
+  });
+
+  auto buffer = std::make_unique<char[]>(Process::READ_BUFFER_SIZE);
+  std::array<pollfd, 3> fds{pollfd{m_stdout, POLLIN, 0},
+                            pollfd{m_stderr, POLLIN, 0},
+                            pollfd{wake.get(), POLLIN, 0}};
+  bool ended = false; // The shell exited or closed its output
+
+  while (!filters[0].done() || !filters[1].done()) {
+    int ready = poll(fds.data(), fds.size(), -1);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ended = true;
+      break;
+    }
+    if (fds[2].fd >= 0 && fds[2].revents != 0) {
+      // Nothing short of ending the shell stops every command it started;
+      // TERM first so that they can clean up
+      kill(-m_pid, SIGTERM);
+      auto deadline = std::chrono::steady_clock::now() + Process::KILL_GRACE;
+      siginfo_t info{};
+      while (std::chrono::steady_clock::now() < deadline &&
+             waitid(P_PID, m_pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 &&
+             info.si_pid == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+      for (size_t i = 0; i < 2; ++i) {
+        filters[i].flush(i == 1, on_chunk);
+      }
+      end();
+      return 128 + SIGTERM;
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      while (!filters[i].done()) {
+        ssize_t n = read(fds[i].fd, buffer.get(), Process::READ_BUFFER_SIZE);
+        if (n > 0) {
+          filters[i].feed(std::string_view(buffer.get(), n), i == 1,
+                          on_chunk);
+          continue;
+        }
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+          ended = true;
+        }
+        break;
+      }
+      if (filters[i].done()) {
+        fds[i].fd = -1;
+      }
+    }
+    if (ended) {
+      break;
+    }
+  }
+
+  if (ended) {
+    // exit or exec in the command: its status is the shell's
+    for (size_t i = 0; i < 2; ++i) {
+      filters[i].flush(i == 1, on_chunk);
+    }
+    return end();
+  }
+
+  try {
+    return std::stoi(filters[0].line());
+  } catch (const std::exception &) {
+    return 1;
+  }
+}
@@ -0,0 +1,735 @@
+/*
+ * References:
+ *    https://docs.python.org/3/c-api/init.html
+ *    https://docs.python.org/3/c-api/init.html#a-per-interpreter-gil
+ *    https://docs.python.org/3/c-api/marshal.html
+ */
+#include "python_runtime.hpp"
+#include "chunk_cache.hpp"
+#include "output_sink.hpp"
+#include "pipeline.hpp"
+#include "python_writer.hpp"
+#include "trace.hpp"
+
+#include <marshal.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if PY_VERSION_HEX >= 0x030C0000
+#define TERMINAL_PY_SUBINTERPRETERS 1
+#endif
+
+namespace {
+
+std::once_flag s_python_once;
+
+// Created once; sys.stdout and sys.stderr of the main interpreter
+PythonWriter::Writers s_python_writers;
+
+// The writers point at the sink of one command at a time, so commands in
+// the main interpreter are serialized. Always taken before the GIL.
+std::mutex s_python_mutex;
+
+// Holds the GIL of the main interpreter for the current scope (any thread).
+class PyGilGuard {
+public:
+  PyGilGuard() : m_state(PyGILState_Ensure()) {}
+  ~PyGilGuard() { PyGILState_Release(m_state); }
+
+  PyGilGuard(const PyGilGuard &) = delete;
+  auto operator=(const PyGilGuard &) -> PyGilGuard & = delete;
+
+private:
+  PyGILState_STATE m_state;
+};
+
+// Raises KeyboardInterrupt in commands whose stop was requested. Stop
+// callbacks only queue the request and the GIL of the target interpreter is
+// taken on this thread, so the caller of request_stop never waits for it.
+class Interrupter {
+public:
+  // Registers the code running on this thread; GIL held.
+  auto add() -> uint64_t {
+    std::lock_guard lock(m_mutex);
+    uint64_t id = m_next_id++;
+    m_targets[id] = {PyInterpreterState_Get(), PyThread_get_thread_ident()};
+    return id;
+  }
+
+  // Unregisters it and drops an interrupt not delivered yet; GIL held.
+  void remove(uint64_t id) {
+    std::lock_guard lock(m_mutex);
+    auto it = m_targets.find(id);
+    if (it != m_targets.end()) {
+      PyThreadState_SetAsyncExc(it->second.thread, nullptr);
+      m_targets.erase(it);
+    }
+  }
+
+  // Any thread, any locks held
+  void request(uint64_t id) {
+    std::lock_guard lock(m_mutex);
+    if (m_stopped) {
+      return;
+    }
+    if (!m_thread.joinable()) {
+      m_thread = std::jthread([this](std::stop_token stop) { run(stop); });
+    }
+    m_requests.push_back(id);
+    m_wake.notify_one();
+  }
+
+  // Called before the interpreters are torn down
+  void stop() {
+    {
+      std::lock_guard lock(m_mutex);
+      m_stopped = true;
+    }
+    if (m_thread.joinable()) {
+      m_thread.request_stop();
+      m_thread.join();
+    }
+  }
+
+private:
+  struct Target {
+    PyInterpreterState *interp;
+    unsigned long thread;
+  };
+
+  void run(std::stop_token stop) {
+    std::unique_lock lock(m_mutex);
+    while (m_wake.wait(lock, stop, [this] { return !m_requests.empty(); })) {
+      uint64_t id = m_requests.back();
+      m_requests.pop_back();
+      auto it = m_targets.find(id);
+      if (it == m_targets.end()) {
+        continue;
+      }
+      Target target = it->second;
+      lock.unlock();
+      interrupt(id, target);
+      lock.lock();
+    }
+  }
+
+  void interrupt(uint64_t id, const Target &target) {
+    bool main = target.interp == PyInterpreterState_Main();
+    PyGILState_STATE gil{};
+    PyThreadState *state = nullptr;
+    if (main) {
+      gil = PyGILState_Ensure();
+    } else {
+      state = PyThreadState_New(target.interp);
+      PyEval_RestoreThread(state);
+    }
+
+    // remove() needs this GIL, so the command cannot finish meanwhile
+    {
+      std::lock_guard lock(m_mutex);
+      if (m_targets.contains(id)) {
+        PyThreadState_SetAsyncExc(target.thread, PyExc_KeyboardInterrupt);
+      }
+    }
+
+    if (main) {
+      PyGILState_Release(gil);
+    } else {
+      PyThreadState_Clear(state);
+      PyThreadState_DeleteCurrent();
+    }
+  }
+
+  std::mutex m_mutex;
+  std::condition_variable_any m_wake;
+  std::unordered_map<uint64_t, Target> m_targets;
+  std::vector<uint64_t> m_requests;
+  uint64_t m_next_id{1};
+  bool m_stopped{false};
+  std::jthread m_thread;
+};
+
+Interrupter s_interrupter;
+
+// Custom deleter for PyObject*
+// Called automatically when the Smart Pointer goes out of scope
+struct PyObjectDeleter {
+  void operator()(PyObject *obj) {
+    if (obj) {
+      Py_DECREF(obj);
+    }
+  }
+};
+
+// Custom Smart Pointer Type
+using PyObjectPtr = std::unique_ptr<PyObject, PyObjectDeleter>;
+
+// Clears a pending SystemExit; true if its code means success.
+// PyErr_Print would exit the whole application instead.
+auto handle_system_exit(OutputSink &sink) -> bool {
+  PyObject *type = nullptr, *value = nullptr, *traceback = nullptr;
+  PyErr_Fetch(&type, &value, &traceback);
+  PyErr_NormalizeException(&type, &value, &traceback);
+  PyObjectPtr type_ptr(type), value_ptr(value), traceback_ptr(traceback);
+
+  PyObjectPtr code(value ? PyObject_GetAttrString(value, "code") : nullptr);
+  PyErr_Clear();
+  if (!code || code.get() == Py_None) {
+    return true;
+  }
+  if (PyLong_Check(code.get())) {
+    return PyLong_AsLong(code.get()) == 0;
+  }
+  // sys.exit("message") prints the message and fails
+  PyObjectPtr text(PyObject_Str(code.get()));
+  if (const char *message = text ? PyUnicode_AsUTF8(text.get()) : nullptr) {
+    sink.write(std::string(message) + "\n", true);
+  }
+  PyErr_Clear();
+  return false;
+}
+
+// Adds the strings of an iterable that start with prefix. Private names
+// only when the prefix asks for them.
+void add_names(PyObject *iterable, const std::string_view prefix,
+               std::vector<std::string> &names) {
+  PyObjectPtr iterator(PyObject_GetIter(iterable));
+  if (!iterator) {
+    PyErr_Clear();
+    return;
+  }
+  while (PyObjectPtr item{PyIter_Next(iterator.get())}) {
+    Py_ssize_t size = 0;
+    const char *text = PyUnicode_Check(item.get())
+                           ? PyUnicode_AsUTF8AndSize(item.get(), &size)
+                           : nullptr;
+    if (!text) {
+      PyErr_Clear();
+      continue;
+    }
+    std::string_view name(text, size);
+    if (name.starts_with(prefix) &&
+        (!name.starts_with('_') || prefix.starts_with('_'))) {
+      names.emplace_back(name);
+    }
+  }
+  PyErr_Clear();
+}
+
+// Names for completion in the given namespace of the current interpreter
+auto collect_names(PyObject *globals, const std::string_view path,
+                   const std::string_view prefix) -> std::vector<std::string> {
+  std::vector<std::string> names;
+  PyObject *builtins = PyEval_GetBuiltins();
+  if (path.empty()) {
+    add_names(globals, prefix, names);
+    add_names(builtins, prefix, names);
+  } else {
+    // Attribute lookups only: nothing is called besides properties
+    PyObjectPtr object;
+    for (size_t start = 0; start <= path.size();) {
+      size_t end = std::min(path.find('.', start), path.size());
+      std::string part(path.substr(start, end - start));
+      if (!object) {
+        PyObject *found = PyDict_GetItemString(globals, part.c_str());
+        if (!found) {
+          found = PyDict_GetItemString(builtins, part.c_str());
+        }
+        Py_XINCREF(found);
+        object.reset(found);
+      } else {
+        object.reset(PyObject_GetAttrString(object.get(), part.c_str()));
+      }
+      if (!object) {
+        PyErr_Clear();
+        return names;
+      }
+      start = end + 1;
+    }
+    PyObjectPtr attributes(PyObject_Dir(object.get()));
+    if (attributes) {
+      add_names(attributes.get(), prefix, names);
+    }
+    PyErr_Clear();
+  }
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  return names;
+}
+
+// Code object of a command, or null with the compile error set. Large
+// commands are compiled once: marshalled code objects do not belong to an
+// interpreter, so one chunk serves the main and every sub-interpreter.
+auto compile_code(const std::string_view command, const std::string &name)
+    -> PyObjectPtr {
+  // Py_CompileString needs a terminated string: copied only to compile
+  if (!ChunkCache::worth_caching(command)) {
+    std::string code(command);
+    return PyObjectPtr(
+        Py_CompileString(code.c_str(), name.c_str(), Py_file_input));
+  }
+
+  auto &cache = Interpreter::chunk_cache();
+  auto key = ChunkCache::key("python " PY_VERSION, name, command);
+  if (auto chunk = cache.find(key)) {
+    Trace::Span span("python_load_code");
+    PyObjectPtr object(PyMarshal_ReadObjectFromString(
+        chunk->data(), static_cast<Py_ssize_t>(chunk->size())));
+    if (object && PyCode_Check(object.get())) {
+      return object;
+    }
+    PyErr_Clear(); // Unreadable by this build: compiled again below
+  }
+
+  Trace::Span span("python_compile");
+  std::string code(command);
+  PyObjectPtr object(
+      Py_CompileString(code.c_str(), name.c_str(), Py_file_input));
+  if (object) {
+    PyObjectPtr bytes(
+        PyMarshal_WriteObjectToString(object.get(), Py_MARSHAL_VERSION));
+    char *data = nullptr;
+    Py_ssize_t size = 0;
+    if (bytes && PyBytes_AsStringAndSize(bytes.get(), &data, &size) == 0) {
+      cache.store(key, std::string(data, static_cast<size_t>(size)));
+    }
+    PyErr_Clear();
+  }
+  return object;
+}
+
+// Writes str(value) as an output line; None writes nothing
+auto emit_value(PyObject *value, OutputSink &sink) -> bool {
+  if (value == Py_None) {
+    return true;
+  }
+  PyObjectPtr text(PyObject_Str(value));
+  Py_ssize_t size = 0;
+  const char *utf8 = text ? PyUnicode_AsUTF8AndSize(text.get(), &size) : nullptr;
+  if (!utf8) {
+    return false;
+  }
+  sink.write(std::string_view(utf8, static_cast<size_t>(size)));
+  sink.write("\n");
+  return true;
+}
+
+// Pipeline stage: the command runs once per input line, with the line in
+// the global `line`. An expression has its value written; a callable value
+// is called with the line, and with None once the input ends. Returns None,
+// or null with the exception set.
+auto run_lines(PyObject *globals, const std::string_view command,
+               const std::string &name,
+               const Interpreter::InputSource &input, OutputSink &sink,
+               std::stop_token stop) -> PyObjectPtr {
+  std::string source(command);
+  PyObjectPtr code(
+      Py_CompileString(source.c_str(), name.c_str(), Py_eval_input));
+  if (!code) {
+    PyErr_Clear(); // Statements
+    code.reset(Py_CompileString(source.c_str(), name.c_str(), Py_file_input));
+  }
+  if (!code) {
+    return nullptr;
+  }
+
+  // Other threads may run Python while this one waits for input
+  Interpreter::InputSource unlocked = [&input](std::string &chunk,
+                                               std::stop_token input_stop) {
+    bool more = false;
+    Py_BEGIN_ALLOW_THREADS
+    more = input(chunk, input_stop);
+    Py_END_ALLOW_THREADS
+    return more;
+  };
+
+  PyObjectPtr function; // Last callable value
+  bool ok = Pipeline::for_each_line(unlocked, stop, [&](std::string_view line) {
+    PyObjectPtr text(PyUnicode_DecodeUTF8(
+        line.data(), static_cast<Py_ssize_t>(line.size()), "surrogateescape"));
+    if (!text || PyDict_SetItemString(globals, "line", text.get()) < 0) {
+      return false;
+    }
+    PyObjectPtr result(PyEval_EvalCode(code.get(), globals, globals));
+    if (result && PyCallable_Check(result.get())) {
+      function = std::move(result);
+      result.reset(PyObject_CallOneArg(function.get(), text.get()));
+    }
+    return result && emit_value(result.get(), sink);
+  });
+  if (ok && function) {
+    PyObjectPtr result(PyObject_CallOneArg(function.get(), Py_None));
+    ok = result && emit_value(result.get(), sink);
+  }
+  return ok ? PyObjectPtr(Py_NewRef(Py_None)) : nullptr;
+}
+
+// Runs code in the given namespace of the current interpreter
+auto run_code(PyObject *globals, const PythonWriter::Writers &writers,
+              const std::string_view command, const std::string &name,
+              const Interpreter::OutputHandler &on_output,
+              std::stop_token stop,
+              const Interpreter::InputSource *input = nullptr) -> bool {
+  if (!writers.out) {
+    on_output("Error: Failed to create Python output writers.\n", true);
+    return false;
+  }
+
+  // print() and tracebacks write straight into the sink
+  OutputSink sink(on_output);
+  PythonWriter::set_sink(writers, &sink);
+  PythonWriter::install(writers);
+
+  // The interrupt is raised at the next bytecode boundary; a blocking call
+  // such as time.sleep sees it only once it returns.
+  uint64_t id = s_interrupter.add();
+  PyObjectPtr py_result;
+  {
+    std::stop_callback on_stop(stop, [id] { s_interrupter.request(id); });
+
+    // Compiled here too, so a stop during a long compilation is seen
+    if (input) {
+      py_result = run_lines(globals, command, name, *input, sink, stop);
+    } else if (auto code = compile_code(command, name)) {
+      py_result.reset(PyEval_EvalCode(code.get(), globals, globals));
+    }
+  }
+  s_interrupter.remove(id);
+
+  bool ok = py_result != nullptr;
+  if (!py_result) {
+    if (stop.stop_requested() &&
+        PyErr_ExceptionMatches(PyExc_KeyboardInterrupt)) {
+      PyErr_Clear();
+    } else if (PyErr_ExceptionMatches(PyExc_SystemExit)) {
+      ok = handle_system_exit(sink);
+    } else {
+      PyErr_Print();
+    }
+  }
+
+  sink.flush();
+  PythonWriter::set_sink(writers, nullptr);
+  return ok;
+}
+
+// Fresh globals for a session in the current interpreter, as in __main__
+auto new_namespace() -> PyObject * {
+  PyObject *globals = PyDict_New();
+  PyObjectPtr name(PyUnicode_FromString("__main__"));
+  PyDict_SetItemString(globals, "__name__", name.get());
+  PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins());
+  return globals;
+}
+
+#ifdef TERMINAL_PY_SUBINTERPRETERS
+
+struct SubInterpreter {
+  PyInterpreterState *interp{nullptr};
+  PyThreadState *owner{nullptr}; // Thread state made at creation
+  PyObject *globals{nullptr};  // __main__ dictionary
+  PyObject *pristine{nullptr}; // Copy of globals right after creation
+  PythonWriter::Writers writers;
+};
+
+using SubInterpreterPtr = std::unique_ptr<SubInterpreter>;
+
+// Pre-created sub-interpreters for parallel commands
+std::vector<SubInterpreterPtr> s_pool;
+std::mutex s_pool_mutex;
+
+auto create_subinterpreter() -> SubInterpreterPtr {
+  Trace::Span span("python_subinterpreter_create");
+  PyGilGuard gil;
+  PyThreadState *main_state = PyThreadState_Get();
+
+  PyInterpreterConfig config = {
+      .use_main_obmalloc = 0,
+      .allow_fork = 0,
+      .allow_exec = 0,
+      .allow_threads = 1,
+      .allow_daemon_threads = 0,
+      .check_multi_interp_extensions = 1,
+      .gil = PyInterpreterConfig_OWN_GIL,
+  };
+
+  // On success the new interpreter becomes current, holding its own GIL
+  PyThreadState *sub_state = nullptr;
+  PyStatus status = Py_NewInterpreterFromConfig(&sub_state, &config);
+  if (PyStatus_Exception(status)) {
+    return nullptr;
+  }
+
+  auto sub = std::make_unique<SubInterpreter>();
+  sub->interp = PyThreadState_GetInterpreter(sub_state);
+  sub->owner = sub_state;
+  sub->writers = PythonWriter::create();
+  sub->globals =
+      Py_NewRef(PyModule_GetDict(PyImport_AddModule("__main__")));
+  sub->pristine = PyDict_Copy(sub->globals);
+
+  // Commands attach with a thread state of their own. The initial one is
+  // kept until Py_EndInterpreter: some 3.12 releases cannot recreate it.
+  PyThreadState_Swap(main_state);
+
+  return sub;
+}
+
+void destroy_subinterpreter(SubInterpreterPtr sub) {
+  if (!sub) {
+    return;
+  }
+  PyGilGuard gil;
+  PyThreadState *main_state = PyThreadState_Swap(sub->owner);
+
+  Py_XDECREF(sub->pristine);
+  Py_XDECREF(sub->globals);
+  Py_XDECREF(sub->writers.out);
+  Py_XDECREF(sub->writers.err);
+  Py_EndInterpreter(sub->owner);
+
+  PyThreadState_Swap(main_state);
+}
+
+auto run_subinterpreter(SubInterpreter &sub, const std::string_view command,
+                        const std::string &name,
+                        const Interpreter::OutputHandler &on_output,
+                        bool reset, std::stop_token stop,
+                        const Interpreter::InputSource *input) -> bool {
+  // Attach this worker to the sub-interpreter, taking its own GIL
+  PyThreadState *state = PyThreadState_New(sub.interp);
+  PyEval_RestoreThread(state);
+
+  if (reset) {
+    PyDict_Clear(sub.globals);
+    PyDict_Update(sub.globals, sub.pristine);
+  }
+  bool ok = run_code(sub.globals, sub.writers, command, name, on_output, stop,
+                     input);
+
+  PyThreadState_Clear(state);
+  PyThreadState_DeleteCurrent();
+  return ok;
+}
+
+auto acquire_subinterpreter() -> SubInterpreterPtr {
+  {
+    std::lock_guard lock(s_pool_mutex);
+    if (!s_pool.empty()) {
+      auto sub = std::move(s_pool.back());
+      s_pool.pop_back();
+      return sub;
+    }
+  }
+  return create_subinterpreter();
+}
+
+void release_subinterpreter(SubInterpreterPtr sub) {
+  std::lock_guard lock(s_pool_mutex);
+  s_pool.push_back(std::move(sub));
+}
+
+#endif // TERMINAL_PY_SUBINTERPRETERS
+
+} // namespace
+
+void PythonRuntime::initialize() {
+  std::call_once(s_python_once, [] {
+    Trace::Span span("python_initialize");
+    // Signal handlers belong to the GTK application, not to Python.
+    Py_InitializeEx(0);
+    s_python_writers = PythonWriter::create();
+    // Release the GIL taken by the initializing thread so that any worker
+    // can acquire it later through PyGILState_Ensure.
+    PyEval_SaveThread();
+  });
+}
+
+void PythonRuntime::shutdown() {
+  std::lock_guard lock(s_python_mutex);
+  if (!Py_IsInitialized()) {
+    return;
+  }
+  s_interrupter.stop();
+
+#ifdef TERMINAL_PY_SUBINTERPRETERS
+  {
+    std::lock_guard pool(s_pool_mutex);
+    for (auto &sub : s_pool) {
+      destroy_subinterpreter(std::move(sub));
+    }
+    s_pool.clear();
+  }
+#endif
+
+  // Release the Python Interpreter before exiting.
+  PyGILState_Ensure();
+  Py_FinalizeEx();
+}
+
+auto PythonRuntime::subinterpreters_supported() -> bool {
+#ifdef TERMINAL_PY_SUBINTERPRETERS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void PythonRuntime::prefill(size_t count) {
+#ifdef TERMINAL_PY_SUBINTERPRETERS
+  initialize();
+  while (true) {
+    {
+      std::lock_guard lock(s_pool_mutex);
+      if (s_pool.size() >= count) {
+        return;
+      }
+    }
+    auto sub = create_subinterpreter();
+    if (!sub) {
+      return;
+    }
+    release_subinterpreter(std::move(sub));
+  }
+#else
+  (void)count;
+#endif
+}
+
+auto PythonRuntime::import_modules(const std::vector<std::string> &modules,
+                                   std::stop_token stop) -> size_t {
+  Trace::Span span("python_import_modules");
+  size_t imported = 0;
+  for (const auto &name : modules) {
+    if (stop.stop_requested()) {
+      break;
+    }
+    // One module at a time: a command submitted meanwhile waits for one
+    // import at most
+    std::lock_guard lock(s_python_mutex);
+    PyGilGuard gil;
+    PyObjectPtr module(PyImport_ImportModule(name.c_str()));
+    if (module) {
+      ++imported;
+    } else {
+      PyErr_Clear(); // Not installed: the command importing it will say so
+    }
+  }
+  return imported;
+}
+
+struct PythonSession::State {
+  PyObject *globals{nullptr}; // Made on the first command in the main one
+#ifdef TERMINAL_PY_SUBINTERPRETERS
+  // Used by one command at a time; parallel commands borrow a clean one
+  // from the pool
+  SubInterpreterPtr sub;
+  std::mutex sub_mutex;
+#endif
+};
+
+PythonSession::PythonSession() : m_state(std::make_unique<State>()) {}
+
+PythonSession::~PythonSession() {
+  std::lock_guard lock(s_python_mutex);
+  if (!Py_IsInitialized()) {
+    return;
+  }
+#ifdef TERMINAL_PY_SUBINTERPRETERS
+  // Whoever borrows it next starts from a reset namespace
+  if (m_state->sub) {
+    release_subinterpreter(std::move(m_state->sub));
+  }
+#endif
+  if (m_state->globals) {
+    PyGilGuard gil;
+    Py_DECREF(m_state->globals);
+  }
+}
+
+auto PythonSession::names(const std::string_view path,
+                          const std::string_view prefix, bool isolated)
+    -> std::vector<std::string> {
+  if (!Py_IsInitialized()) {
+    return {};
+  }
+
+#ifdef TERMINAL_PY_SUBINTERPRETERS
+  if (isolated) {
+    std::unique_lock session(m_state->sub_mutex, std::try_to_lock);
+    if (!session.owns_lock() || !m_state->sub) {
+      return {};
+    }
+    PyThreadState *state = PyThreadState_New(m_state->sub->interp);
+    PyEval_RestoreThread(state);
+    auto names = collect_names(m_state->sub->globals, path, prefix);
+    PyThreadState_Clear(state);
+    PyThreadState_DeleteCurrent();
+    return names;
+  }
+#else
+  (void)isolated;
+#endif
+
+  std::unique_lock lock(s_python_mutex, std::try_to_lock);
+  if (!lock.owns_lock() || !m_state->globals) {
+    return {};
+  }
+  PyGilGuard gil;
+  return collect_names(m_state->globals, path, prefix);
+}
+
+auto PythonSession::run(const std::string_view command,
+                        const Interpreter::OutputHandler &on_output,
+                        bool isolated, std::stop_token stop,
+                        const std::string_view name,
+                        const Interpreter::InputSource *input) -> bool {
+  // Initializes the Python interpreter (if not already initialized)
+  PythonRuntime::initialize();
+  std::string file_name(name);
+
+#ifdef TERMINAL_PY_SUBINTERPRETERS
+  if (isolated) {
+    // The session sub-interpreter keeps its namespace between commands;
+    // parallel commands borrow a clean one from the pool.
+    std::unique_lock session(m_state->sub_mutex, std::try_to_lock);
+    if (session.owns_lock()) {
+      bool reset = !m_state->sub; // May come from another session
+      if (!m_state->sub) {
+        m_state->sub = acquire_subinterpreter();
+      }
+      if (m_state->sub) {
+        return run_subinterpreter(*m_state->sub, command, file_name,
+                                  on_output, reset, stop, input);
+      }
+    } else if (auto sub = acquire_subinterpreter()) {
+      bool ok = run_subinterpreter(*sub, command, file_name, on_output, true,
+                                   stop, input);
+      release_subinterpreter(std::move(sub));
+      return ok;
+    }
+    on_output("Sub-interpreter unavailable, using the main interpreter.\n",
+              true);
+  }
+#else
+  (void)isolated; // Older runtimes: always the main interpreter
+#endif
+
+  // Sessions share the main interpreter and its GIL, each with its own
+  // globals
+  std::lock_guard lock(s_python_mutex);
+  PyGilGuard gil;
+  if (!m_state->globals) {
+    m_state->globals = new_namespace();
+  }
+  return run_code(m_state->globals, s_python_writers, command, file_name,
+                  on_output, stop, input);
+}
@@ -0,0 +1,115 @@
+/*
+ * References:
+ *    https://docs.python.org/3/c-api/type.html#c.PyType_FromSpec
+ */
+#include "python_writer.hpp"
+#include "output_sink.hpp"
+
+#include <exception>
+#include <string_view>
+
+namespace {
+
+struct WriterObject {
+  PyObject_HEAD
+  OutputSink *sink;
+  int is_error;
+};
+
+auto writer_write(PyObject *self, PyObject *arg) -> PyObject * {
+  Py_ssize_t size = 0;
+  // UTF-8 view owned by the string object; no intermediate copy
+  const char *data = PyUnicode_AsUTF8AndSize(arg, &size);
+  if (!data) {
+    return nullptr;
+  }
+  auto *writer = reinterpret_cast<WriterObject *>(self);
+  // Output handlers may throw; exceptions must not unwind through CPython
+  try {
+    if (writer->sink) {
+      writer->sink->write(std::string_view(data, size), writer->is_error);
+    }
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return nullptr;
+  }
+  return PyLong_FromSsize_t(PyUnicode_GetLength(arg));
+}
+
+auto writer_flush(PyObject *self, PyObject *) -> PyObject * {
+  auto *writer = reinterpret_cast<WriterObject *>(self);
+  try {
+    if (writer->sink) {
+      writer->sink->flush();
+    }
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return nullptr;
+  }
+  Py_RETURN_NONE;
+}
+
+auto writer_false(PyObject *, PyObject *) -> PyObject * { Py_RETURN_FALSE; }
+
+auto writer_true(PyObject *, PyObject *) -> PyObject * { Py_RETURN_TRUE; }
+
+auto writer_encoding(PyObject *, void *) -> PyObject * {
+  return PyUnicode_FromString("utf-8");
+}
+
+PyMethodDef s_methods[] = {
+    {"write", writer_write, METH_O, nullptr},
+    {"flush", writer_flush, METH_NOARGS, nullptr},
+    {"isatty", writer_false, METH_NOARGS, nullptr},
+    {"writable", writer_true, METH_NOARGS, nullptr},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyGetSetDef s_getset[] = {
+    {"encoding", writer_encoding, nullptr, nullptr, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+PyType_Slot s_slots[] = {{Py_tp_methods, s_methods},
+                         {Py_tp_getset, s_getset},
+                         {0, nullptr}};
+
+PyType_Spec s_spec = {"terminal.Writer", sizeof(WriterObject), 0,
+                      Py_TPFLAGS_DEFAULT, s_slots};
+
+auto new_writer(PyTypeObject *type, int is_error) -> PyObject * {
+  auto *writer = PyObject_New(WriterObject, type);
+  if (writer) {
+    writer->sink = nullptr;
+    writer->is_error = is_error;
+  }
+  return reinterpret_cast<PyObject *>(writer);
+}
+
+} // namespace
+
+auto PythonWriter::create() -> Writers {
+  // Heap type: one per interpreter, as required by isolated sub-interpreters
+  PyObject *type = PyType_FromSpec(&s_spec);
+  if (!type) {
+    return {};
+  }
+  Writers writers{new_writer(reinterpret_cast<PyTypeObject *>(type), 0),
+                  new_writer(reinterpret_cast<PyTypeObject *>(type), 1)};
+  Py_DECREF(type); // Instances keep the type alive
+
+  if (!writers.out || !writers.err) {
+    Py_XDECREF(writers.out);
+    Py_XDECREF(writers.err);
+    return {};
+  }
+  return writers;
+}
+
+void PythonWriter::set_sink(const Writers &writers, OutputSink *sink) {
+  reinterpret_cast<WriterObject *>(writers.out)->sink = sink;
+  reinterpret_cast<WriterObject *>(writers.err)->sink = sink;
+}
+
+void PythonWriter::install(const Writers &writers) {
+  PySys_SetObject("stdout", writers.out);
+  PySys_SetObject("stderr", writers.err);
+}
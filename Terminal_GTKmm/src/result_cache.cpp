@@ -0,0 +1,160 @@
+/*
+ * References:
+ *    https://man7.org/linux/man-pages/man2/stat.2.html
+ */
+#include "result_cache.hpp"
+#include "sha256.hpp"
+#include "trace.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// Characters around file names in shell, Python and Lua code
+constexpr std::string_view WORD_SEPARATORS = " \t\n;|&()<>'\"`,=[]{}";
+
+// Size and modification time of the existing files named in a command
+auto file_stamps(const std::string_view command,
+                 const std::string_view directory) -> std::string {
+  std::string stamps;
+  size_t checked = 0;
+  for (size_t start = 0; start < command.size() &&
+                         checked < ResultCache::MAX_NAMED_FILES;) {
+    start = command.find_first_not_of(WORD_SEPARATORS, start);
+    if (start == std::string_view::npos) {
+      break;
+    }
+    size_t end = std::min(command.find_first_of(WORD_SEPARATORS, start),
+                          command.size());
+    auto word = command.substr(start, end - start);
+    start = end;
+    // Names look like paths or have an extension
+    if (word.find_first_of("/.") == std::string_view::npos) {
+      continue;
+    }
+    ++checked;
+    std::string path(word);
+    if (!word.starts_with('/') && !directory.empty()) {
+      path = std::string(directory) + "/" + path;
+    }
+    struct stat info{};
+    if (stat(path.c_str(), &info) != 0) {
+      continue;
+    }
+    char stamp[96];
+    std::snprintf(stamp, sizeof(stamp), "%lld.%09ld:%lld:%llu\n",
+                  static_cast<long long>(info.st_mtim.tv_sec),
+                  info.st_mtim.tv_nsec, static_cast<long long>(info.st_size),
+                  static_cast<unsigned long long>(info.st_ino));
+    stamps += path;
+    stamps += '\0';
+    stamps += stamp;
+  }
+  return stamps;
+}
+
+// Bytes an entry accounts for, key included
+auto entry_bytes(const std::string &key, const ResultCache::Result &result)
+    -> size_t {
+  return key.size() + result.bytes +
+         result.chunks.size() * sizeof(ResultCache::Chunk);
+}
+
+} // namespace
+
+ResultCache::ResultCache(size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+void ResultCache::set_enabled(bool enabled) {
+  m_enabled = enabled;
+  if (!enabled) {
+    clear(); // Stale by the time it is turned on again
+  }
+}
+
+void ResultCache::set_max_bytes(size_t max_bytes) {
+  std::lock_guard lock(m_mutex);
+  m_max_bytes = max_bytes;
+  evict(m_max_bytes);
+}
+
+auto ResultCache::max_result_bytes() const -> size_t {
+  std::lock_guard lock(m_mutex);
+  return m_max_bytes / MAX_RESULT_SHARE;
+}
+
+auto ResultCache::key(int language, const std::string_view command,
+                      const std::string_view directory) -> std::string {
+  Trace::Span span("cache_key");
+  std::string key = std::to_string(language);
+  key += '\0';
+  key += directory;
+  key += '\0';
+  key += Sha256::hex(command); // Not a copy of a large script
+  key += '\0';
+  key += file_stamps(command, directory);
+  return key;
+}
+
+auto ResultCache::find(const std::string &key)
+    -> std::shared_ptr<const Result> {
+  if (!m_enabled) {
+    return nullptr;
+  }
+  std::lock_guard lock(m_mutex);
+  auto it = m_index.find(key);
+  if (it == m_index.end()) {
+    return nullptr;
+  }
+  m_entries.splice(m_entries.begin(), m_entries, it->second);
+  return it->second->second;
+}
+
+void ResultCache::store(std::string key, Result result) {
+  size_t bytes = entry_bytes(key, result);
+  std::lock_guard lock(m_mutex);
+  if (!m_enabled || bytes > m_max_bytes / MAX_RESULT_SHARE) {
+    return;
+  }
+  if (auto it = m_index.find(key); it != m_index.end()) {
+    auto entry = it->second;
+    m_bytes -= entry_bytes(entry->first, *entry->second);
+    m_index.erase(it);
+    m_entries.erase(entry);
+  }
+  evict(m_max_bytes - bytes);
+
+  // The index points into the key kept by the list node
+  m_entries.emplace_front(std::move(key),
+                          std::make_shared<const Result>(std::move(result)));
+  m_index.emplace(m_entries.front().first, m_entries.begin());
+  m_bytes += bytes;
+}
+
+void ResultCache::clear() {
+  std::lock_guard lock(m_mutex);
+  m_index.clear();
+  m_entries.clear();
+  m_bytes = 0;
+}
+
+auto ResultCache::entries() const -> size_t {
+  std::lock_guard lock(m_mutex);
+  return m_entries.size();
+}
+
+auto ResultCache::bytes() const -> size_t {
+  std::lock_guard lock(m_mutex);
+  return m_bytes;
+}
+
+void ResultCache::evict(size_t max_bytes) {
+  while (m_bytes > max_bytes && !m_entries.empty()) {
+    auto &oldest = m_entries.back();
+    m_bytes -= entry_bytes(oldest.first, *oldest.second);
+    m_index.erase(oldest.first);
+    m_entries.pop_back();
+  }
+}
@@ -0,0 +1,55 @@
+#include "save_task.hpp"
+
+#include <stdexcept>
+
+SaveTask::SaveTask(const std::string &path, const Source &source,
+                   const DoneHandler &on_done)
+    : m_path(path), m_source(source), m_on_done(on_done) {
+  m_dispatcher.connect(sigc::mem_fun(*this, &SaveTask::pump));
+}
+
+void SaveTask::start() {
+  try {
+    m_writer = std::make_unique<FileWriter>(
+        m_path, [this]() { m_dispatcher.emit(); });
+  } catch (const std::runtime_error &e) {
+    finish(e.what());
+    return;
+  }
+  m_running = true;
+  m_source_done = false;
+  pump();
+}
+
+void SaveTask::pump() {
+  if (!m_running) {
+    return;
+  }
+
+  if (m_writer->finished()) {
+    finish(m_writer->error());
+    return;
+  }
+
+  // Refill up to the writer limit; the next notification continues
+  try {
+    std::string chunk;
+    while (!m_source_done && m_writer->can_write()) {
+      if (!m_source(chunk)) {
+        m_source_done = true;
+        m_writer->close();
+      } else {
+        m_writer->write(std::move(chunk));
+        chunk.clear();
+      }
+    }
+  } catch (const std::runtime_error &e) {
+    finish(e.what());
+  }
+}
+
+void SaveTask::finish(const std::string &error) {
+  m_running = false;
+  m_writer.reset(); // Removes the temporary file if not committed
+  m_on_done(error);
+}
@@ -0,0 +1,68 @@
+#include "script_loader.hpp"
+#include "trace.hpp"
+
+#include <glib.h>
+#include <glibmm/main.h>
+
+#include <algorithm>
+#include <cstring>
+
+ScriptLoader::ScriptLoader(MappedFile file,
+                           const Glib::RefPtr<Gtk::TextBuffer> &buffer,
+                           const ProgressHandler &on_progress,
+                           const DoneHandler &on_done)
+    : m_file(std::move(file)), m_buffer(buffer), m_on_progress(on_progress),
+      m_on_done(on_done) {}
+
+ScriptLoader::~ScriptLoader() { m_idle.disconnect(); }
+
+void ScriptLoader::start() {
+  m_buffer->set_text("");
+  m_offset = 0;
+  m_idle = Glib::signal_idle().connect(
+      sigc::mem_fun(*this, &ScriptLoader::on_idle), Glib::PRIORITY_DEFAULT_IDLE);
+}
+
+auto ScriptLoader::on_idle() -> bool {
+  Trace::Span span("load_chunk");
+  auto data = m_file.data();
+  const char *begin = data.data() + m_offset;
+  size_t length = std::min(CHUNK_SIZE, data.size() - m_offset);
+
+  // Cut after the last newline, or at least before a split character
+  if (m_offset + length < data.size()) {
+    if (auto *newline = static_cast<const char *>(memrchr(begin, '\n', length))) {
+      length = newline - begin + 1;
+    } else {
+      size_t cut = length;
+      while (cut > 0 && (static_cast<unsigned char>(begin[cut]) & 0xC0) == 0x80) {
+        --cut;
+      }
+      // Only continuation bytes: left whole for validation to reject
+      length = cut > 0 ? cut : length;
+    }
+  }
+
+  const char *valid_end = nullptr;
+  if (!g_utf8_validate(begin, static_cast<gssize>(length), &valid_end)) {
+    m_buffer->set_text("");
+    m_on_done("Invalid UTF-8 at byte " +
+              std::to_string(m_offset + (valid_end - begin)));
+    return false;
+  }
+
+  // One undo step per chunk would keep a second copy of the file
+  m_buffer->begin_irreversible_action();
+  m_buffer->insert(m_buffer->end(), begin, begin + length);
+  m_buffer->end_irreversible_action();
+  m_offset += length;
+  span.add_bytes(length);
+
+  if (m_offset >= data.size()) {
+    m_on_progress(1.0);
+    m_on_done("");
+    return false;
+  }
+  m_on_progress(static_cast<double>(m_offset) / data.size());
+  return true;
+}
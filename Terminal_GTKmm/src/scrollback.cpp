@@ -0,0 +1,349 @@
+#include "scrollback.hpp"
+
+#include <cstring>
+
+Scrollback::Scrollback(size_t max_bytes, size_t max_lines)
+    : m_max_bytes(std::max(max_bytes, 2 * BLOCK_SIZE)),
+      m_max_lines(std::max<size_t>(max_lines, 1)), m_lines(m_max_lines),
+      m_runs(2 * m_max_lines) {}
+
+void Scrollback::set_spill(size_t max_bytes, const std::string &directory) {
+  m_max_spill_bytes = max_bytes;
+  m_spilled_text.set_directory(directory);
+  m_spilled_lines.set_directory(directory);
+  m_spilled_runs.set_directory(directory);
+  trim();
+}
+
+void Scrollback::append(const std::string_view text, Style style) {
+  if (text.empty()) {
+    return;
+  }
+
+  if (m_runs.size() == 0 || m_runs.back().style != style) {
+    if (m_runs.full()) {
+      spill_run(m_runs[0]);
+    }
+    m_runs.push_back({m_end_offset, style});
+  }
+  uint64_t run = m_memory_first_run + m_runs.size() - 1;
+
+  // Line records
+  const char *data = text.data();
+  size_t remaining = text.size();
+  uint64_t offset = m_end_offset;
+  while (remaining > 0) {
+    if (!m_line_open) {
+      if (m_lines.full()) {
+        spill_line(m_lines[0]);
+      }
+      m_lines.push_back({offset, 0, run});
+      m_line_open = true;
+    }
+    const auto *newline =
+        static_cast<const char *>(std::memchr(data, '\n', remaining));
+    size_t length = newline ? newline - data : remaining;
+    m_lines.back().length += length;
+    if (newline) {
+      m_line_open = false;
+      ++length;
+    }
+    data += length;
+    offset += length;
+    remaining -= length;
+  }
+
+  // Text blocks: every block but the last one is exactly BLOCK_SIZE
+  data = text.data();
+  remaining = text.size();
+  while (remaining > 0) {
+    if (m_blocks.empty() || m_blocks.back().size() == BLOCK_SIZE) {
+      m_blocks.emplace_back().reserve(BLOCK_SIZE);
+    }
+    auto &block = m_blocks.back();
+    size_t n = std::min(remaining, BLOCK_SIZE - block.size());
+    block.append(data, n);
+    data += n;
+    remaining -= n;
+  }
+  m_end_offset += text.size();
+
+  trim();
+}
+
+// The oldest record or block leaves memory: appended to its file when
+// spilling, else dropped. Files hold consecutive data only, so one that
+// does not end where the new data starts is started over. A failed write
+// turns spilling off; trim then drops what was spilled.
+
+void Scrollback::spill_block(const std::string &block) {
+  if (m_max_spill_bytes > 0) {
+    if (m_text_base + m_spilled_text.size() != m_blocks_offset) {
+      m_spilled_text.reset();
+      m_text_base = m_blocks_offset;
+    }
+    if (m_spilled_text.append(block.data(), block.size())) {
+      return;
+    }
+    m_max_spill_bytes = 0;
+  }
+  m_begin_offset = std::max(m_begin_offset, m_blocks_offset + block.size());
+}
+
+void Scrollback::spill_line(const Line &line) {
+  if (m_max_spill_bytes > 0) {
+    if (m_lines_base + m_spilled_lines.size() / sizeof(Line) !=
+        m_memory_first_line) {
+      m_spilled_lines.reset();
+      m_lines_base = m_memory_first_line;
+    }
+    if (m_spilled_lines.append(&line, sizeof(Line))) {
+      ++m_memory_first_line;
+      return;
+    }
+    m_max_spill_bytes = 0;
+  }
+  // Dropped by the ring; spilled lines before it go too
+  m_first_line = ++m_memory_first_line;
+}
+
+void Scrollback::spill_run(const Run &run) {
+  if (m_max_spill_bytes > 0) {
+    if (m_runs_base + m_spilled_runs.size() / sizeof(Run) !=
+        m_memory_first_run) {
+      m_spilled_runs.reset();
+      m_runs_base = m_memory_first_run;
+    }
+    if (m_spilled_runs.append(&run, sizeof(Run))) {
+      ++m_memory_first_run;
+      return;
+    }
+    m_max_spill_bytes = 0;
+  }
+  m_first_run = ++m_memory_first_run;
+}
+
+void Scrollback::drop_first_line() {
+  if (m_first_line == m_memory_first_line) {
+    m_lines.pop_front();
+    ++m_memory_first_line;
+  }
+  ++m_first_line;
+}
+
+void Scrollback::trim() {
+  // Oldest blocks leave memory when over the byte budget
+  while (m_blocks.size() > 1 && m_end_offset - m_blocks_offset > m_max_bytes) {
+    spill_block(m_blocks.front());
+    m_blocks.pop_front();
+    m_blocks_offset += BLOCK_SIZE;
+  }
+
+  // Disk budget: text, then line and style records
+  if (m_blocks_offset > m_begin_offset + m_max_spill_bytes) {
+    m_begin_offset = m_blocks_offset - m_max_spill_bytes;
+  }
+  uint64_t max_records = m_max_spill_bytes / 4;
+  while (m_first_line < m_memory_first_line &&
+         (m_memory_first_line - m_first_line) * sizeof(Line) > max_records) {
+    drop_first_line();
+  }
+  if (m_memory_first_run - m_first_run > max_records / sizeof(Run)) {
+    m_first_run = m_memory_first_run - max_records / sizeof(Run);
+  }
+
+  // Lines that ended before the first retained byte are gone
+  while (line_count() > 0) {
+    auto first = line_record(m_first_line);
+    if (first.offset + first.length >= m_begin_offset) {
+      break;
+    }
+    drop_first_line();
+  }
+
+  // Text before the first line is released too, in memory or on disk
+  if (line_count() > 0) {
+    m_begin_offset =
+        std::max(m_begin_offset, line_record(m_first_line).offset);
+    while (m_blocks.size() > 1 &&
+           m_blocks_offset + BLOCK_SIZE <= m_begin_offset) {
+      m_blocks.pop_front();
+      m_blocks_offset += BLOCK_SIZE;
+    }
+  } else {
+    m_begin_offset = std::max(m_begin_offset, m_blocks_offset);
+  }
+
+  // Keep the run active at the first retained byte
+  while (end_run() - m_first_run > 1 &&
+         run_record(m_first_run + 1).offset <= m_begin_offset) {
+    if (m_first_run == m_memory_first_run) {
+      m_runs.pop_front();
+      ++m_memory_first_run;
+    }
+    ++m_first_run;
+  }
+
+  // Disk space of what was dropped
+  if (m_begin_offset > m_text_base) {
+    m_spilled_text.discard(m_begin_offset - m_text_base);
+  }
+  if (m_first_line > m_lines_base) {
+    m_spilled_lines.discard((m_first_line - m_lines_base) * sizeof(Line));
+  }
+  if (m_first_run > m_runs_base) {
+    m_spilled_runs.discard((m_first_run - m_runs_base) * sizeof(Run));
+  }
+}
+
+void Scrollback::clear() {
+  m_blocks.clear();
+  m_blocks_offset = m_end_offset;
+  m_begin_offset = m_end_offset;
+
+  m_first_line = end_line();
+  m_memory_first_line = m_first_line;
+  m_lines.clear();
+  m_line_open = false;
+
+  m_first_run = end_run();
+  m_memory_first_run = m_first_run;
+  m_runs.clear();
+
+  m_spilled_text.reset();
+  m_spilled_lines.reset();
+  m_spilled_runs.reset();
+}
+
+auto Scrollback::first_line() const -> uint64_t { return m_first_line; }
+
+auto Scrollback::end_line() const -> uint64_t {
+  return m_memory_first_line + m_lines.size();
+}
+
+auto Scrollback::line_count() const -> size_t {
+  return end_line() - m_first_line;
+}
+
+auto Scrollback::line_record(uint64_t number) const -> Line {
+  if (number >= m_memory_first_line) {
+    return m_lines[number - m_memory_first_line];
+  }
+  Line line;
+  m_spilled_lines.read((number - m_lines_base) * sizeof(Line), sizeof(Line),
+                       reinterpret_cast<char *>(&line));
+  return line;
+}
+
+auto Scrollback::run_record(uint64_t index) const -> Run {
+  if (index >= m_memory_first_run) {
+    return m_runs[index - m_memory_first_run];
+  }
+  Run run;
+  m_spilled_runs.read((index - m_runs_base) * sizeof(Run), sizeof(Run),
+                      reinterpret_cast<char *>(&run));
+  return run;
+}
+
+auto Scrollback::end_run() const -> uint64_t {
+  return m_memory_first_run + m_runs.size();
+}
+
+auto Scrollback::line(uint64_t number) const -> Line {
+  if (number < m_first_line || number >= end_line()) {
+    return {m_end_offset, 0, end_run()};
+  }
+  auto line = line_record(number);
+
+  // The start of the oldest line may already be gone
+  if (line.offset < m_begin_offset) {
+    auto cut = m_begin_offset - line.offset;
+    line.length = cut < line.length ? line.length - cut : 0;
+    line.offset = m_begin_offset;
+  }
+  return line;
+}
+
+auto Scrollback::line_at(uint64_t offset) const -> uint64_t {
+  // Last line starting at or before offset
+  uint64_t low = m_first_line, high = end_line();
+  while (high - low > 1) {
+    uint64_t middle = low + (high - low) / 2;
+    if (line_record(middle).offset <= offset) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+auto Scrollback::line_text(uint64_t number) const -> std::string {
+  auto l = line(number);
+  std::string text;
+  read(l.offset, l.length, text);
+  return text;
+}
+
+auto Scrollback::line_spans(uint64_t number) const -> std::vector<Span> {
+  std::vector<Span> spans;
+  auto l = line(number);
+  uint64_t run = std::max(l.run, m_first_run);
+  uint64_t end = l.offset + l.length;
+
+  for (; run < end_run(); ++run) {
+    const auto r = run_record(run);
+    if (r.offset >= end && !spans.empty()) {
+      break;
+    }
+    size_t start = r.offset > l.offset ? r.offset - l.offset : 0;
+    if (!spans.empty() && spans.back().start == start) {
+      spans.back().style = r.style; // Later run wins at the same position
+    } else {
+      spans.push_back({start, r.style});
+    }
+  }
+  return spans;
+}
+
+auto Scrollback::size() const -> uint64_t {
+  return m_end_offset - m_begin_offset;
+}
+
+auto Scrollback::spilled_size() const -> uint64_t {
+  return m_blocks_offset > m_begin_offset ? m_blocks_offset - m_begin_offset
+                                          : 0;
+}
+
+auto Scrollback::begin_offset() const -> uint64_t { return m_begin_offset; }
+
+auto Scrollback::end_offset() const -> uint64_t { return m_end_offset; }
+
+void Scrollback::read(uint64_t offset, size_t length, std::string &out) const {
+  out.clear();
+  offset = std::max(offset, m_begin_offset);
+  uint64_t end = std::min<uint64_t>(offset + length, m_end_offset);
+  if (offset >= end) {
+    return;
+  }
+  out.reserve(end - offset);
+
+  // Spilled part, paged in from disk
+  if (offset < m_blocks_offset) {
+    size_t n = std::min(end, m_blocks_offset) - offset;
+    out.resize(n);
+    m_spilled_text.read(offset - m_text_base, n, out.data());
+    offset += n;
+  }
+
+  size_t index = (offset - m_blocks_offset) / BLOCK_SIZE;
+  size_t position = (offset - m_blocks_offset) % BLOCK_SIZE;
+  while (offset < end) {
+    const auto &block = m_blocks[index];
+    size_t n = std::min<uint64_t>(end - offset, block.size() - position);
+    out.append(block, position, n);
+    offset += n;
+    position = 0;
+    ++index;
+  }
+}
@@ -0,0 +1,940 @@
+/*
+ * References:
+ *    https://www.gtkmm.org
+ */
+#include "session.hpp"
+#include "completion.hpp"
+#include "pipeline.hpp"
+#include "trace.hpp"
+
+#include <glib.h>
+#include <glibmm/miscutils.h>
+#include <gtkmm-4.0/gtkmm/eventcontrollerkey.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Length of the longest prefix of text that does not end in the middle of
+// a UTF-8 sequence, so that chunk boundaries never split a character.
+auto utf8_complete_length(const std::string_view text) -> size_t {
+  size_t i = text.size();
+  for (size_t back = 1; back <= 3 && back <= text.size(); ++back) {
+    auto c = static_cast<unsigned char>(text[text.size() - back]);
+    if ((c & 0xC0) == 0x80) {
+      continue; // Continuation byte, keep looking for the lead byte
+    }
+    size_t expected = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    if (expected > back) {
+      i = text.size() - back;
+    }
+    break;
+  }
+  return i;
+}
+
+} // namespace
+
+uint64_t Session::s_next_command_id = 1;
+
+Session::Session(Executor &executor, const Settings &settings,
+                 HistoryProvider history, StatusHandler on_status)
+    : Gtk::Box(Gtk::Orientation::VERTICAL), m_executor(executor),
+      m_settings(settings), m_history(std::move(history)),
+      m_on_status(std::move(on_status)) {
+  if (m_settings.spill_to_disk) {
+    m_scrollback.set_spill(m_settings.spill_max_bytes,
+                           Glib::build_filename(Glib::get_user_cache_dir(),
+                                                "terminal_gtkmm"));
+  }
+
+  set_spacing(5);
+  setup_command_area();
+  setup_signals();
+}
+
+Session::~Session() {
+  m_completion.unparent();
+  m_script_loader_release.disconnect();
+
+  // Workers blocked on a full queue must not wait for a session that is
+  // gone, and the executor does not wait for commands to run to completion.
+  for (auto &command : m_running) {
+    command.timeout.disconnect();
+    command.stop.request_stop();
+    command.queue->close();
+  }
+  if (m_output_tick != 0) {
+    m_command_output.remove_tick_callback(m_output_tick);
+  }
+
+  // Released on a worker: ending the shell or the Python namespace may
+  // wait for a command of another session
+  m_executor.submit([interpreter = std::move(m_interpreter)]() {});
+}
+
+void Session::setup_signals() {
+  // Button events
+  m_btn_input_execute.signal_clicked().connect(
+      sigc::mem_fun(*this, &Session::execute_input));
+  m_btn_input_stop.signal_clicked().connect(
+      sigc::mem_fun(*this, &Session::stop_commands));
+  m_btn_input_clear.signal_clicked().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::clear), 1));
+  m_btn_output_clear.signal_clicked().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::clear), 2));
+
+  // History keys are seen before the text view moves the cursor
+  auto input_keys = Gtk::EventControllerKey::create();
+  input_keys->set_propagation_phase(Gtk::PropagationPhase::CAPTURE);
+  input_keys->signal_key_pressed().connect(
+      sigc::mem_fun(*this, &Session::on_input_key_pressed), false);
+  m_command_input.add_controller(input_keys);
+  m_command_input_buffer->signal_changed().connect([this]() {
+    if (!m_history_showing) {
+      m_history_position.reset(); // Edited: Up starts from the newest again
+    }
+  });
+
+  m_completion_list.signal_row_activated().connect(
+      [this](Gtk::ListBoxRow *row) {
+        if (auto *label = dynamic_cast<Gtk::Label *>(row->get_child())) {
+          apply_completion(label->get_text());
+        }
+        m_completion.popdown();
+      });
+  m_completion.signal_closed().connect(
+      [this]() { m_command_input.grab_focus(); });
+
+  auto search_keys = Gtk::EventControllerKey::create();
+  search_keys->signal_key_pressed().connect(
+      [this](guint keyval, guint, Gdk::ModifierType state) {
+        if (keyval == GDK_KEY_r &&
+            (state & Gdk::ModifierType::CONTROL_MASK) ==
+                Gdk::ModifierType::CONTROL_MASK) {
+          history_search(true);
+          return true;
+        }
+        return false;
+      },
+      false);
+  m_history_search.add_controller(search_keys);
+  m_history_search.signal_search_changed().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::history_search), false));
+  m_history_search.signal_activate().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::history_search_end), true));
+  m_history_search.signal_stop_search().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::history_search_end), false));
+
+  // Output search: every keystroke searches, no search delay
+  auto session_keys = Gtk::EventControllerKey::create();
+  session_keys->signal_key_pressed().connect(
+      [this](guint keyval, guint, Gdk::ModifierType state) {
+        if ((keyval == GDK_KEY_f || keyval == GDK_KEY_F) &&
+            (state & Gdk::ModifierType::CONTROL_MASK) ==
+                Gdk::ModifierType::CONTROL_MASK) {
+          find_in_output();
+          return true;
+        }
+        return false;
+      },
+      false);
+  add_controller(session_keys);
+
+  auto output_search_keys = Gtk::EventControllerKey::create();
+  output_search_keys->set_propagation_phase(Gtk::PropagationPhase::CAPTURE);
+  output_search_keys->signal_key_pressed().connect(
+      [this](guint keyval, guint, Gdk::ModifierType state) {
+        if ((keyval == GDK_KEY_Return || keyval == GDK_KEY_KP_Enter) &&
+            (state & Gdk::ModifierType::SHIFT_MASK) ==
+                Gdk::ModifierType::SHIFT_MASK) {
+          output_search_step(false);
+          return true;
+        }
+        return false;
+      },
+      false);
+  m_output_search_entry.add_controller(output_search_keys);
+  m_output_search_entry.signal_changed().connect(
+      sigc::mem_fun(*this, &Session::output_search_changed));
+  m_output_search_entry.signal_activate().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::output_search_step), true));
+  m_output_search_entry.signal_previous_match().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::output_search_step), true));
+  m_output_search_entry.signal_next_match().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::output_search_step), false));
+  m_output_search_entry.signal_stop_search().connect(
+      sigc::mem_fun(*this, &Session::output_search_end));
+  m_output_search_regex.signal_toggled().connect(
+      sigc::mem_fun(*this, &Session::output_search_changed));
+  m_output_search_case.signal_toggled().connect(
+      sigc::mem_fun(*this, &Session::output_search_changed));
+  m_btn_search_previous.signal_clicked().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::output_search_step), true));
+  m_btn_search_next.signal_clicked().connect(
+      sigc::bind(sigc::mem_fun(*this, &Session::output_search_step), false));
+}
+
+void Session::setup_command_area() {
+  // Configure label
+  m_info_input.set_label("Enter the command:");
+  m_info_output.set_label("");
+
+  // Configure input area
+  m_command_input.set_left_margin(15);
+  m_command_input.set_monospace(true);
+  m_command_input.set_top_margin(15);
+  m_command_input.set_wrap_mode(Gtk::WrapMode::WORD_CHAR);
+  m_command_input_buffer = m_command_input.get_buffer();
+
+  // Re-lexes only the edited lines, the rest is done at idle time
+  m_input_highlighter =
+      std::make_unique<Highlighter>(m_command_input_buffer, m_interpreter_type);
+
+  m_input_scroll.set_child(m_command_input);
+  m_input_scroll.set_vexpand(true);
+
+  // Configure input buttons
+  m_btn_input_clear.set_label("Clear");
+  m_btn_input_clear.set_margin(5);
+
+  m_btn_input_execute.set_label("Execute");
+  m_btn_input_execute.set_margin(5);
+
+  m_btn_input_stop.set_label("Stop");
+  m_btn_input_stop.set_margin(5);
+  m_btn_input_stop.set_sensitive(false);
+
+  m_load_progress.set_hexpand(true);
+  m_load_progress.set_valign(Gtk::Align::CENTER);
+  m_load_progress.set_margin(5);
+  m_load_progress.set_visible(false);
+
+  m_history_search.set_hexpand(true);
+  m_history_search.set_valign(Gtk::Align::CENTER);
+  m_history_search.set_margin(5);
+  m_history_search.set_placeholder_text("Search history (Ctrl-R: older)");
+  m_history_search.set_visible(false);
+
+  // Completion list, placed next to the cursor when shown
+  m_completion_scroll.set_child(m_completion_list);
+  m_completion_scroll.set_policy(Gtk::PolicyType::NEVER,
+                                 Gtk::PolicyType::AUTOMATIC);
+  m_completion_scroll.set_max_content_height(240);
+  m_completion_scroll.set_propagate_natural_height(true);
+  m_completion_scroll.set_propagate_natural_width(true);
+  m_completion.set_child(m_completion_scroll);
+  m_completion.set_position(Gtk::PositionType::BOTTOM);
+  m_completion.set_has_arrow(false);
+  m_completion.set_parent(*this);
+
+  // Configure output area (scrolls by itself, only visible lines are drawn)
+  m_command_output.set_vexpand(true);
+  m_command_output.set_search(&m_output_search);
+
+  // Output search bar
+  m_output_search_entry.set_hexpand(true);
+  m_output_search_entry.set_placeholder_text(
+      "Search output (Enter: older, Shift-Enter: newer)");
+  m_output_search_regex.set_label("Regex");
+  m_output_search_case.set_label("Match case");
+  m_btn_search_previous.set_label("Previous");
+  m_btn_search_next.set_label("Next");
+  m_output_search_info.set_width_chars(16);
+  m_output_search_box.set_spacing(5);
+  m_output_search_box.set_margin(5);
+  m_output_search_box.append(m_output_search_entry);
+  m_output_search_box.append(m_output_search_regex);
+  m_output_search_box.append(m_output_search_case);
+  m_output_search_box.append(m_btn_search_previous);
+  m_output_search_box.append(m_btn_search_next);
+  m_output_search_box.append(m_output_search_info);
+  m_output_search_box.set_visible(false);
+
+  // Configure output buttons
+  m_btn_output_clear.set_label("Clear");
+  m_btn_output_clear.set_margin(5);
+
+  // Tool box
+  m_input_tool_box.append(m_btn_input_clear);
+  m_input_tool_box.append(m_btn_input_execute);
+  m_input_tool_box.append(m_btn_input_stop);
+  m_input_tool_box.append(m_load_progress);
+  m_input_tool_box.append(m_history_search);
+  m_output_tool_box.append(m_btn_output_clear);
+
+  append(m_info_input);
+  append(m_input_scroll);
+  append(m_input_tool_box);
+  append(m_info_output);
+  append(m_output_search_box);
+  append(m_command_output);
+  append(m_output_tool_box);
+}
+
+void Session::set_language(int language) {
+  m_interpreter_type = language;
+  m_history_position.reset();
+  m_input_highlighter->set_language(language);
+}
+
+void Session::execute_input(bool bypass_cache) {
+  auto command = m_command_input_buffer->get_text();
+  if (command.empty()) {
+    m_info_input.set_label("Empty command input! Enter a command:");
+    return;
+  }
+
+  m_history(m_interpreter_type).add(command.raw());
+  m_history_position.reset();
+
+  // "bash: ... | python: ..." streams between the stages, never cached
+  if (auto stages = Pipeline::parse(command.raw()); !stages.empty()) {
+    run_job([interpreter = m_interpreter,
+             stages = std::move(stages)](const auto &on_output, auto stop) {
+      Pipeline::run(*interpreter, stages, on_output, stop);
+    });
+    return;
+  }
+
+  run_job([interpreter = m_interpreter, command = std::string(command),
+           language = m_interpreter_type,
+           bypass_cache](const auto &on_output, auto stop) {
+    interpreter->execute_command(command, language, on_output, stop,
+                                 bypass_cache);
+  });
+}
+
+void Session::execute_file(const std::string &path, int language) {
+  // The script is never loaded into the editor
+  m_on_status("Executing " + path);
+  run_job([interpreter = m_interpreter, path,
+           language](const auto &on_output, auto stop) {
+    interpreter->execute_file(path, language, on_output, stop);
+  });
+}
+
+void Session::stop_commands() {
+  // Each backend reports the cancellation in the output of its command
+  for (auto &command : m_running) {
+    command.stop.request_stop();
+  }
+}
+
+void Session::load_script(const std::string &path, int language) {
+  stop_loading();
+
+  std::optional<MappedFile> file;
+  try {
+    file.emplace(path);
+  } catch (const std::runtime_error &e) {
+    m_info_input.set_label(e.what());
+    return;
+  }
+
+  clear();
+  set_language(language);
+  m_on_status("Interpreter: " + Interpreter::name(language));
+
+  // Read-only until the whole file is in the buffer
+  m_command_input.set_editable(false);
+  m_load_progress.set_fraction(0.0);
+  m_load_progress.set_visible(true);
+  m_info_input.set_label("Loading " + path + " ...");
+
+  m_script_loader = std::make_unique<ScriptLoader>(
+      std::move(*file), m_command_input_buffer,
+      [this](double fraction) { m_load_progress.set_fraction(fraction); },
+      [this, path](const std::string &error) {
+        m_info_input.set_label(error.empty() ? "Loaded " + path
+                                             : "Failed to load " + path +
+                                                   ": " + error);
+        m_load_progress.set_visible(false);
+        m_command_input.set_editable(true);
+        // Unmaps the file once the loader has returned
+        m_script_loader_release = Glib::signal_idle().connect([this]() {
+          m_script_loader.reset();
+          return false;
+        });
+      });
+  m_script_loader->start();
+}
+
+void Session::stop_loading() {
+  m_script_loader_release.disconnect(); // Would reset the next loader
+  if (m_script_loader) {
+    m_script_loader.reset();
+    m_load_progress.set_visible(false);
+    m_command_input.set_editable(true);
+  }
+}
+
+auto Session::can_save() -> bool {
+  if (m_command_input_buffer->get_char_count() == 0) {
+    m_info_input.set_label("Empty command input! Enter a command:");
+    return false;
+  }
+
+  if (m_scrollback.size() == 0) {
+    m_info_output.set_label("Empty output!");
+    return false;
+  }
+  return true;
+}
+
+void Session::save(const std::string &directory) {
+  if (saving()) {
+    m_on_status("A save is already running");
+    return;
+  }
+
+  g_message("[Terminal App] Path: %s", directory.c_str());
+
+  // Input: read in slices of characters, the editor is read-only meanwhile
+  std::string filename = "terminal_commands.txt";
+  m_command_input.set_editable(false);
+  m_input_save = std::make_unique<SaveTask>(
+      directory + "/" + filename,
+      [this, offset = 0](std::string &chunk) mutable {
+        if (offset >= m_command_input_buffer->get_char_count()) {
+          return false;
+        }
+        auto start = m_command_input_buffer->get_iter_at_offset(offset);
+        auto end = start;
+        end.forward_chars(SAVE_CHUNK_CHARS);
+        chunk = m_command_input_buffer->get_slice(start, end).raw();
+        offset = end.get_offset();
+        return true;
+      },
+      [this, directory, filename](const std::string &error) {
+        m_command_input.set_editable(true);
+        m_info_input.set_text(error.empty()
+                                  ? "Save in " + directory + " ... " + filename
+                                  : "Save failed: " + error);
+      });
+
+  // Output: the bytes retained when the save started, block by block
+  filename = "terminal_result.txt";
+  m_output_save = std::make_unique<SaveTask>(
+      directory + "/" + filename,
+      [this, offset = m_scrollback.begin_offset(),
+       end = m_scrollback.end_offset()](std::string &chunk) mutable {
+        if (offset >= end) {
+          return false;
+        }
+        if (offset < m_scrollback.begin_offset()) {
+          throw std::runtime_error(
+              "output was cleared or trimmed while saving");
+        }
+        m_scrollback.read(
+            offset, std::min<uint64_t>(end - offset, Scrollback::BLOCK_SIZE),
+            chunk);
+        offset += chunk.size();
+        return true;
+      },
+      [this, directory, filename](const std::string &error) {
+        m_info_output.set_text(error.empty()
+                                   ? "Save in " + directory + " ... " + filename
+                                   : "Save failed: " + error);
+      });
+
+  m_info_input.set_text("Saving...");
+  m_info_output.set_text("Saving...");
+  m_input_save->start();
+  m_output_save->start();
+}
+
+auto Session::saving() const -> bool {
+  return (m_input_save && m_input_save->running()) ||
+         (m_output_save && m_output_save->running());
+}
+
+void Session::clear(int operation) {
+  // 0 (input and output), 1 (input), 2 (output)
+  if (operation == 0 || operation == 1) {
+    stop_loading();
+    m_command_input_buffer->set_text("");
+    m_info_input.set_label("Enter a command:");
+  }
+  if (operation == 0 || operation == 2) {
+    m_scrollback.clear();
+    m_output_search.update();
+    m_command_output.refresh();
+    m_info_output.set_label("Result:");
+  }
+}
+
+auto Session::on_input_key_pressed(guint keyval, guint,
+                                   Gdk::ModifierType state) -> bool {
+  auto modifiers = state & (Gdk::ModifierType::CONTROL_MASK |
+                            Gdk::ModifierType::SHIFT_MASK |
+                            Gdk::ModifierType::ALT_MASK);
+  if (!m_command_input.get_editable()) {
+    return false;
+  }
+  if (keyval == GDK_KEY_r && modifiers == Gdk::ModifierType::CONTROL_MASK) {
+    history_search_start();
+    return true;
+  }
+  if (modifiers != Gdk::ModifierType{}) {
+    return false;
+  }
+  if (keyval == GDK_KEY_Tab) {
+    return complete_input();
+  }
+
+  // Up and Down recall only from the first and last line, as in a shell
+  auto cursor = input_cursor();
+  if (keyval == GDK_KEY_Up && cursor.get_line() == 0) {
+    history_recall(true);
+    return true;
+  }
+  if (keyval == GDK_KEY_Down && m_history_position &&
+      cursor.get_line() == m_command_input_buffer->get_line_count() - 1) {
+    history_recall(false);
+    return true;
+  }
+  return false;
+}
+
+auto Session::input_cursor() -> Gtk::TextIter {
+  return m_command_input_buffer->get_iter_at_mark(
+      m_command_input_buffer->get_insert());
+}
+
+auto Session::complete_input() -> bool {
+  auto cursor = input_cursor();
+  auto line_start = cursor;
+  line_start.set_line_offset(0);
+  std::string text = m_command_input_buffer->get_text(line_start, cursor).raw();
+  if (text.empty() || std::isspace(static_cast<unsigned char>(text.back()))) {
+    return false; // A plain Tab, for indentation
+  }
+
+  auto result = Completion::complete(text, m_interpreter_type, *m_interpreter);
+  // File names need not be valid UTF-8, the buffer does
+  std::erase_if(result.items, [](const std::string &item) {
+    return !g_utf8_validate(item.data(), item.size(), nullptr);
+  });
+  m_completion_word = text.substr(result.start);
+  if (result.items.empty()) {
+    return true;
+  }
+
+  auto prefix = Completion::common_prefix(result.items);
+  if (prefix.size() > m_completion_word.size()) {
+    apply_completion(prefix);
+  }
+  if (result.items.size() > 1) {
+    show_completions(result.items);
+  }
+  return true;
+}
+
+void Session::show_completions(const std::vector<std::string> &items) {
+  while (auto *row = m_completion_list.get_row_at_index(0)) {
+    m_completion_list.remove(*row);
+  }
+  for (const auto &item : items) {
+    auto *label = Gtk::make_managed<Gtk::Label>(item, Gtk::Align::START);
+    label->set_margin_start(5);
+    label->set_margin_end(5);
+    m_completion_list.append(*label);
+  }
+  m_completion_list.select_row(*m_completion_list.get_row_at_index(0));
+
+  // Points at the cursor, in the coordinates of the popover's parent
+  Gdk::Rectangle location;
+  m_command_input.get_iter_location(input_cursor(), location);
+  int x = 0, y = 0;
+  m_command_input.buffer_to_window_coords(Gtk::TextWindowType::WIDGET,
+                                          location.get_x(), location.get_y(),
+                                          x, y);
+  double parent_x = 0, parent_y = 0;
+  m_command_input.translate_coordinates(*this, x, y, parent_x, parent_y);
+  m_completion.set_pointing_to(
+      Gdk::Rectangle(static_cast<int>(parent_x), static_cast<int>(parent_y),
+                     1, location.get_height()));
+  m_completion.popup();
+  m_completion_list.get_row_at_index(0)->grab_focus();
+}
+
+void Session::apply_completion(const std::string &item) {
+  auto end = input_cursor();
+  auto start = end;
+  start.backward_chars(static_cast<int>(g_utf8_strlen(
+      m_completion_word.data(), static_cast<gssize>(m_completion_word.size()))));
+  end = m_command_input_buffer->erase(start, end);
+  m_command_input_buffer->insert(end, item);
+  m_completion_word = item;
+}
+
+void Session::history_recall(bool older) {
+  Trace::Span span("history_recall", 0);
+  auto &history = m_history(m_interpreter_type);
+  if (!m_history_position) {
+    m_history_draft = m_command_input_buffer->get_text();
+  }
+
+  // Entries repeating the one shown are skipped
+  std::string shown = m_command_input_buffer->get_text();
+  size_t position = m_history_position.value_or(history.end());
+  while (true) {
+    auto match = older ? history.previous(position, m_history_draft, true)
+                       : history.next(position, m_history_draft, true);
+    if (!match) {
+      if (!older) {
+        // Past the newest entry: back to what was typed
+        m_history_position.reset();
+        history_show(m_history_draft);
+      }
+      return;
+    }
+    position = match->position;
+    if (match->text != shown) {
+      history_show(match->text);
+      m_history_position = position;
+      return;
+    }
+  }
+}
+
+void Session::history_show(const std::string_view text) {
+  m_history_showing = true;
+  m_command_input_buffer->set_text(std::string(text));
+  m_command_input_buffer->place_cursor(m_command_input_buffer->end());
+  m_history_showing = false;
+}
+
+void Session::history_search_start() {
+  if (!m_history_search.get_visible()) {
+    m_history_draft = m_command_input_buffer->get_text();
+    m_history_position.reset();
+    m_history_search.set_text("");
+    m_history_search.set_visible(true);
+  }
+  m_history_search.grab_focus();
+}
+
+void Session::history_search(bool older) {
+  Trace::Span span("history_search", 0);
+  std::string query = m_history_search.get_text();
+  if (query.empty()) {
+    m_history_position.reset();
+    history_show(m_history_draft);
+    m_info_input.set_label("Search history:");
+    return;
+  }
+
+  // Typing searches from the newest entry, Ctrl-R from the one shown
+  auto &history = m_history(m_interpreter_type);
+  size_t position = older && m_history_position ? *m_history_position
+                                                : history.end();
+  if (auto match = history.previous(position, query, false)) {
+    history_show(match->text);
+    m_history_position = match->position;
+    m_info_input.set_label("Search history:");
+  } else {
+    m_info_input.set_label("Search history: no match for " + query);
+  }
+}
+
+void Session::history_search_end(bool accept) {
+  if (!accept) {
+    history_show(m_history_draft);
+  }
+  m_history_position.reset();
+  m_history_search.set_visible(false);
+  m_info_input.set_label("Enter the command:");
+  m_command_input.grab_focus();
+}
+
+void Session::find_in_output() {
+  m_output_search_box.set_visible(true);
+  m_output_search_entry.grab_focus();
+  if (!m_output_search.active() && !m_output_search_entry.get_text().empty()) {
+    output_search_changed();
+  }
+}
+
+void Session::output_search_changed() {
+  // Matches are looked for from the bottom of the view upwards
+  auto bottom = m_scrollback.line(m_command_output.last_visible_line());
+  m_output_search_anchor = bottom.offset + bottom.length + 1;
+  m_output_search_jump = true;
+
+  auto error = m_output_search.set_query(m_output_search_entry.get_text(),
+                                         m_output_search_regex.get_active(),
+                                         !m_output_search_case.get_active());
+  if (!error.empty()) {
+    m_output_search_info.set_text("Invalid");
+    m_output_search_entry.set_tooltip_text(error);
+    return;
+  }
+  m_output_search_entry.set_tooltip_text("");
+}
+
+void Session::output_search_step(bool older) {
+  if (!m_output_search.active()) {
+    return;
+  }
+  // Older or newer than the current match, wrapping around at either end
+  auto current = m_output_search.current();
+  std::optional<OutputSearch::Match> match;
+  if (older) {
+    match = m_output_search.find_previous(current ? current->offset
+                                                  : m_output_search_anchor);
+    if (!match) {
+      match = m_output_search.find_previous(
+          std::numeric_limits<uint64_t>::max());
+    }
+  } else {
+    match = m_output_search.find_next(current ? current->offset + 1
+                                              : m_output_search_anchor);
+    if (!match) {
+      match = m_output_search.find_next(0);
+    }
+  }
+  if (match) {
+    output_search_show(*match);
+  }
+  on_output_search_update();
+}
+
+void Session::output_search_show(const OutputSearch::Match &match) {
+  m_output_search_jump = false;
+  m_output_search.set_current(match);
+  m_command_output.show_line(m_scrollback.line_at(match.offset));
+}
+
+void Session::output_search_end() {
+  m_output_search.set_query("", false, false);
+  m_output_search_box.set_visible(false);
+  m_command_input.grab_focus();
+}
+
+void Session::on_output_search_update() {
+  // After typing, the first match above the anchor is shown (one below it
+  // once nothing is above); the view stays put after that
+  if (m_output_search_jump && !m_output_search.current()) {
+    auto match = m_output_search.nearest(m_output_search_anchor);
+    if (match && (match->offset < m_output_search_anchor ||
+                  m_output_search.complete())) {
+      output_search_show(*match);
+    }
+  }
+
+  std::string text;
+  if (m_output_search.active()) {
+    char buffer[64];
+    auto count = m_output_search.count();
+    const char *more = m_output_search.complete() ? "" : "+";
+    if (count == 0) {
+      text = m_output_search.complete() ? "No matches" : "Searching...";
+    } else if (auto index = m_output_search.current_index(); index > 0) {
+      std::snprintf(buffer, sizeof(buffer), "%zu of %zu%s", index, count, more);
+      text = buffer;
+    } else {
+      std::snprintf(buffer, sizeof(buffer), "%zu%s matches", count, more);
+      text = buffer;
+    }
+  }
+  m_output_search_info.set_text(text);
+  m_command_output.refresh();
+}
+
+void Session::run_job(Job job) {
+  uint64_t id = s_next_command_id++;
+  Trace::Span span("submit_command", id);
+
+  auto queue = std::make_shared<OutputQueue>(m_settings.output_max_queued_bytes);
+  std::stop_source stop;
+  sigc::connection timeout;
+  if (m_settings.command_timeout.count() > 0) {
+    timeout = Glib::signal_timeout().connect_seconds_once(
+        [stop]() mutable { stop.request_stop(); },
+        m_settings.command_timeout.count());
+  }
+  m_running.push_back({queue, {}, id, Trace::now_us(), stop, timeout});
+  if (m_output_tick == 0) {
+    m_output_tick = m_command_output.add_tick_callback(
+        sigc::mem_fun(*this, &Session::on_output_tick));
+  }
+
+  update_running_status();
+
+  // Execute command on a worker and stream the output to the UI thread.
+  // push() blocks while the UI is behind, which throttles the command.
+  m_executor.submit([queue, id, token = stop.get_token(),
+                     job = std::move(job)]() {
+    Trace::set_command(id);
+    Trace::Span span("job");
+    // Incomplete UTF-8 tail of the last chunk, per stream (stdout, stderr)
+    std::array<std::string, 2> pending;
+    try {
+      job([&queue, &pending, &span](std::string_view chunk, bool is_error) {
+        span.add_bytes(chunk.size());
+        auto &carry = pending[is_error];
+        std::string text = std::move(carry);
+        text += chunk;
+        size_t complete = utf8_complete_length(text);
+        carry = text.substr(complete);
+        text.resize(complete);
+        if (!text.empty()) {
+          queue->push({std::move(text), is_error});
+        }
+      }, token);
+    } catch (const std::exception &e) {
+      queue->push({e.what(), true});
+    }
+    for (size_t i = 0; i < pending.size(); ++i) {
+      if (!pending[i].empty()) {
+        queue->push({std::move(pending[i]), i == 1});
+      }
+    }
+    // Recorded before the UI can see the command finish
+    span.stop();
+    Trace::set_command(0);
+    queue->push({"", false, true});
+  });
+}
+
+auto Session::on_output_tick(const Glib::RefPtr<Gdk::FrameClock> &) -> bool {
+  Trace::Span span("output_tick", 0);
+  // Each running command gets an equal share of the frame budget; chunks
+  // waiting longer than the latency limit are taken regardless.
+  auto now = std::chrono::steady_clock::now();
+  size_t share = m_settings.output_frame_budget /
+                 std::max<size_t>(m_running.size(), 1);
+  bool appended = false;
+
+  for (auto it = m_running.begin(); it != m_running.end();) {
+    auto &queue = it->queue;
+    size_t taken = 0;
+    bool finished = false;
+
+    while (auto *chunk = queue->front()) {
+      bool late = now - chunk->time >= m_settings.output_max_latency;
+      if (taken >= share && !late) {
+        break;
+      }
+      if (chunk->finished) {
+        finished = true;
+        // Blank line between the output of consecutive commands
+        m_scrollback.append("\n");
+      } else {
+        append_styled(*it, chunk->text, chunk->is_error);
+        taken += chunk->text.size();
+      }
+      appended = true;
+      queue->pop();
+      if (finished) {
+        break;
+      }
+    }
+
+    if (finished) {
+      if (Trace::enabled()) {
+        int64_t now_us = Trace::now_us();
+        Trace::record({"command", it->id, 0, it->start_us,
+                       now_us - it->start_us, 0, 0, 0});
+        show_trace_summary(it->id);
+      }
+      it->timeout.disconnect();
+      it = m_running.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  if (appended) {
+    m_output_search.update();
+    m_command_output.refresh();
+    update_running_status();
+  }
+
+  if (m_running.empty()) {
+    m_output_tick = 0;
+    return false; // Removes the tick callback until the next command
+  }
+  return true;
+}
+
+void Session::append_styled(RunningCommand &command,
+                            const std::string_view text, bool is_error) {
+  Trace::Span span("append_output", command.id);
+  span.add_bytes(text.size());
+  auto base = is_error ? Scrollback::STYLE_ERROR : Scrollback::STYLE_OUTPUT;
+  command.parsers[is_error].feed(text, m_spans);
+  for (const auto &span : m_spans) {
+    m_scrollback.append(span.text,
+                        m_command_output.intern(span.attributes, base));
+  }
+}
+
+void Session::update_running_status() {
+  m_btn_input_stop.set_sensitive(!m_running.empty());
+  if (!m_running.empty()) {
+    m_info_output.set_label("Running " + std::to_string(m_running.size()) +
+                            " command(s)...");
+  } else {
+    m_info_output.set_label("Result:");
+  }
+}
+
+void Session::append_to_output(const std::string_view text, bool is_error) {
+  Trace::Span span("append_to_output", 0);
+  span.add_bytes(text.size());
+  // Constant cost per append; the scrollback drops the oldest output itself
+  m_scrollback.append(text, is_error ? Scrollback::STYLE_ERROR
+                                     : Scrollback::STYLE_OUTPUT);
+  m_output_search.update();
+  m_command_output.refresh();
+}
+
+void Session::show_trace_summary(uint64_t command) {
+  // Wall time of the whole command, CPU and memory of the worker plus the
+  // UI work done for it, and where the time went
+  int64_t wall_us = 0, cpu_us = 0, rss_kb = 0;
+  uint64_t bytes = 0;
+  std::vector<std::pair<std::string_view, int64_t>> phases;
+  for (const auto &event : Trace::events(command)) {
+    std::string_view name = event.name;
+    if (name == "command") {
+      wall_us = event.wall_us;
+      continue;
+    }
+    if (name == "job") {
+      bytes = event.bytes;
+      rss_kb = event.rss_delta_kb;
+      cpu_us += event.cpu_us;
+      continue;
+    }
+    if (name == "append_output" || name == "submit_command") {
+      cpu_us += event.cpu_us;
+    }
+    auto phase = std::find_if(phases.begin(), phases.end(),
+                              [name](const auto &p) { return p.first == name; });
+    if (phase == phases.end()) {
+      phases.emplace_back(name, event.wall_us);
+    } else {
+      phase->second += event.wall_us;
+    }
+  }
+
+  char buffer[160];
+  std::snprintf(buffer, sizeof(buffer),
+                "Last command: %.1f ms, CPU %.1f ms, %.2f MB, RSS %+.1f MB |",
+                wall_us / 1e3, cpu_us / 1e3, bytes / 1e6, rss_kb / 1024.0);
+  std::string text = buffer;
+  for (const auto &[name, phase_us] : phases) {
+    std::snprintf(buffer, sizeof(buffer), " %.*s %.1f ms",
+                  static_cast<int>(name.size()), name.data(), phase_us / 1e3);
+    text += buffer;
+  }
+  m_on_status(text);
+}
@@ -0,0 +1,109 @@
+/*
+ * References:
+ *    https://docs.gtk.org/glib/struct.KeyFile.html
+ */
+#include "settings.hpp"
+
+#include <glibmm/fileutils.h>
+#include <glibmm/keyfile.h>
+#include <glibmm/miscutils.h>
+
+namespace {
+
+// Reads a positive integer, keeping the current value when absent or invalid
+template <typename T>
+void read_integer(const Glib::RefPtr<Glib::KeyFile> &file,
+                  const Glib::ustring &group, const Glib::ustring &key,
+                  T &value) {
+  try {
+    if (file->has_group(group) && file->has_key(group, key)) {
+      auto number = file->get_int64(group, key);
+      if (number > 0) {
+        value = static_cast<T>(number);
+      }
+    }
+  } catch (const Glib::Error &e) {
+    g_warning("[Terminal App] Settings %s/%s: %s", group.c_str(), key.c_str(),
+              e.what());
+  }
+}
+
+void read_boolean(const Glib::RefPtr<Glib::KeyFile> &file,
+                  const Glib::ustring &group, const Glib::ustring &key,
+                  bool &value) {
+  try {
+    if (file->has_group(group) && file->has_key(group, key)) {
+      value = file->get_boolean(group, key);
+    }
+  } catch (const Glib::Error &e) {
+    g_warning("[Terminal App] Settings %s/%s: %s", group.c_str(), key.c_str(),
+              e.what());
+  }
+}
+
+// Reads a list separated by ';'; an empty value makes an empty list
+void read_list(const Glib::RefPtr<Glib::KeyFile> &file,
+               const Glib::ustring &group, const Glib::ustring &key,
+               std::vector<std::string> &value) {
+  try {
+    if (file->has_group(group) && file->has_key(group, key)) {
+      value.clear();
+      for (const auto &item : file->get_string_list(group, key)) {
+        if (!item.empty()) {
+          value.push_back(item);
+        }
+      }
+    }
+  } catch (const Glib::Error &e) {
+    g_warning("[Terminal App] Settings %s/%s: %s", group.c_str(), key.c_str(),
+              e.what());
+  }
+}
+
+} // namespace
+
+auto Settings::path() -> std::string {
+  return Glib::build_filename(Glib::get_user_config_dir(), "terminal_gtkmm",
+                              "settings.ini");
+}
+
+auto Settings::load() -> Settings {
+  Settings settings;
+
+  auto file = Glib::KeyFile::create();
+  try {
+    if (!file->load_from_file(path())) {
+      return settings;
+    }
+  } catch (const Glib::Error &) {
+    return settings; // No settings file: defaults
+  }
+
+  long long latency = settings.output_max_latency.count();
+  read_integer(file, "Output", "max_latency_ms", latency);
+  settings.output_max_latency = std::chrono::milliseconds(latency);
+  read_integer(file, "Output", "max_queued_bytes",
+               settings.output_max_queued_bytes);
+  read_integer(file, "Output", "frame_budget_bytes",
+               settings.output_frame_budget);
+  read_boolean(file, "Output", "spill_to_disk", settings.spill_to_disk);
+  read_integer(file, "Output", "spill_max_bytes", settings.spill_max_bytes);
+
+  long long timeout = settings.command_timeout.count();
+  read_integer(file, "Execution", "timeout_s", timeout);
+  settings.command_timeout = std::chrono::seconds(timeout);
+
+  read_integer(file, "Cache", "max_bytes", settings.cache_max_bytes);
+  read_boolean(file, "Cache", "key_directory", settings.cache_key_directory);
+  read_integer(file, "Cache", "compiled_max_bytes",
+               settings.compiled_max_bytes);
+  read_boolean(file, "Cache", "compiled_on_disk", settings.compiled_on_disk);
+
+  read_boolean(file, "Startup", "warm_up", settings.warm_up);
+  read_integer(file, "Startup", "lua_states", settings.warm_up_lua_states);
+  read_boolean(file, "Startup", "python", settings.warm_up_python);
+  read_list(file, "Startup", "python_modules",
+            settings.warm_up_python_modules);
+
+  return settings;
+}
@@ -0,0 +1,132 @@
+/*
+ * References:
+ *    https://csrc.nist.gov/pubs/fips/180-4/upd1/final
+ */
+#include "sha256.hpp"
+
+#include <algorithm>
+
+namespace {
+
+constexpr std::array<uint32_t, 64> ROUND_CONSTANTS{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+constexpr auto rotr(uint32_t x, int n) -> uint32_t {
+  return (x >> n) | (x << (32 - n));
+}
+
+} // namespace
+
+Sha256::Sha256()
+    : m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f,
+              0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {}
+
+void Sha256::update(const std::string_view data) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(data.data());
+  size_t size = data.size();
+  m_length += size;
+
+  if (m_used > 0) {
+    size_t take = std::min(size, m_block.size() - m_used);
+    std::copy_n(bytes, take, m_block.begin() + m_used);
+    m_used += take;
+    bytes += take;
+    size -= take;
+    if (m_used < m_block.size()) {
+      return;
+    }
+    compress(m_block.data());
+    m_used = 0;
+  }
+  // Whole blocks straight from the input
+  for (; size >= m_block.size(); bytes += m_block.size(), size -= m_block.size()) {
+    compress(bytes);
+  }
+  std::copy_n(bytes, size, m_block.begin());
+  m_used = size;
+}
+
+auto Sha256::finish() -> Digest {
+  uint64_t bits = m_length * 8;
+  // 0x80, zeros up to 56 bytes into a block, then the length big-endian
+  uint8_t padding[72] = {0x80};
+  size_t pad = (m_used < 56 ? 56 : 120) - m_used;
+  for (int i = 0; i < 8; ++i) {
+    padding[pad + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+  }
+  update(std::string_view(reinterpret_cast<const char *>(padding), pad + 8));
+
+  Digest digest;
+  for (size_t i = 0; i < m_state.size(); ++i) {
+    for (size_t j = 0; j < 4; ++j) {
+      digest[i * 4 + j] = static_cast<uint8_t>(m_state[i] >> (24 - 8 * j));
+    }
+  }
+  return digest;
+}
+
+auto Sha256::hex(const std::string_view data) -> std::string {
+  Sha256 sha;
+  sha.update(data);
+  return to_hex(sha.finish());
+}
+
+auto Sha256::to_hex(const Digest &digest) -> std::string {
+  static constexpr char DIGITS[] = "0123456789abcdef";
+  std::string text;
+  text.reserve(digest.size() * 2);
+  for (uint8_t byte : digest) {
+    text += DIGITS[byte >> 4];
+    text += DIGITS[byte & 0xF];
+  }
+  return text;
+}
+
+void Sha256::compress(const uint8_t *block) {
+  std::array<uint32_t, 64> w;
+  for (size_t i = 0; i < 16; ++i) {
+    w[i] = uint32_t(block[i * 4]) << 24 | uint32_t(block[i * 4 + 1]) << 16 |
+           uint32_t(block[i * 4 + 2]) << 8 | uint32_t(block[i * 4 + 3]);
+  }
+  for (size_t i = 16; i < 64; ++i) {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  auto [a, b, c, d, e, f, g, h] = m_state;
+  for (size_t i = 0; i < 64; ++i) {
+    uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+    uint32_t choice = (e & f) ^ (~e & g);
+    uint32_t t1 = h + s1 + choice + ROUND_CONSTANTS[i] + w[i];
+    uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+    uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = s0 + majority;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  m_state[0] += a;
+  m_state[1] += b;
+  m_state[2] += c;
+  m_state[3] += d;
+  m_state[4] += e;
+  m_state[5] += f;
+  m_state[6] += g;
+  m_state[7] += h;
+}
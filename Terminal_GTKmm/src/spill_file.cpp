@@ -0,0 +1,163 @@
+#include "spill_file.hpp"
+#include "trace.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace {
+
+// Unnamed file in directory: O_TMPFILE, or a named one unlinked at once
+// on file systems without it
+auto open_unnamed(const std::string &directory) -> int {
+  int fd = ::open(directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR)) {
+    return fd;
+  }
+  std::string path = directory + "/terminal_spill.XXXXXX";
+  std::vector<char> temp(path.begin(), path.end());
+  temp.push_back('\0');
+  fd = ::mkostemp(temp.data(), O_CLOEXEC);
+  if (fd >= 0) {
+    ::unlink(temp.data());
+  }
+  return fd;
+}
+
+} // namespace
+
+SpillFile::SpillFile(std::string directory)
+    : m_directory(std::move(directory)) {}
+
+SpillFile::~SpillFile() { reset(); }
+
+auto SpillFile::open() -> bool {
+  Trace::Span span("spill_open");
+  if (!m_directory.empty()) {
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    m_fd = open_unnamed(m_directory);
+  }
+  if (m_fd < 0) {
+    const char *temp = std::getenv("TMPDIR");
+    m_fd = open_unnamed(temp && *temp ? temp : "/tmp");
+  }
+  return m_fd >= 0;
+}
+
+auto SpillFile::append(const void *data, size_t size) -> bool {
+  if (m_fd < 0 && !open()) {
+    return false;
+  }
+  const auto *bytes = static_cast<const char *>(data);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pwrite(m_fd, bytes + done, size - done,
+                         static_cast<off_t>(m_size + done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      // Partial data is never read: the size stays where it was
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  m_size += size;
+  return true;
+}
+
+auto SpillFile::view(uint64_t offset, size_t length) const
+    -> std::string_view {
+  if (offset >= m_size || length == 0) {
+    return {};
+  }
+  uint64_t start = offset - offset % WINDOW_SIZE;
+  uint64_t end = std::min({offset + length, start + WINDOW_SIZE, m_size});
+
+  // A window mapped before the file grew may be too short
+  Window *window = nullptr;
+  for (auto &w : m_windows) {
+    if (w.data && w.start == start && w.start + w.length >= end) {
+      window = &w;
+      break;
+    }
+  }
+  if (!window) {
+    Trace::Span span("spill_map");
+    window = &*std::min_element(
+        m_windows.begin(), m_windows.end(),
+        [](const Window &a, const Window &b) { return a.used < b.used; });
+    for (auto &w : m_windows) {
+      if (w.data && w.start == start) {
+        window = &w; // Replaced by the longer mapping
+      }
+    }
+    if (window->data) {
+      ::munmap(const_cast<char *>(window->data), window->length);
+      *window = {};
+    }
+    size_t length = std::min<uint64_t>(WINDOW_SIZE, m_size - start);
+    void *data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, m_fd,
+                        static_cast<off_t>(start));
+    if (data == MAP_FAILED) {
+      return {};
+    }
+    *window = {start, length, static_cast<const char *>(data), 0};
+  }
+  window->used = ++m_tick;
+  return {window->data + (offset - start), static_cast<size_t>(end - offset)};
+}
+
+void SpillFile::read(uint64_t offset, size_t length, char *out) const {
+  while (length > 0) {
+    auto part = view(offset, length);
+    if (part.empty()) {
+      std::memset(out, 0, length); // Past the end or unmappable
+      return;
+    }
+    std::memcpy(out, part.data(), part.size());
+    out += part.size();
+    offset += part.size();
+    length -= part.size();
+  }
+}
+
+void SpillFile::discard(uint64_t offset) {
+  offset = std::min(offset, m_size);
+  uint64_t end = offset - offset % DISCARD_STEP;
+  if (m_fd < 0 || end <= m_discarded) {
+    return;
+  }
+  // Best effort: without hole punching the space is kept until reset
+  ::fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              static_cast<off_t>(m_discarded),
+              static_cast<off_t>(end - m_discarded));
+  m_discarded = end;
+}
+
+void SpillFile::reset() {
+  unmap();
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+  m_size = 0;
+  m_discarded = 0;
+}
+
+void SpillFile::unmap() const {
+  for (auto &window : m_windows) {
+    if (window.data) {
+      ::munmap(const_cast<char *>(window.data), window.length);
+    }
+    window = {};
+  }
+}
@@ -10,23 +10,92 @@
  *    lua
  */
 #include "terminal.hpp"
+#include "chunk_cache.hpp"
+#include "completion.hpp"
+#include "result_cache.hpp"
+#include "trace.hpp"
 
 #include <giomm.h>
 #include <glib.h>
+#include <gtkmm-4.0/gdkmm/frameclock.h>
 #include <gtkmm-4.0/gtkmm/application.h>
 #include <gtkmm-4.0/gtkmm/filechooserdialog.h>
 #include <gtkmm-4.0/gtkmm/messagedialog.h>
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// --startup-profile: each milestone is printed once, in ms since startup
+enum Milestone { FIRST_FRAME, FIRST_READY, LANGUAGE_READY };
+
+std::atomic<bool> s_startup_profile{false};
+std::atomic<int64_t> s_startup_us{0};
+std::atomic<unsigned> s_reported{0};
+
+void report(int milestone, const std::string &what) {
+  unsigned bit = 1u << milestone;
+  if (!s_startup_profile || (s_reported.fetch_or(bit) & bit)) {
+    return;
+  }
+  double ms = static_cast<double>(Trace::now_us() - s_startup_us) / 1000;
+  std::fprintf(stderr, "startup: %-24s %8.1f ms\n", what.c_str(), ms);
+}
+
+// Any thread
+void report_ready(int language) {
+  report(LANGUAGE_READY + language, Interpreter::name(language) + " ready");
+  report(FIRST_READY, "first interpreter ready");
+}
+
+} // namespace
 
 Terminal::Terminal() {
   set_title("Experimental Terminal");
   set_default_size(800, 600);
 
+  auto &cache = Interpreter::result_cache();
+  cache.set_max_bytes(m_settings.cache_max_bytes);
+  cache.set_key_directory(m_settings.cache_key_directory);
+
+  Interpreter::chunk_cache().set_max_bytes(m_settings.compiled_max_bytes);
+
+  // Nothing the first frame does not need is done before it
+  WarmUp::Options warm_up;
+  if (m_settings.warm_up) {
+    warm_up.lua_states = m_settings.warm_up_lua_states;
+    warm_up.python = m_settings.warm_up_python;
+    warm_up.python_modules = m_settings.warm_up_python_modules;
+  }
+  if (m_settings.compiled_on_disk) {
+    warm_up.chunk_directory = Glib::build_filename(
+        Glib::get_user_cache_dir(), "terminal_gtkmm", "chunks");
+  }
+  m_warm_up = std::make_unique<WarmUp>(std::move(warm_up), report_ready);
+
+  if (s_startup_profile) {
+    signal_realize().connect([this]() {
+      m_first_frame = get_frame_clock()->signal_after_paint().connect(
+          [this]() {
+            report(FIRST_FRAME, "first frame");
+            m_first_frame.disconnect();
+          });
+    });
+  }
+
   setup_interface();
-  setup_signals();
+  m_trace_exported.connect(sigc::mem_fun(*this, &Terminal::on_trace_exported));
+
+  // Executables are indexed in the background, ready for the first Tab
+  Completion::prepare();
 }
 
+Terminal::~Terminal() = default;
+
 void Terminal::setup_interface() {
   // Configure main box
   m_main_box.set_margin(5);
@@ -36,24 +105,21 @@ void Terminal::setup_interface() {
   create_menu();
   m_main_box.append(m_menu_bar);
 
-  // Setup command area
-  setup_command_area();
+  // Sessions
+  m_notebook.set_scrollable(true);
+  m_notebook.set_vexpand(true);
+  m_notebook.signal_switch_page().connect(
+      sigc::mem_fun(*this, &Terminal::on_session_switched));
+  m_main_box.append(m_notebook);
+
+  // Status box
+  m_status_bar_box.append(m_info_status_bar);
+  m_main_box.append(m_status_bar_box);
 
   // Set the main container
   set_child(m_main_box);
 
-  // Set Interpreter
-  on_menu_interpreter(Interpreter::Languages::BASH);
-}
-
-void Terminal::setup_signals() {
-  // Button events
-  m_btn_input_execute.signal_clicked().connect(
-      sigc::mem_fun(*this, &Terminal::on_execute_command));
-  m_btn_input_clear.signal_clicked().connect(
-      sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_tools_clear), 1));
-  m_btn_output_clear.signal_clicked().connect(
-      sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_tools_clear), 2));
+  on_menu_session_new();
 }
 
 void Terminal::create_menu() {
@@ -61,7 +127,10 @@ void Terminal::create_menu() {
 
   // File menu
   auto file_menu = Gio::Menu::create();
+  file_menu->append("New Tab", "app.new_tab");
+  file_menu->append("Close Tab", "app.close_tab");
   file_menu->append("Open", "app.open");
+  file_menu->append("Execute File", "app.execute_file");
   file_menu->append("Save", "app.save");
   file_menu->append("Save as", "app.saveas");
   file_menu->append("Quit", "app.quit");
@@ -80,8 +149,37 @@ void Terminal::create_menu() {
   interpreter_menu->append("Python", "app.interpreter_python");
   interpreter_menu->append("Lua", "app.interpreter_lua");
 
+  auto bash_mode_menu = Gio::Menu::create();
+  bash_mode_menu->append("Shell Session", "app.bash_session");
+  bash_mode_menu->append("Fresh Shell", "app.bash_fresh_shell");
+
+  auto lua_state_menu = Gio::Menu::create();
+  lua_state_menu->append("Keep State", "app.lua_keep_state");
+  lua_state_menu->append("Reset Globals", "app.lua_reset_globals");
+  lua_state_menu->append("Fresh State", "app.lua_fresh_state");
+
+  auto trace_menu = Gio::Menu::create();
+  trace_menu->append("Start/Stop Recording", "app.trace_toggle");
+  trace_menu->append("Export Trace", "app.trace_export");
+
+  auto cache_menu = Gio::Menu::create();
+  cache_menu->append("Enable/Disable", "app.cache_toggle");
+  cache_menu->append("Execute Uncached", "app.run_uncached");
+  cache_menu->append("Clear Cache", "app.cache_clear");
+
+  auto python_mode_menu = Gio::Menu::create();
+  python_mode_menu->append("Shared Interpreter", "app.python_shared");
+  python_mode_menu->append("Sub-interpreters", "app.python_subinterpreters");
+
   tools_menu->append("Execute", "app.run");
+  tools_menu->append("Stop", "app.stop");
+  tools_menu->append("Find in Output", "app.find");
   tools_menu->append_submenu("Interpreter", interpreter_menu);
+  tools_menu->append_submenu("Bash Mode", bash_mode_menu);
+  tools_menu->append_submenu("Lua State", lua_state_menu);
+  tools_menu->append_submenu("Python Mode", python_mode_menu);
+  tools_menu->append_submenu("Cache", cache_menu);
+  tools_menu->append_submenu("Trace", trace_menu);
   tools_menu->append_submenu("Clear", clear_menu);
 
   menu_model->append_submenu("Tools", tools_menu);
@@ -98,12 +196,20 @@ void Terminal::create_menu() {
   auto app = Gtk::Application::get_default();
   if (app) {
     // File
+    app->add_action("new_tab",
+                    sigc::mem_fun(*this, &Terminal::on_menu_session_new));
+    app->add_action("close_tab",
+                    sigc::mem_fun(*this, &Terminal::on_menu_session_close));
     app->add_action("open", sigc::mem_fun(*this, &Terminal::on_menu_file_open));
+    app->add_action("execute_file",
+                    sigc::mem_fun(*this, &Terminal::on_menu_file_execute));
     app->add_action("save", sigc::mem_fun(*this, &Terminal::on_menu_file_save));
     app->add_action("saveas",
                     sigc::mem_fun(*this, &Terminal::on_menu_file_saveAs));
     app->add_action("quit", sigc::mem_fun(*this, &Terminal::on_menu_file_quit));
-    app->add_action("run", sigc::mem_fun(*this, &Terminal::on_execute_command));
+    app->add_action("run", [this]() { session().execute_input(); });
+    app->add_action("stop", [this]() { session().stop_commands(); });
+    app->add_action("find", [this]() { session().find_in_output(); });
     // Interpreter
     app->add_action(
         "interpreter_bash",
@@ -117,6 +223,49 @@ void Terminal::create_menu() {
         "interpreter_lua",
         sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_interpreter),
                    Interpreter::Languages::LUA));
+    // Bash mode
+    app->add_action(
+        "bash_session",
+        sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_bash_mode),
+                   Interpreter::BashMode::SHELL_SESSION));
+    app->add_action(
+        "bash_fresh_shell",
+        sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_bash_mode),
+                   Interpreter::BashMode::FRESH_SHELL));
+    // Lua state
+    app->add_action(
+        "lua_keep_state",
+        sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_lua_reset),
+                   Interpreter::LuaReset::KEEP_STATE));
+    app->add_action(
+        "lua_reset_globals",
+        sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_lua_reset),
+                   Interpreter::LuaReset::RESET_GLOBALS));
+    app->add_action(
+        "lua_fresh_state",
+        sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_lua_reset),
+                   Interpreter::LuaReset::FRESH_STATE));
+    // Python mode
+    app->add_action(
+        "python_shared",
+        sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_python_mode),
+                   Interpreter::PythonMode::SHARED_INTERPRETER));
+    app->add_action(
+        "python_subinterpreters",
+        sigc::bind(sigc::mem_fun(*this, &Terminal::on_menu_python_mode),
+                   Interpreter::PythonMode::SUBINTERPRETERS));
+    // Cache
+    app->add_action("cache_toggle",
+                    sigc::mem_fun(*this, &Terminal::on_menu_cache_toggle));
+    app->add_action("run_uncached",
+                    [this]() { session().execute_input(true); });
+    app->add_action("cache_clear",
+                    sigc::mem_fun(*this, &Terminal::on_menu_cache_clear));
+    // Trace
+    app->add_action("trace_toggle",
+                    sigc::mem_fun(*this, &Terminal::on_menu_trace_toggle));
+    app->add_action("trace_export",
+                    sigc::mem_fun(*this, &Terminal::on_menu_trace_export));
     // Clear
     app->add_action(
         "clear",
@@ -154,35 +303,16 @@ void Terminal::on_menu_file_open() {
       if (response_id == Gtk::ResponseType::ACCEPT) {
         if (auto f = m_pFileDialog->get_file()) {
           m_path = f->get_path();
-          // Read file content
-          std::ifstream file(m_path);
-          if (!file) {
-            Gtk::MessageDialog error_dialog(*this, "Failed to open file.",
-                                            false, Gtk::MessageType::ERROR);
-            error_dialog.set_modal(true);
-            error_dialog.present();
-            return;
-          }
           // Determine interpreter by file extension
-          if (m_path.ends_with(".py")) {
-            m_interpreter_type = Interpreter::Languages::PYTHON;
-          } else if (m_path.ends_with(".lua")) {
-            m_interpreter_type = Interpreter::Languages::LUA;
-          } else if (m_path.ends_with(".sh")) {
-            m_interpreter_type = Interpreter::Languages::BASH;
-          } else {
+          int language = Interpreter::language_of(m_path);
+          if (language == Interpreter::Languages::DEFAULT) {
             Gtk::MessageDialog error_dialog(*this, "Unsupported file type.",
                                             false, Gtk::MessageType::ERROR);
             error_dialog.set_modal(true);
             error_dialog.present();
             return;
           }
-          // Updates
-          std::ostringstream buffer;
-          buffer << file.rdbuf();
-          on_menu_tools_clear();
-          on_menu_interpreter(m_interpreter_type);
-          m_command_input_buffer->set_text(buffer.str());
+          session().load_script(m_path, language);
         }
       }
       m_pFileDialog->hide();
@@ -192,64 +322,77 @@ void Terminal::on_menu_file_open() {
   m_pFileDialog->show();
 }
 
-void Terminal::on_menu_file_save() {
-  // Get texts
-  auto input_text = m_command_input_buffer->get_text();
-  auto output_text = m_command_output_buffer->get_text();
-
-  if (input_text.empty()) {
-    m_info_input.set_label("Empty command input! Enter a command:");
-    return;
+void Terminal::on_menu_file_execute() {
+  if (!m_pExecuteDialog) {
+    // Filters
+    auto filter_text = Gtk::FileFilter::create();
+    filter_text->set_name("Script Files");
+    filter_text->add_pattern("*.py");
+    filter_text->add_pattern("*.lua");
+    filter_text->add_pattern("*.sh");
+    // Dialog
+    m_pExecuteDialog.reset(new Gtk::FileChooserDialog(
+        "Select a script file to execute", Gtk::FileChooser::Action::OPEN));
+    m_pExecuteDialog->set_transient_for(*this);
+    m_pExecuteDialog->set_modal(true);
+    m_pExecuteDialog->set_hide_on_close(true);
+    m_pExecuteDialog->add_button("_Cancel", Gtk::ResponseType::CANCEL);
+    m_pExecuteDialog->add_button("_Execute", Gtk::ResponseType::ACCEPT);
+    m_pExecuteDialog->add_filter(filter_text);
+    m_pExecuteDialog->signal_response().connect([this](int response_id) {
+      if (response_id == Gtk::ResponseType::ACCEPT) {
+        if (auto f = m_pExecuteDialog->get_file()) {
+          auto path = f->get_path();
+          int language = Interpreter::language_of(path);
+          if (language == Interpreter::Languages::DEFAULT) {
+            m_info_status_bar.set_text("Unsupported file type: " + path);
+          } else {
+            session().execute_file(path, language);
+          }
+        }
+      }
+      m_pExecuteDialog->hide();
+    });
   }
 
-  if (output_text.empty()) {
-    m_info_output.set_label("Empty output!");
+  m_pExecuteDialog->show();
+}
+
+void Terminal::on_menu_file_save() {
+  auto &session = this->session();
+  if (!session.can_save()) {
     return;
   }
 
   if (m_path.empty()) {
-    on_menu_file_saveAs();
+    on_menu_file_saveAs(); // Saves once a folder is selected
+    return;
   }
 
-  g_message("[Terminal App] Path: %s", m_path.c_str());
-
-  auto filename = "terminal_commands.txt";
-  auto path = m_path + "/" + filename;
-  if (save(path, input_text)) {
-    m_info_input.set_text("Save in " + m_path + " ... " + filename);
-  } else {
-    m_info_input.set_text("There was something wrong!");
-  }
-  filename = "terminal_result.txt";
-  path = m_path + "/" + filename;
-  if (save(path, output_text)) {
-    m_info_output.set_text("Save in " + m_path + " ... " + filename);
-  } else {
-    m_info_output.set_text("There was something wrong!");
-  }
+  session.save(m_path);
 }
 
 void Terminal::on_menu_file_saveAs() {
-  if (!m_pFileDialog) {
-    m_pFileDialog.reset(new Gtk::FileChooserDialog(
+  if (!m_pSaveDialog) {
+    m_pSaveDialog.reset(new Gtk::FileChooserDialog(
         "Select Folder", Gtk::FileChooser::Action::SELECT_FOLDER));
-    m_pFileDialog->set_transient_for(*this);
-    m_pFileDialog->set_modal(true);
-    m_pFileDialog->set_hide_on_close(true);
-    m_pFileDialog->add_button("_Cancel", Gtk::ResponseType::CANCEL);
-    m_pFileDialog->add_button("_Select", Gtk::ResponseType::ACCEPT);
-    m_pFileDialog->signal_response().connect([this](int response_id) {
+    m_pSaveDialog->set_transient_for(*this);
+    m_pSaveDialog->set_modal(true);
+    m_pSaveDialog->set_hide_on_close(true);
+    m_pSaveDialog->add_button("_Cancel", Gtk::ResponseType::CANCEL);
+    m_pSaveDialog->add_button("_Select", Gtk::ResponseType::ACCEPT);
+    m_pSaveDialog->signal_response().connect([this](int response_id) {
       if (response_id == Gtk::ResponseType::ACCEPT) {
-        if (auto file = m_pFileDialog->get_file()) {
+        if (auto file = m_pSaveDialog->get_file()) {
           m_path = file->get_path();
           on_menu_file_save();
         }
       }
-      m_pFileDialog->hide();
+      m_pSaveDialog->hide();
     });
   }
 
-  m_pFileDialog->show();
+  m_pSaveDialog->show();
 }
 
 void Terminal::on_menu_file_quit() { close(); }
@@ -272,161 +415,171 @@ void Terminal::on_menu_help_about() {
 }
 
 void Terminal::on_menu_tools_clear(int operation) {
-  // 0 (input and output), 1 (input), 2 (output)
-  if (operation == 0 || operation == 1) {
-    m_command_input_buffer->set_text("");
-    m_info_input.set_label("Enter a command:");
-  }
-  if (operation == 0 || operation == 2) {
-    m_command_output_buffer->set_text("");
-    m_info_output.set_label("Result:");
-  }
+  session().clear(operation);
 }
 
 void Terminal::on_menu_interpreter(int interpreter_type) {
-  m_interpreter_type = interpreter_type;
+  session().set_language(interpreter_type);
   std::string interpreter = Interpreter::name(interpreter_type);
   m_info_status_bar.set_text(!interpreter.empty()
                                  ? "Interpreter: " + interpreter
                                  : "Undefined Interpreter");
 }
 
-void Terminal::setup_command_area() {
-  // Configure label
-  m_info_input.set_label("Enter the command:");
-  m_info_output.set_label("");
-
-  // Configure input area
-  m_command_input.set_left_margin(15);
-  m_command_input.set_monospace(true);
-  m_command_input.set_top_margin(15);
-  m_command_input.set_wrap_mode(Gtk::WrapMode::WORD_CHAR);
-  m_command_input_buffer = m_command_input.get_buffer();
-
-  auto tag = m_command_input_buffer->create_tag();
-  tag->property_foreground() = "#00FF00"; // Define green color
-
-  m_command_input_buffer->signal_changed().connect([this, tag]() {
-    m_command_input_buffer->apply_tag(tag, m_command_input_buffer->begin(),
-                                      m_command_input_buffer->end());
-  });
-
-  m_input_scroll.set_child(m_command_input);
-  m_input_scroll.set_vexpand(true);
-
-  // Configure input buttons
-  m_btn_input_clear.set_label("Clear");
-  m_btn_input_clear.set_margin(5);
-
-  m_btn_input_execute.set_label("Execute");
-  m_btn_input_execute.set_margin(5);
-
-  // Configure output area
-  m_command_output.set_cursor_visible(false);
-  m_command_output.set_editable(false);
-  m_command_output.set_left_margin(15);
-  m_command_output.set_monospace(true);
-  m_command_output.set_top_margin(15);
-  m_command_output.set_wrap_mode(Gtk::WrapMode::WORD_CHAR);
-  m_command_output_buffer = m_command_output.get_buffer();
-
-  m_output_scroll.set_child(m_command_output);
-  m_output_scroll.set_vexpand(true);
+void Terminal::on_menu_bash_mode(int mode) {
+  Interpreter::set_bash_mode(static_cast<Interpreter::BashMode>(mode));
+  m_info_status_bar.set_text(mode == Interpreter::BashMode::SHELL_SESSION
+                                 ? "Bash: Shell Session"
+                                 : "Bash: Fresh Shell");
+}
 
-  // Configure output buttons
-  m_btn_output_clear.set_label("Clear");
-  m_btn_output_clear.set_margin(5);
+void Terminal::on_menu_lua_reset(int policy) {
+  static const std::vector<std::string> names{"Keep State", "Reset Globals",
+                                              "Fresh State"};
+  Interpreter::set_lua_reset(static_cast<Interpreter::LuaReset>(policy));
+  m_info_status_bar.set_text("Lua: " + names.at(policy));
+}
 
-  // Tool box
-  m_input_tool_box.append(m_btn_input_clear);
-  m_input_tool_box.append(m_btn_input_execute);
-  m_output_tool_box.append(m_btn_output_clear);
+void Terminal::on_menu_python_mode(int mode) {
+  if (!Interpreter::set_python_mode(
+          static_cast<Interpreter::PythonMode>(mode))) {
+    m_info_status_bar.set_text(
+        "Python: sub-interpreters need Python 3.12 or newer");
+    return;
+  }
+  m_info_status_bar.set_text(mode == Interpreter::PythonMode::SUBINTERPRETERS
+                                 ? "Python: Sub-interpreters"
+                                 : "Python: Shared Interpreter");
+}
 
-  // Status box
-  m_status_bar_box.append(m_info_status_bar);
+auto Terminal::session() -> Session & {
+  return *m_sessions.at(std::max(m_notebook.get_current_page(), 0));
+}
 
-  // Main box
-  m_main_box.append(m_info_input);
-  m_main_box.append(m_input_scroll);
-  m_main_box.append(m_input_tool_box);
-  m_main_box.append(m_info_output);
-  m_main_box.append(m_output_scroll);
-  m_main_box.append(m_output_tool_box);
-  m_main_box.append(m_status_bar_box);
+void Terminal::on_menu_session_new() {
+  // Added before its page, which the notebook may switch to right away
+  m_sessions.push_back(std::make_unique<Session>(
+      m_executor, m_settings,
+      [this](int language) -> History & { return history(language); },
+      [this](const std::string &text) { m_info_status_bar.set_text(text); }));
+  auto *label = Gtk::make_managed<Gtk::Label>(
+      "Session " + std::to_string(m_next_session++));
+  int page = m_notebook.append_page(*m_sessions.back(), *label);
+  m_notebook.set_current_page(page);
+
+  // The session shell starts before the first command
+  if (m_settings.warm_up) {
+    m_executor.submit([interpreter = m_sessions.back()->interpreter()]() {
+      if (interpreter->prepare()) {
+        report_ready(Interpreter::Languages::BASH);
+      }
+    });
+  }
 }
 
-void Terminal::on_execute_command() {
-  auto command = m_command_input_buffer->get_text();
-  if (command.empty()) {
-    m_info_input.set_label("Empty command input! Enter a command:");
+void Terminal::on_menu_session_close() {
+  if (m_sessions.size() <= 1) {
+    m_info_status_bar.set_text("The last session cannot be closed");
     return;
   }
+  // Taken out first: pages and sessions keep the same indices when the
+  // notebook switches to the next page. Its running commands are stopped,
+  // their interpreter goes with the last of them.
+  int page = m_notebook.get_current_page();
+  auto closing = std::move(m_sessions.at(page));
+  m_sessions.erase(m_sessions.begin() + page);
+  m_notebook.remove_page(page);
+}
 
-  try {
-    // Execute command and show output
-    auto output = execute_command(command.data());
-    append_to_output(output);
-  } catch (const std::exception &e) {
-    append_to_output(e.what(), true);
+void Terminal::on_session_switched(Gtk::Widget *, guint number) {
+  if (number < m_sessions.size()) {
+    m_info_status_bar.set_text(
+        "Interpreter: " + Interpreter::name(m_sessions[number]->language()));
   }
 }
 
-auto Terminal::execute_command(const std::string_view command) -> std::string {
-  return Interpreter::execute_command(command, m_interpreter_type);
+auto Terminal::history(int language) -> History & {
+  auto &history = m_histories.at(language);
+  if (!history) {
+    std::string name = Interpreter::name(language);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    history = std::make_unique<History>(
+        Glib::build_filename(Glib::get_user_data_dir(), "terminal_gtkmm",
+                             "history", name + ".log"));
+  }
+  return *history;
 }
 
-void Terminal::append_to_output(const std::string_view text, bool is_error) {
-  auto end = m_command_output_buffer->end();
-
-  if (is_error) {
-    // Create tag for error text if it doesn't exist
-    auto tag = m_command_output_buffer->get_tag_table()->lookup("error");
-    if (!tag) {
-      tag = m_command_output_buffer->create_tag("error");
-      tag->property_foreground() = "#FF0000";
-    }
-    m_command_output_buffer->insert_with_tag(end, text.data(), tag);
-  } else {
-    auto tag = m_command_output_buffer->get_tag_table()->lookup("ok");
-    if (!tag) {
-      tag = m_command_output_buffer->create_tag("ok");
-      tag->property_foreground() = "#95A3FC";
-    }
-    std::string txt = text.data();
-    m_command_output_buffer->insert_with_tag(end, txt + "\n", tag);
-  }
+void Terminal::on_menu_cache_toggle() {
+  auto &cache = Interpreter::result_cache();
+  cache.set_enabled(!cache.enabled());
+  m_info_status_bar.set_text(cache.enabled() ? "Cache: on" : "Cache: off");
+}
 
-  // Scroll to end
-  auto mark = m_command_output_buffer->create_mark(end);
-  m_command_output.scroll_to(mark);
+void Terminal::on_menu_cache_clear() {
+  auto &cache = Interpreter::result_cache();
+  char text[96];
+  std::snprintf(text, sizeof(text), "Cache: cleared %zu result(s), %.1f MB",
+                cache.entries(), cache.bytes() / 1e6);
+  cache.clear();
+  m_info_status_bar.set_text(text);
+}
 
-  // Limit buffer size
-  if (m_command_output_buffer->get_char_count() > MAX_OUTPUT_BUFFER_SIZE) {
-    auto start = m_command_output_buffer->begin();
-    auto end = m_command_output_buffer->get_iter_at_offset(
-        m_command_output_buffer->get_char_count() - MAX_OUTPUT_BUFFER_SIZE);
-    m_command_output_buffer->erase(start, end);
+void Terminal::on_menu_trace_toggle() {
+  if (!Trace::enabled()) {
+    Trace::clear();
+    Trace::set_enabled(true);
+    m_info_status_bar.set_text("Trace: recording");
+    return;
   }
+  Trace::set_enabled(false);
+  on_menu_trace_export();
 }
 
-auto Terminal::save(std::string path, std::string text) -> bool {
-  if (!text.empty()) {
-    try {
-      std::fstream fileout;
-      fileout.open(path, std::ios::out);
-      fileout << text;
-      fileout.close();
-    } catch (...) {
-      return false;
+void Terminal::on_menu_trace_export() {
+  auto directory = Glib::build_filename(Glib::get_user_cache_dir(),
+                                        "terminal_gtkmm");
+  g_mkdir_with_parents(directory.c_str(), 0755);
+  auto path = Glib::build_filename(
+      directory, "trace-" + std::to_string(g_get_real_time() / 1000000) +
+                     ".json");
+
+  // Up to a million events: written on a worker, reported back through
+  // m_trace_exported
+  m_info_status_bar.set_text("Trace: writing " + path);
+  m_executor.submit([this, path]() {
+    auto error = Trace::export_chrome(path);
+    {
+      std::lock_guard lock(m_trace_mutex);
+      m_trace_report =
+          error.empty() ? "Trace written to " + path : "Trace: " + error;
     }
-  }
-  return true;
+    m_trace_exported.emit();
+  });
+}
+
+void Terminal::on_trace_exported() {
+  std::lock_guard lock(m_trace_mutex);
+  m_info_status_bar.set_text(m_trace_report);
 }
 
 // Main
 auto terminal(int argc, char *argv[]) -> int {
+  s_startup_us = Trace::now_us();
+
+  // Handled here: GApplication rejects options it does not know
+  auto last = std::remove_if(argv + 1, argv + argc, [](const char *argument) {
+    return std::strcmp(argument, "--startup-profile") == 0;
+  });
+  s_startup_profile = last != argv + argc;
+  argc = static_cast<int>(last - argv);
+  argv[argc] = nullptr;
+
   auto app = Gtk::Application::create("com.gtkmm.app.terminal");
   const int status = app->make_window_and_run<Terminal>(argc, argv);
 
+  Interpreter::shutdown();
+
   return status;
 }
@@ -0,0 +1,311 @@
+#include "tokenizer.hpp"
+#include "interpreter.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+constexpr std::array<std::string_view, 29> s_bash_keywords{
+    "break",  "case",    "continue", "declare", "do",       "done",
+    "elif",   "else",    "esac",     "exit",    "export",   "fi",
+    "for",    "function", "if",      "in",      "local",    "readonly",
+    "return", "select",  "shift",    "source",  "then",     "time",
+    "unset",  "until",   "while",    "echo",    "cd"};
+
+constexpr std::array<std::string_view, 35> s_python_keywords{
+    "False", "None",   "True",    "and",      "as",     "assert", "async",
+    "await", "break",  "class",   "continue", "def",    "del",    "elif",
+    "else",  "except", "finally", "for",      "from",   "global", "if",
+    "import", "in",    "is",      "lambda",   "nonlocal", "not",  "or",
+    "pass",  "raise",  "return",  "try",      "while",  "with",   "yield"};
+
+constexpr std::array<std::string_view, 22> s_lua_keywords{
+    "and",   "break", "do",     "else",   "elseif", "end",
+    "false", "for",   "function", "goto", "if",     "in",
+    "local", "nil",   "not",    "or",     "repeat", "return",
+    "then",  "true",  "until",  "while"};
+
+template <size_t N>
+auto is_keyword(const std::array<std::string_view, N> &keywords,
+                const std::string_view word) -> bool {
+  return std::find(keywords.begin(), keywords.end(), word) != keywords.end();
+}
+
+auto is_word_start(char c) -> bool {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+auto is_word_char(char c) -> bool {
+  return is_word_start(c) || (c >= '0' && c <= '9');
+}
+
+auto is_digit(char c) -> bool { return c >= '0' && c <= '9'; }
+
+// End of a word starting at i
+auto word_end(const std::string_view line, size_t i) -> size_t {
+  while (i < line.size() && is_word_char(line[i])) {
+    ++i;
+  }
+  return i;
+}
+
+// End of a number starting at i (decimal, hex, floats, exponents)
+auto number_end(const std::string_view line, size_t i) -> size_t {
+  while (i < line.size() &&
+         (is_word_char(line[i]) || line[i] == '.' ||
+          ((line[i] == '+' || line[i] == '-') &&
+           (line[i - 1] == 'e' || line[i - 1] == 'E')))) {
+    ++i;
+  }
+  return i;
+}
+
+// Position after the closing quote (or npos), honouring backslash escapes
+auto quoted_end(const std::string_view line, size_t i, char quote,
+                bool escapes = true) -> size_t {
+  for (; i < line.size(); ++i) {
+    if (escapes && line[i] == '\\') {
+      ++i;
+    } else if (line[i] == quote) {
+      return i + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+} // namespace
+
+auto Tokenizer::lex_line(int language, const std::string_view line,
+                         State state, std::vector<Token> &tokens) -> State {
+  tokens.clear();
+  if (language == Interpreter::Languages::BASH) {
+    return lex_bash(line, state, tokens);
+  }
+  if (language == Interpreter::Languages::PYTHON) {
+    return lex_python(line, state, tokens);
+  }
+  if (language == Interpreter::Languages::LUA) {
+    return lex_lua(line, state, tokens);
+  }
+  return 0;
+}
+
+// States: 0 code, 1 inside '...', 2 inside "..."
+auto Tokenizer::lex_bash(const std::string_view line, State state,
+                         std::vector<Token> &tokens) -> State {
+  size_t i = 0;
+
+  if (state == 1 || state == 2) {
+    size_t end = quoted_end(line, 0, state == 1 ? '\'' : '"', state == 2);
+    if (end == std::string_view::npos) {
+      tokens.push_back({0, line.size(), STRING});
+      return state;
+    }
+    tokens.push_back({0, end, STRING});
+    i = end;
+  }
+
+  while (i < line.size()) {
+    char c = line[i];
+    bool word_boundary = i == 0 || line[i - 1] == ' ' || line[i - 1] == '\t' ||
+                         line[i - 1] == ';';
+    if (c == '#' && word_boundary) {
+      tokens.push_back({i, line.size() - i, COMMENT});
+      return 0;
+    }
+    if (c == '\'' || c == '"') {
+      size_t end = quoted_end(line, i + 1, c, c == '"');
+      if (end == std::string_view::npos) {
+        tokens.push_back({i, line.size() - i, STRING});
+        return c == '\'' ? 1 : 2;
+      }
+      tokens.push_back({i, end - i, STRING});
+      i = end;
+    } else if (c == '$' && i + 1 < line.size()) {
+      size_t end = i + 1;
+      if (line[end] == '{') {
+        end = line.find('}', end);
+        end = end == std::string_view::npos ? line.size() : end + 1;
+      } else if (is_word_start(line[end])) {
+        end = word_end(line, end);
+      } else {
+        ++end; // $?, $1, $@ ...
+      }
+      tokens.push_back({i, end - i, VARIABLE});
+      i = end;
+    } else if (is_word_start(c)) {
+      size_t end = word_end(line, i);
+      if (word_boundary && is_keyword(s_bash_keywords, line.substr(i, end - i))) {
+        tokens.push_back({i, end - i, KEYWORD});
+      }
+      i = end;
+    } else if (is_digit(c) && word_boundary) {
+      size_t end = number_end(line, i);
+      tokens.push_back({i, end - i, NUMBER});
+      i = end;
+    } else {
+      ++i;
+    }
+  }
+  return 0;
+}
+
+// States: 0 code, 1 inside ''' string, 2 inside """ string
+auto Tokenizer::lex_python(const std::string_view line, State state,
+                           std::vector<Token> &tokens) -> State {
+  size_t i = 0;
+
+  auto triple_end = [&line](size_t from, char quote) -> size_t {
+    const char delimiter[] = {quote, quote, quote, '\0'};
+    for (size_t p = from; p < line.size(); ++p) {
+      if (line[p] == '\\') {
+        ++p;
+      } else if (line.compare(p, 3, delimiter) == 0) {
+        return p + 3;
+      }
+    }
+    return std::string_view::npos;
+  };
+
+  if (state == 1 || state == 2) {
+    size_t end = triple_end(0, state == 1 ? '\'' : '"');
+    if (end == std::string_view::npos) {
+      tokens.push_back({0, line.size(), STRING});
+      return state;
+    }
+    tokens.push_back({0, end, STRING});
+    i = end;
+  }
+
+  while (i < line.size()) {
+    char c = line[i];
+    if (c == '#') {
+      tokens.push_back({i, line.size() - i, COMMENT});
+      return 0;
+    }
+    if (c == '\'' || c == '"') {
+      size_t start = i;
+      // String prefixes (r, b, f, u, rb, ...) are part of the token
+      while (start > 0 && is_word_start(line[start - 1]) &&
+             std::string_view("rRbBfFuU").find(line[start - 1]) !=
+                 std::string_view::npos) {
+        --start;
+      }
+      if (line.compare(i, 3, std::string(3, c)) == 0) {
+        size_t end = triple_end(i + 3, c);
+        if (end == std::string_view::npos) {
+          tokens.push_back({start, line.size() - start, STRING});
+          return c == '\'' ? 1 : 2;
+        }
+        tokens.push_back({start, end - start, STRING});
+        i = end;
+        continue;
+      }
+      size_t end = quoted_end(line, i + 1, c);
+      end = end == std::string_view::npos ? line.size() : end;
+      tokens.push_back({start, end - start, STRING});
+      i = end;
+    } else if (is_word_start(c)) {
+      size_t end = word_end(line, i);
+      if (is_keyword(s_python_keywords, line.substr(i, end - i))) {
+        tokens.push_back({i, end - i, KEYWORD});
+      }
+      i = end;
+    } else if (is_digit(c)) {
+      size_t end = number_end(line, i);
+      tokens.push_back({i, end - i, NUMBER});
+      i = end;
+    } else {
+      ++i;
+    }
+  }
+  return 0;
+}
+
+// States: 0 code; STRING_STATE + level inside a long string [=[ ... ]=];
+// COMMENT_STATE + level inside a long comment --[=[ ... ]=]
+auto Tokenizer::lex_lua(const std::string_view line, State state,
+                        std::vector<Token> &tokens) -> State {
+  constexpr State STRING_STATE = 0x100;
+  constexpr State COMMENT_STATE = 0x200;
+
+  // Level of a long bracket opening at i ([[, [=[, ...), or -1
+  auto long_open = [&line](size_t i) -> int {
+    if (i >= line.size() || line[i] != '[') {
+      return -1;
+    }
+    size_t p = i + 1;
+    while (p < line.size() && line[p] == '=') {
+      ++p;
+    }
+    return p < line.size() && line[p] == '[' ? static_cast<int>(p - i - 1)
+                                             : -1;
+  };
+
+  // Position after the long bracket closing of the given level, or npos
+  auto long_close = [&line](size_t from, State level) -> size_t {
+    std::string delimiter = "]" + std::string(level, '=') + "]";
+    size_t p = line.find(delimiter, from);
+    return p == std::string_view::npos ? p : p + delimiter.size();
+  };
+
+  size_t i = 0;
+  if (state >= STRING_STATE) {
+    bool comment = state >= COMMENT_STATE;
+    State level = state - (comment ? COMMENT_STATE : STRING_STATE);
+    size_t end = long_close(0, level);
+    if (end == std::string_view::npos) {
+      tokens.push_back({0, line.size(), comment ? COMMENT : STRING});
+      return state;
+    }
+    tokens.push_back({0, end, comment ? COMMENT : STRING});
+    i = end;
+  }
+
+  while (i < line.size()) {
+    char c = line[i];
+    if (c == '-' && i + 1 < line.size() && line[i + 1] == '-') {
+      int level = long_open(i + 2);
+      if (level >= 0) {
+        size_t end = long_close(i + 4 + level, level);
+        if (end == std::string_view::npos) {
+          tokens.push_back({i, line.size() - i, COMMENT});
+          return COMMENT_STATE + level;
+        }
+        tokens.push_back({i, end - i, COMMENT});
+        i = end;
+        continue;
+      }
+      tokens.push_back({i, line.size() - i, COMMENT});
+      return 0;
+    }
+    if (int level = long_open(i); level >= 0) {
+      size_t end = long_close(i + 2 + level, level);
+      if (end == std::string_view::npos) {
+        tokens.push_back({i, line.size() - i, STRING});
+        return STRING_STATE + level;
+      }
+      tokens.push_back({i, end - i, STRING});
+      i = end;
+    } else if (c == '\'' || c == '"') {
+      size_t end = quoted_end(line, i + 1, c);
+      end = end == std::string_view::npos ? line.size() : end;
+      tokens.push_back({i, end - i, STRING});
+      i = end;
+    } else if (is_word_start(c)) {
+      size_t end = word_end(line, i);
+      if (is_keyword(s_lua_keywords, line.substr(i, end - i))) {
+        tokens.push_back({i, end - i, KEYWORD});
+      }
+      i = end;
+    } else if (is_digit(c)) {
+      size_t end = number_end(line, i);
+      tokens.push_back({i, end - i, NUMBER});
+      i = end;
+    } else {
+      ++i;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include "trace.hpp"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+std::atomic<bool> Trace::s_enabled{false};
+std::mutex Trace::s_mutex;
+std::deque<Trace::Event> Trace::s_events;
+
+namespace {
+
+thread_local uint64_t s_command = 0;
+
+// Small ids are easier to read in the trace viewer than pthread ids
+auto thread_id() -> uint32_t {
+  static std::atomic<uint32_t> next{1};
+  thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+auto thread_cpu_us() -> int64_t {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1'000'000 + ts.tv_nsec / 1000;
+}
+
+// Resident set size from /proc/self/statm (one pread on a cached fd)
+auto rss_kb() -> int64_t {
+  static int fd = ::open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  static long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+  char buffer[128];
+  ssize_t n = fd >= 0 ? ::pread(fd, buffer, sizeof(buffer) - 1, 0) : -1;
+  if (n <= 0) {
+    return 0;
+  }
+  buffer[n] = '\0';
+  unsigned long size = 0, resident = 0;
+  if (std::sscanf(buffer, "%lu %lu", &size, &resident) != 2) {
+    return 0;
+  }
+  return static_cast<int64_t>(resident) * page_kb;
+}
+
+} // namespace
+
+void Trace::Span::begin(const char *name, uint64_t command) {
+  m_name = name;
+  m_command = command;
+  m_rss_kb = rss_kb();
+  m_cpu_us = thread_cpu_us();
+  m_start_us = now_us();
+}
+
+void Trace::Span::end() {
+  int64_t end_us = now_us();
+  Trace::record({m_name, m_command, thread_id(), m_start_us,
+                 end_us - m_start_us, thread_cpu_us() - m_cpu_us,
+                 rss_kb() - m_rss_kb, m_bytes});
+}
+
+void Trace::set_enabled(bool enabled) {
+  s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+auto Trace::command() -> uint64_t { return s_command; }
+
+void Trace::set_command(uint64_t command) { s_command = command; }
+
+auto Trace::now_us() -> int64_t {
+  static const auto origin = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - origin)
+      .count();
+}
+
+void Trace::record(const Event &event) {
+  std::lock_guard lock(s_mutex);
+  if (s_events.size() >= MAX_EVENTS) {
+    s_events.pop_front(); // Keeps the most recent events
+  }
+  s_events.push_back(event);
+  s_events.back().thread = event.thread ? event.thread : thread_id();
+}
+
+auto Trace::events(uint64_t command) -> std::vector<Event> {
+  std::lock_guard lock(s_mutex);
+  std::vector<Event> events;
+  for (const auto &event : s_events) {
+    if (event.command == command) {
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+void Trace::clear() {
+  std::lock_guard lock(s_mutex);
+  s_events.clear();
+}
+
+auto Trace::export_chrome(const std::string &path) -> std::string {
+  std::deque<Event> events;
+  {
+    std::lock_guard lock(s_mutex);
+    events = s_events;
+  }
+
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (!file) {
+    return "Failed to open " + path;
+  }
+  // Complete events ("ph": "X"); names are literals, no escaping needed
+  std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  for (size_t i = 0; i < events.size(); ++i) {
+    const auto &e = events[i];
+    std::fprintf(file,
+                 "{\"name\": \"%s\", \"cat\": \"terminal\", \"ph\": \"X\", "
+                 "\"pid\": %d, \"tid\": %u, \"ts\": %lld, \"dur\": %lld, "
+                 "\"args\": {\"command\": %llu, \"cpu_us\": %lld, "
+                 "\"rss_delta_kb\": %lld, \"bytes\": %llu}}%s\n",
+                 e.name, static_cast<int>(getpid()), e.thread,
+                 static_cast<long long>(e.start_us),
+                 static_cast<long long>(e.wall_us),
+                 static_cast<unsigned long long>(e.command),
+                 static_cast<long long>(e.cpu_us),
+                 static_cast<long long>(e.rss_delta_kb),
+                 static_cast<unsigned long long>(e.bytes),
+                 i + 1 < events.size() ? "," : "");
+  }
+  std::fprintf(file, "]}\n");
+  bool failed = std::ferror(file) != 0;
+  if (std::fclose(file) != 0 || failed) {
+    return "Failed to write " + path;
+  }
+  return "";
+}
@@ -0,0 +1,39 @@
+/*
+ * References:
+ *    https://docs.python.org/3/c-api/init.html#c.Py_InitializeEx
+ *    https://docs.python.org/3/c-api/import.html
+ */
+#include "warm_up.hpp"
+#include "chunk_cache.hpp"
+#include "interpreter.hpp"
+#include "trace.hpp"
+
+#include <utility>
+
+WarmUp::WarmUp(Options options, ReadyHandler on_ready)
+    : m_options(std::move(options)), m_on_ready(std::move(on_ready)),
+      m_thread([this](std::stop_token stop) { run(stop); }) {}
+
+WarmUp::~WarmUp() = default;
+
+void WarmUp::run(std::stop_token stop) {
+  Trace::Span span("warm_up", 0);
+
+  // Cheapest first, so that some interpreter is ready as soon as possible
+  if (m_options.lua_states > 0) {
+    Interpreter::prepare_lua(m_options.lua_states);
+    m_on_ready(Interpreter::Languages::LUA);
+  }
+
+  // Pruning reads the whole cache directory
+  if (!stop.stop_requested() && !m_options.chunk_directory.empty()) {
+    Interpreter::chunk_cache().set_directory(m_options.chunk_directory);
+  }
+
+  if (!stop.stop_requested() && m_options.python) {
+    Interpreter::prepare_python(m_options.python_modules, stop);
+    if (!stop.stop_requested()) {
+      m_on_ready(Interpreter::Languages::PYTHON);
+    }
+  }
+}